@@ -0,0 +1,35 @@
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "Regression.h"
+
+// Compares the benchmarks of two result files of a test driver, e.g.
+// Compare baseline/WatchTest.json bin/logs/WatchTest.json 0.1
+int main(int argc, char* argv[])
+{
+   if(argc < 3)
+   {
+      std::cerr << "Usage: Compare <baseline.json> <current.json> "
+         << "[threshold]" << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   std::vector<aire::Test::Benchmark> baseline;
+   std::vector<aire::Test::Benchmark> current;
+   std::ifstream baselineFile(argv[1]);
+   std::ifstream currentFile(argv[2]);
+   if(!aire::Regression::Read(baselineFile, baseline) || 
+      !aire::Regression::Read(currentFile, current))
+   {
+      std::cerr << "Cannot read " << argv[1] << " or " << argv[2] << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   double threshold = (argc > 3) ? std::atof(argv[3]) : 0.05;
+   size_t numSlower = aire::Regression::Print(std::cout, 
+      aire::Regression::Compare(baseline, current, threshold));
+   return (numSlower > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,161 +1,148 @@
 #include <cstdlib>
-#include <cstring>
 #include <iostream>
+#include <string>
 
-// Frage: Wann wird neuer Zustand ausgefuehrt? 
-// In welchem Zeit bereich der Zeitscheibe ?
+#include "StateMachine.h"
 
 namespace State {
 enum Machine {
-   ON  = 1,  // On
-   OFF = 2,  // Off
-   SET = 3,  // Set velocity (CRUISE)
-   RES = 4,  // Resume velocity (CRUISE)
-   INC = 5,  // Increase velocity (CRUISE)
-   DEC = 6   // Decrease velocity (CRUISE)
+   OFF,      // Off
+   ON,       // On
+   SET,      // Set velocity (CRUISE)
+   RES,      // Resume velocity (CRUISE)
+   INC,      // Increase velocity (CRUISE)
+   DEC,      // Decrease velocity (CRUISE)
+   NUM_STATES
 };
 }
 
 namespace Signal {
 enum Bus {
-   ON  = 1,  // On
-   OFF = 2,  // Off
-   SET = 3,  // Set velocity
-   RES = 4,  // Resume velocity
-   INC = 5,  // Increase velocity
-   DEC = 6,  // Decrease velocity
-   BRK = 7,  // Brake
-   NOS = 9   // NO signal
+   ON,       // On
+   OFF,      // Off
+   SET,      // Set velocity
+   RES,      // Resume velocity
+   INC,      // Increase velocity
+   DEC,      // Decrease velocity
+   BRK,      // Brake
+   NOS,      // NO signal
+   NUM_SIGNALS
 };
 }
 
-State::Machine state;
-State::Machine oldState;
+// Data of one controller, the machine only holds the state
+struct Cruise
+{
+   double velocity;
+   double target;
+};
 
-void display() 
-{ 
-   if(state == State::ON) std::cout << "Display: ON" << std::endl; 
-   else std::cout << "Display: CRUISE" << std::endl; 
-} 
-void startCruise() { }
-void stopCruise() { } 
-void saveVelocity() { std::cout << "Saved velocity" << std::endl; } 
-void exitCruise() { } 
-void setVelocity() { }
-void resVelocity() { } 
-void incVelocity() { } 
-void decVelocity() { } 
+void startCruise(Cruise& cruise) { cruise.target = 0; }
+void stopCruise(Cruise&) { }
+void saveVelocity(Cruise&) { std::cout << "Saved velocity" << std::endl; }
+void exitCruise(Cruise&) { }
+void setVelocity(Cruise& cruise) { cruise.target = cruise.velocity; }
+void resVelocity(Cruise&) { }
+void incVelocity(Cruise& cruise) { cruise.target += 1; }
+void decVelocity(Cruise& cruise) { cruise.target -= 1; }
 
-const char* getStateName()
-{
-   switch(state)
-   {
-      case State::ON:  return "ON";  break;
-      case State::OFF: return "OFF"; break;
-      case State::SET: return "SET"; break;
-      case State::RES: return "RES"; break;
-      case State::DEC: return "DEC"; break;
-      case State::INC: return "INC"; break;
-      default: return "UNKNOWN";     break;
-   }
-   return "UNKOWN";
-}
+// Leaving SET saves the velocity
+void incFromSet(Cruise& cruise) { incVelocity(cruise); saveVelocity(cruise); }
+void decFromSet(Cruise& cruise) { decVelocity(cruise); saveVelocity(cruise); }
+void exitFromSet(Cruise& cruise) { exitCruise(cruise); saveVelocity(cruise); }
+void stopFromSet(Cruise& cruise) { stopCruise(cruise); saveVelocity(cruise); }
 
-void cruise(Signal::Bus input)
+typedef aire::Transition<Cruise, State::Machine, Signal::Bus> Transition;
+
+// Freude am Fahren
+struct CruiseTable
 {
-   switch(state)
-   {
-      case State::ON:
-         display();
-         // Freude am Fahren
-         switch(input) {
-            case Signal::SET: setVelocity(); state = State::SET; break;
-            case Signal::RES: resVelocity(); state = State::RES; break;
-            case Signal::OFF: exitCruise();  state = State::OFF; break;
-         }
-         std::cout << "State is " << getStateName() << std::endl;
-         break;
-      case State::SET:
-         display();
-         switch(input) {
-            case Signal::INC: incVelocity(); state = State::INC; break;
-            case Signal::DEC: decVelocity(); state = State::DEC; break;
-            case Signal::OFF: exitCruise();  state = State::OFF; break;
-            case Signal::BRK: stopCruise();  state = State::ON;  break;
-         }
-         if(oldState != state) saveVelocity();
-         std::cout << "State is " << getStateName() << std::endl;
-         break;
-      case State::RES:
-         display();
-         switch(input) {
-            case Signal::SET: setVelocity(); state = State::SET; break;
-            case Signal::INC: incVelocity(); state = State::INC; break;
-            case Signal::DEC: decVelocity(); state = State::DEC; break;
-            case Signal::OFF: exitCruise();  state = State::OFF; break;
-            case Signal::BRK: stopCruise();  state = State::ON;  break;
-         }
-         std::cout << "State is " << getStateName() << std::endl;
-         break;
-      case State::INC:
-         display();
-         switch(input) {
-            case Signal::SET: setVelocity(); state = State::SET; break;
-            case Signal::RES: resVelocity(); state = State::RES; break;
-            case Signal::INC: incVelocity(); state = State::INC; break;
-            case Signal::DEC: decVelocity(); state = State::DEC; break;
-            case Signal::OFF: exitCruise();  state = State::OFF; break;
-            case Signal::BRK: stopCruise();  state = State::ON;  break;
-         }
-         std::cout << "State is " << getStateName() << std::endl;
-         break;
-      case State::DEC:
-         display();
-         switch(input) {
-            case Signal::SET: setVelocity(); state = State::SET; break;
-            case Signal::RES: resVelocity(); state = State::RES; break;
-            case Signal::INC: incVelocity(); state = State::INC; break;
-            case Signal::DEC: decVelocity(); state = State::DEC; break;
-            case Signal::OFF: exitCruise();  state = State::OFF; break;
-            case Signal::BRK: stopCruise();  state = State::ON;  break;
-         }
-         std::cout << "State is " << getStateName() << std::endl;
-         break;
-      case State::OFF:
-         switch(input) {
-            case Signal::ON: startCruise(); state = State::ON; break;
-         }
-         std::cout << "State is " << getStateName() << std::endl;
-         break;
-   }
-   oldState = state;
-}
+   typedef Cruise ContextType;
+   typedef State::Machine StateType;
+   typedef Signal::Bus EventType;
+   static const size_t NUM_STATES = State::NUM_STATES;
+   static const size_t NUM_EVENTS = Signal::NUM_SIGNALS;
+   static const State::Machine INITIAL = State::OFF;
+   static constexpr Transition TRANSITIONS[] = {
+      {State::OFF, Signal::ON,  State::ON,  nullptr, &startCruise},
+      {State::ON,  Signal::SET, State::SET, nullptr, &setVelocity},
+      {State::ON,  Signal::RES, State::RES, nullptr, &resVelocity},
+      {State::ON,  Signal::OFF, State::OFF, nullptr, &exitCruise},
+      {State::SET, Signal::INC, State::INC, nullptr, &incFromSet},
+      {State::SET, Signal::DEC, State::DEC, nullptr, &decFromSet},
+      {State::SET, Signal::OFF, State::OFF, nullptr, &exitFromSet},
+      {State::SET, Signal::BRK, State::ON,  nullptr, &stopFromSet},
+      {State::RES, Signal::SET, State::SET, nullptr, &setVelocity},
+      {State::RES, Signal::INC, State::INC, nullptr, &incVelocity},
+      {State::RES, Signal::DEC, State::DEC, nullptr, &decVelocity},
+      {State::RES, Signal::OFF, State::OFF, nullptr, &exitCruise},
+      {State::RES, Signal::BRK, State::ON,  nullptr, &stopCruise},
+      {State::INC, Signal::SET, State::SET, nullptr, &setVelocity},
+      {State::INC, Signal::RES, State::RES, nullptr, &resVelocity},
+      {State::INC, Signal::INC, State::INC, nullptr, &incVelocity},
+      {State::INC, Signal::DEC, State::DEC, nullptr, &decVelocity},
+      {State::INC, Signal::OFF, State::OFF, nullptr, &exitCruise},
+      {State::INC, Signal::BRK, State::ON,  nullptr, &stopCruise},
+      {State::DEC, Signal::SET, State::SET, nullptr, &setVelocity},
+      {State::DEC, Signal::RES, State::RES, nullptr, &resVelocity},
+      {State::DEC, Signal::INC, State::INC, nullptr, &incVelocity},
+      {State::DEC, Signal::DEC, State::DEC, nullptr, &decVelocity},
+      {State::DEC, Signal::OFF, State::OFF, nullptr, &exitCruise},
+      {State::DEC, Signal::BRK, State::ON,  nullptr, &stopCruise}
+   };
+};
+constexpr Transition CruiseTable::TRANSITIONS[];
 
+const char* STATE_NAMES[State::NUM_STATES] =
+   {"OFF", "ON", "SET", "RES", "INC", "DEC"};
 
 int main(int argc, char* argv[])
 {
-   state = State::OFF;
-   Signal::Bus signal = Signal::OFF;
+   Cruise cruise = {100, 0};
+   aire::StateMachine<CruiseTable> machine(cruise);
 
    std::cout << "Input signal: on, off, set, res, inc, dec, brk" << std::endl;
    std::cout << "Input signal: esc to exit cruise control" << std::endl;
 
+   const char* inputs[Signal::NOS] =
+      {"on", "off", "set", "res", "inc", "dec", "brk"};
    while(true)
    {
       std::string input;
-      std::cout << "Input: "; getline(std::cin, input);
+      std::cout << "Input: ";
+      if(!std::getline(std::cin, input))
+      {
+         break;
+      }
       std::cout << "Signal was: " << input << std::endl;
-      if(input.find("on") == 0)  signal = Signal::ON;
-      else if(input.find("off") == 0) signal = Signal::OFF;
-      else if(input.find("dec") == 0) signal = Signal::DEC;
-      else if(input.find("inc") == 0) signal = Signal::INC;
-      else if(input.find("set") == 0) signal = Signal::SET;
-      else if(input.find("res") == 0) signal = Signal::RES;
-      else if(input.find("brk") == 0) signal = Signal::BRK;
-      else if(input.find("esc") == 0) break;
-      else signal = Signal::NOS;
-      cruise(signal);
+      if(input.find("esc") == 0)
+      {
+         break;
+      }
+
+      // The signal the input starts with
+      Signal::Bus signal = Signal::NOS;
+      for(int i = 0; i < Signal::NOS && signal == Signal::NOS; i++)
+      {
+         if(input.find(inputs[i]) == 0)
+         {
+            signal = static_cast<Signal::Bus>(i);
+         }
+      }
+
+      // The display shows the state before the signal
+      State::Machine state = machine.getState();
+      if(state == State::ON)
+      {
+         std::cout << "Display: ON" << std::endl;
+      }
+      else if(state != State::OFF)
+      {
+         std::cout << "Display: CRUISE " << cruise.target << std::endl;
+      }
+      machine.process(signal);
+      std::cout << "State is " << STATE_NAMES[machine.getState()] << std::endl;
    }
-   
+
    return EXIT_SUCCESS;
 }
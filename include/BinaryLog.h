@@ -0,0 +1,732 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file BinaryLog.h
+//! \brief Binary log with deferred formatting. 
+#ifndef BINARYLOG_H
+#define BINARYLOG_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <map>
+#include <string>
+#include <ostream>
+#include <chrono>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "Timer.h"
+#include "Stream.h"
+
+//! \brief Global aire namespace.
+namespace aire
+{
+
+//! \brief Binary log with deferred formatting.
+//!
+//! The hot path only copies a format id, a time stamp and the raw bytes of 
+//! the arguments into a ring buffer of the calling thread. Strings are 
+//! copied, all other arguments are stored as 8 bytes with a type tag. The 
+//! text is formatted later by writeText, e.g. on a background thread 
+//! started by startWriter. The lines of all threads are merged by time. 
+//! A format is a text with {} for every argument. A record that does not 
+//! fit into the ring buffer is dropped and counted. Use AIRE_LOG to 
+//! register the format once per call site and log.
+template<class ClockType>
+class BasicBinaryLog
+{
+public:
+   //! \brief Constructor of the object.
+   //! \param capacity The bytes of the ring buffer per thread.
+   BasicBinaryLog(size_t capacity = 65536)
+   {
+      initialize(capacity);
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~BasicBinaryLog()
+   {
+      destroy();
+   }
+
+   //! \brief Initializes the default parameter of the object.
+   //! \param capacity The bytes of the ring buffer, a power of two.
+   virtual void initialize(size_t capacity = 65536)
+   {
+      _id = GetNextId();
+      _capacity = 64;
+      while(_capacity < capacity)
+      {
+         _capacity <<= 1;
+      }
+      _origin = ClockType::Now();
+      _isTime = false;
+      _isWriting = false;
+      _output = nullptr;
+   }
+
+   //! \brief Stops the writer and frees the buffers of all threads.
+   virtual void destroy()
+   {
+      stopWriter();
+      std::lock_guard<std::mutex> lock(_mutex);
+      _threads.clear();
+      _rings.clear();
+
+      // Thread local caches must not point to the freed buffers
+      _id = GetNextId();
+   }
+
+   //! \brief Registers a format.
+   //! \param format The text with {} for every argument.
+   //! \return The id of the format.
+   uint32_t addFormat(const char* format)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _formats.push_back(format);
+      return static_cast<uint32_t>(_formats.size() - 1);
+   }
+
+   //! \brief Registers a format literal once.
+   //!
+   //! The literal is identified by its address, so the same call site 
+   //! gets the same id from every thread.
+   //! \param format The string literal with {} for every argument.
+   //! \return The id of the format.
+   uint32_t getFormat(const char* format)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _literals.find(format);
+      if(it == _literals.end())
+      {
+         _formats.push_back(format);
+         it = _literals.insert(std::make_pair(format, 
+            static_cast<uint32_t>(_formats.size() - 1))).first;
+      }
+      return it->second;
+   }
+
+   //! \brief Access to the unique id of the log.
+   //! \return The id, it changes when the log is destroyed or initialized.
+   uint64_t getId() const
+   {
+      return _id;
+   }
+
+   //! \brief Specifies if every line starts with the elapsed nanoseconds.
+   //! \param isTime True to print the time.
+   void setTime(bool isTime)
+   {
+      _isTime = isTime;
+   }
+
+   //! \brief Records a line of the calling thread without formatting.
+   //! \param format The id of the format.
+   //! \param args The arguments.
+   //! \return False if the line was dropped.
+   template<class... ArgTypes>
+   bool write(uint32_t format, const ArgTypes&... args)
+   {
+      Ring& ring = local();
+      size_t used = HEADER_SIZE + GetSize(args...);
+      size_t size = Align(used + 1);
+      char* data = ring.reserve(size);
+      if(data == nullptr)
+      {
+         ring.dropped.fetch_add(1, std::memory_order_relaxed);
+         return false;
+      }
+      int64_t time = ClockType::Now();
+      uint32_t size32 = static_cast<uint32_t>(size);
+      std::memcpy(data, &size32, 4);
+      std::memcpy(data + 4, &format, 4);
+      std::memcpy(data + 8, &time, 8);
+      Put(data + HEADER_SIZE, args...);
+
+      // A zero tag ends the arguments
+      std::memset(data + used, 0, size - used);
+      ring.commit(size);
+      return true;
+   }
+
+   //! \brief Formats and removes the recorded lines of all threads.
+   //!
+   //! Only one thread at a time formats, the others wait.
+   //! \param stream The output stream to print to.
+   //! \return The number of lines.
+   size_t writeText(std::ostream& stream)
+   {
+      std::lock_guard<std::mutex> consumer(_consumerMutex);
+      std::vector<Ring*> rings;
+      std::vector<std::string> formats;
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         for(size_t i = 0; i < _rings.size(); i++)
+         {
+            rings.push_back(_rings[i].get());
+         }
+         formats = _formats;
+      }
+
+      // Snapshot of the lines, merged by time
+      std::vector<uint64_t> heads(rings.size());
+      for(size_t i = 0; i < rings.size(); i++)
+      {
+         heads[i] = rings[i]->head.load(std::memory_order_acquire);
+      }
+      FixedStream<1024> line;
+      size_t count = 0;
+      while(true)
+      {
+         size_t next = rings.size();
+         int64_t first = 0;
+         for(size_t i = 0; i < rings.size(); i++)
+         {
+            const char* data = rings[i]->peek(heads[i]);
+            int64_t time = 0;
+            if(data != nullptr)
+            {
+               std::memcpy(&time, data + 8, 8);
+               if(next == rings.size() || time < first)
+               {
+                  next = i;
+                  first = time;
+               }
+            }
+         }
+         if(next == rings.size())
+         {
+            break;
+         }
+         const char* data = rings[next]->peek(heads[next]);
+         uint32_t size = 0;
+         uint32_t format = 0;
+         std::memcpy(&size, data, 4);
+         std::memcpy(&format, data + 4, 4);
+         line.clear();
+         if(_isTime)
+         {
+            line << static_cast<int64_t>((first - _origin) * 
+               ClockType::GetNanosPerTick()) << ' ';
+         }
+         Format(line, (format < formats.size()) ? formats[format].c_str() : 
+            "", data + HEADER_SIZE, data + size);
+         line << '\n';
+         stream.write(line.getData(), line.getSize());
+         rings[next]->release(size);
+         count++;
+      }
+      stream.flush();
+      return count;
+   }
+
+   //! \brief Starts a thread that formats the lines periodically.
+   //! \param stream The output stream to print to.
+   //! \param period The milliseconds between two calls of writeText.
+   void startWriter(std::ostream& stream, uint64_t period = 10)
+   {
+      stopWriter();
+      _output = &stream;
+      _isWriting = true;
+      _writer = std::thread([this, period] ()
+         {
+            while(_isWriting.load())
+            {
+               writeText(*_output);
+               std::this_thread::sleep_for(
+                  std::chrono::milliseconds(period));
+            }
+            writeText(*_output);
+         }
+      );
+   }
+
+   //! \brief Stops the writer thread after it wrote all recorded lines.
+   void stopWriter()
+   {
+      if(_writer.joinable())
+      {
+         _isWriting = false;
+         _writer.join();
+      }
+   }
+
+   //! \brief Access to the number of dropped lines.
+   //! \return The number of lines that did not fit into a ring buffer.
+   uint64_t getDropped() const
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      uint64_t dropped = 0;
+      for(size_t i = 0; i < _rings.size(); i++)
+      {
+         dropped += _rings[i]->dropped.load(std::memory_order_relaxed);
+      }
+      return dropped;
+   }
+
+private:
+   //! \brief Bytes of size, format id and time stamp of a record.
+   static const size_t HEADER_SIZE = 16;
+
+   //! \brief Format id of the filler at the end of a ring buffer.
+   static const uint32_t PADDING = 0xffffffff;
+
+   //! \brief Single-producer single-consumer ring buffer of records.
+   struct Ring
+   {
+      //! \brief Constructor of the buffer.
+      //! \param capacity The number of bytes, a power of two.
+      Ring(size_t capacity) : data(new char[capacity]), mask(capacity - 1),
+         head(0), tail(0), reserved(0), dropped(0)
+      {
+      }
+
+      //! \brief Reserves contiguous bytes, only called by the owner.
+      //! \param size The size of the record, a multiple of 8.
+      //! \return The bytes or nullptr if the buffer is full.
+      char* reserve(size_t size)
+      {
+         uint64_t position = head.load(std::memory_order_relaxed);
+         uint64_t used = position - tail.load(std::memory_order_acquire);
+         size_t offset = static_cast<size_t>(position & mask);
+         size_t padding = (offset + size > mask + 1) ? mask + 1 - offset : 0;
+         if(used + padding + size > mask + 1)
+         {
+            return nullptr;
+         }
+         if(padding > 0)
+         {
+            uint32_t header[2] = {static_cast<uint32_t>(padding), PADDING};
+            std::memcpy(data.get() + offset, header, 8);
+            offset = 0;
+         }
+         reserved = padding;
+         return data.get() + offset;
+      }
+
+      //! \brief Publishes the reserved record.
+      //! \param size The size of the record.
+      void commit(size_t size)
+      {
+         head.store(head.load(std::memory_order_relaxed) + reserved + size,
+            std::memory_order_release);
+      }
+
+      //! \brief Access to the oldest record, skips the filler.
+      //! \param end The end of the records to look at.
+      //! \return The record or nullptr if there is none before end.
+      const char* peek(uint64_t end)
+      {
+         uint64_t position = tail.load(std::memory_order_relaxed);
+         while(position < end)
+         {
+            const char* record = data.get() + (position & mask);
+            uint32_t size = 0;
+            uint32_t format = 0;
+            std::memcpy(&size, record, 4);
+            std::memcpy(&format, record + 4, 4);
+            if(format != PADDING)
+            {
+               return record;
+            }
+            position += size;
+            tail.store(position, std::memory_order_release);
+         }
+         return nullptr;
+      }
+
+      //! \brief Frees the oldest record.
+      //! \param size The size of the record.
+      void release(size_t size)
+      {
+         tail.store(tail.load(std::memory_order_relaxed) + size, 
+            std::memory_order_release);
+      }
+
+      //! \brief The bytes of the records.
+      std::unique_ptr<char[]> data;
+
+      //! \brief Capacity minus one.
+      size_t mask;
+
+      //! \brief Write position, only changed by the owner.
+      std::atomic<uint64_t> head;
+
+      //! \brief Read position, only changed by the consumer.
+      std::atomic<uint64_t> tail;
+
+      //! \brief Filler in front of the reserved record.
+      size_t reserved;
+
+      //! \brief Number of dropped records.
+      std::atomic<uint64_t> dropped;
+   };
+
+   //! \brief Thread local cache entry for the buffer of the thread.
+   struct Cache
+   {
+      //! \brief Id of the log the entry belongs to.
+      uint64_t id;
+
+      //! \brief Buffer of the thread.
+      Ring* ring;
+   };
+
+   //! \brief Unique id of the object.
+   uint64_t _id;
+
+   //! \brief Bytes of the ring buffer per thread.
+   size_t _capacity;
+
+   //! \brief Time stamp of the initialization.
+   int64_t _origin;
+
+   //! \brief Specifies if every line starts with the elapsed time.
+   bool _isTime;
+
+   //! \brief Mutex for the registration of threads and formats.
+   mutable std::mutex _mutex;
+
+   //! \brief Mutex of the formatting thread.
+   std::mutex _consumerMutex;
+
+   //! \brief Ring buffers in registration order.
+   std::vector<std::unique_ptr<Ring>> _rings;
+
+   //! \brief Index into the ring buffers by thread.
+   std::map<std::thread::id, size_t> _threads;
+
+   //! \brief Formats by id.
+   std::vector<std::string> _formats;
+
+   //! \brief Ids of the format literals of AIRE_LOG.
+   std::map<const char*, uint32_t> _literals;
+
+   //! \brief Specifies if the writer thread runs.
+   std::atomic<bool> _isWriting;
+
+   //! \brief Output of the writer thread.
+   std::ostream* _output;
+
+   //! \brief The writer thread.
+   std::thread _writer;
+
+   //! \brief Unique id to detect stale thread local caches.
+   //! \return A new id, never 0.
+   static uint64_t GetNextId()
+   {
+      static std::atomic<uint64_t> nextId(1);
+      return nextId++;
+   }
+
+   //! \brief Access to the thread local cache.
+   //! \return The cache entry of the calling thread.
+   static Cache& GetCache()
+   {
+      static thread_local Cache cache = {0, nullptr};
+      return cache;
+   }
+
+   //! \brief Access to the ring buffer of the calling thread.
+   //! \return The cached ring buffer of the calling thread.
+   Ring& local()
+   {
+      Cache& cache = GetCache();
+      if(cache.id != _id)
+      {
+         cache.ring = &attach();
+         cache.id = _id;
+      }
+      return *cache.ring;
+   }
+
+   //! \brief Looks up or creates the ring buffer of the calling thread.
+   //! \return The ring buffer of the calling thread.
+   Ring& attach()
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::thread::id tid = std::this_thread::get_id();
+      auto it = _threads.find(tid);
+      if(it != _threads.end())
+      {
+         return *_rings[it->second];
+      }
+      _threads[tid] = _rings.size();
+      _rings.push_back(std::unique_ptr<Ring>(new Ring(_capacity)));
+      return *_rings.back();
+   }
+
+   //! \brief Rounds a size up to a multiple of 8.
+   static size_t Align(size_t size)
+   {
+      return (size + 7) & ~static_cast<size_t>(7);
+   }
+
+   //! \brief Type trait of the arguments that are stored as strings.
+   template<class ArgType>
+   struct IsText
+   {
+      //! \brief True for character pointers and arrays.
+      static const bool value = std::is_same<typename std::decay<ArgType>::type,
+         const char*>::value || std::is_same<
+         typename std::decay<ArgType>::type, char*>::value;
+   };
+
+   //! \brief Size of no arguments.
+   static size_t GetSize()
+   {
+      return 0;
+   }
+
+   //! \brief Size of the encoded arguments.
+   template<class ArgType, class... ArgTypes>
+   static size_t GetSize(const ArgType& arg, const ArgTypes&... args)
+   {
+      return 1 + GetData(arg) + GetSize(args...);
+   }
+
+   //! \brief Size of a number or pointer.
+   template<class ArgType>
+   static typename std::enable_if<!IsText<ArgType>::value, size_t>::type 
+      GetData(const ArgType&)
+   {
+      return 8;
+   }
+
+   //! \brief Size of a zero terminated string.
+   template<class ArgType>
+   static typename std::enable_if<IsText<ArgType>::value, size_t>::type 
+      GetData(const ArgType& arg)
+   {
+      return 4 + std::strlen(arg);
+   }
+
+   //! \brief Size of a string.
+   static size_t GetData(const std::string& arg)
+   {
+      return 4 + arg.size();
+   }
+
+   //! \brief Encodes no arguments.
+   static void Put(char*)
+   {
+   }
+
+   //! \brief Encodes the arguments as type tag and bytes.
+   template<class ArgType, class... ArgTypes>
+   static void Put(char* data, const ArgType& arg, const ArgTypes&... args)
+   {
+      Put(data + 1 + Encode(data, arg), args...);
+   }
+
+   //! \brief Encodes a signed integer or enumeration.
+   template<class ArgType>
+   static typename std::enable_if<(std::is_integral<ArgType>::value && 
+      std::is_signed<ArgType>::value) || std::is_enum<ArgType>::value, 
+      size_t>::type Encode(char* data, const ArgType& arg)
+   {
+      int64_t value = static_cast<int64_t>(arg);
+      return Store(data, 'i', &value);
+   }
+
+   //! \brief Encodes a character.
+   static size_t Encode(char* data, const char& arg)
+   {
+      int64_t value = arg;
+      return Store(data, 'c', &value);
+   }
+
+   //! \brief Encodes an unsigned integer or boolean.
+   template<class ArgType>
+   static typename std::enable_if<std::is_integral<ArgType>::value && 
+      !std::is_signed<ArgType>::value, size_t>::type 
+      Encode(char* data, const ArgType& arg)
+   {
+      uint64_t value = arg;
+      return Store(data, std::is_same<ArgType, bool>::value ? 'b' : 'u', 
+         &value);
+   }
+
+   //! \brief Encodes a floating point number.
+   template<class ArgType>
+   static typename std::enable_if<std::is_floating_point<ArgType>::value, 
+      size_t>::type Encode(char* data, const ArgType& arg)
+   {
+      double value = static_cast<double>(arg);
+      return Store(data, 'd', &value);
+   }
+
+   //! \brief Encodes a pointer.
+   template<class ArgType>
+   static typename std::enable_if<std::is_pointer<
+      typename std::decay<ArgType>::type>::value && !IsText<ArgType>::value, 
+      size_t>::type Encode(char* data, const ArgType& arg)
+   {
+      uint64_t value = reinterpret_cast<uintptr_t>(arg);
+      return Store(data, 'p', &value);
+   }
+
+   //! \brief Encodes a zero terminated string.
+   template<class ArgType>
+   static typename std::enable_if<IsText<ArgType>::value, size_t>::type 
+      Encode(char* data, const ArgType& arg)
+   {
+      return Copy(data, arg, std::strlen(arg));
+   }
+
+   //! \brief Encodes a string.
+   static size_t Encode(char* data, const std::string& arg)
+   {
+      return Copy(data, arg.data(), arg.size());
+   }
+
+   //! \brief Stores a type tag and 8 bytes.
+   //! \return The number of bytes after the tag.
+   static size_t Store(char* data, char tag, const void* value)
+   {
+      data[0] = tag;
+      std::memcpy(data + 1, value, 8);
+      return 8;
+   }
+
+   //! \brief Stores a type tag, the length and the characters of a string.
+   //! \return The number of bytes after the tag.
+   static size_t Copy(char* data, const char* text, size_t size)
+   {
+      uint32_t size32 = static_cast<uint32_t>(size);
+      data[0] = 's';
+      std::memcpy(data + 1, &size32, 4);
+      std::memcpy(data + 5, text, size);
+      return 4 + size;
+   }
+
+   //! \brief Formats a record.
+   //! \param line The line to print to.
+   //! \param format The text with {} for every argument.
+   //! \param data The first encoded argument.
+   //! \param end The end of the record including the alignment.
+   static void Format(FixedStream<1024>& line, const char* format, 
+      const char* data, const char* end)
+   {
+      while(*format != '\0')
+      {
+         const char* mark = std::strstr(format, "{}");
+         if(mark == nullptr)
+         {
+            line << format;
+            break;
+         }
+         line.write(format, mark - format);
+         format = mark + 2;
+         if(data < end && *data != '\0')
+         {
+            data = Decode(line, data);
+         }
+         else
+         {
+            line << "{}";
+         }
+      }
+   }
+
+   //! \brief Formats an argument.
+   //! \param line The line to print to.
+   //! \param data The type tag of the argument.
+   //! \return The next argument.
+   static const char* Decode(FixedStream<1024>& line, const char* data)
+   {
+      char tag = data[0];
+      int64_t integer = 0;
+      uint64_t unsignedInt = 0;
+      double real = 0.0;
+      uint32_t size = 0;
+      switch(tag)
+      {
+      case 'i':
+         std::memcpy(&integer, data + 1, 8);
+         line << integer;
+         return data + 9;
+      case 'c':
+         std::memcpy(&integer, data + 1, 8);
+         line << static_cast<char>(integer);
+         return data + 9;
+      case 'u':
+      case 'b':
+         std::memcpy(&unsignedInt, data + 1, 8);
+         line << unsignedInt;
+         return data + 9;
+      case 'p':
+         std::memcpy(&unsignedInt, data + 1, 8);
+         line << reinterpret_cast<const void*>(
+            static_cast<uintptr_t>(unsignedInt));
+         return data + 9;
+      case 'd':
+         std::memcpy(&real, data + 1, 8);
+         line << real;
+         return data + 9;
+      default:
+         std::memcpy(&size, data + 1, 4);
+         line.write(data + 5, size);
+         return data + 5 + size;
+      }
+   }
+
+   //! \brief Private copy constructor. 
+   BasicBinaryLog(BasicBinaryLog const&);
+   
+   //! \brief Private assignment operator.
+   BasicBinaryLog& operator=(BasicBinaryLog const&);
+};
+
+//! \brief Binary log with time stamps of the steady clock.
+typedef BasicBinaryLog<SteadyClock> BinaryLog;
+
+//! \brief Format id of an AIRE_LOG call site for one log.
+struct FormatCache
+{
+   //! \brief The id of the log, 0 if none.
+   uint64_t log;
+
+   //! \brief The id of the format in the log.
+   uint32_t format;
+};
+
+}
+
+//! \brief Records a line, the format is registered once per call site.
+//!
+//! The format must be a string literal with {} for every argument, e.g.
+//! AIRE_LOG(log, "Request {} took {} ns", id, time);
+//! Every thread caches the id of the call site for the last log it wrote 
+//! to, a call site used with another log registers the format there.
+#define AIRE_LOG(log, literal, ...) \
+   do \
+   { \
+      static thread_local aire::FormatCache aireCache = {0, 0}; \
+      auto& aireLog = (log); \
+      if(aireCache.log != aireLog.getId()) \
+      { \
+         aireCache.format = aireLog.getFormat(literal); \
+         aireCache.log = aireLog.getId(); \
+      } \
+      aireLog.write(aireCache.format, ##__VA_ARGS__); \
+   } \
+   while(0)
+
+#endif
@@ -0,0 +1,371 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file Counters.h
+//! \brief Hardware performance counters of a thread. 
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#define AIRE_HAS_PERF
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+//! \brief Global aire namespace.
+namespace aire
+{
+
+//! \brief Hardware performance counters of a thread.
+//!
+//! Every thread has one perf_event_open group, so all events are scheduled 
+//! together and their ratios like the instructions per cycle are 
+//! consistent. The group is opened on the first start of any counters of 
+//! the thread and counts until the thread ends. Counters only keep the 
+//! counts at their start and the sums, start and stop read the group of 
+//! the thread and add the difference, so regions can be nested and any 
+//! number of timers shares the file descriptors of one group. Multiplexed 
+//! counters are scaled by the time the group was running. Hardware events 
+//! count user space only, which perf_event_paranoid 2 permits. Events that 
+//! can not be opened, e.g. in a container without permission or on other 
+//! systems, stay unsupported and read 0, the measurement continues without 
+//! them. A region must be started and stopped on the same thread.
+class Counters
+{
+public:
+   //! \brief Events of the group.
+   enum Event
+   {
+      CYCLES,
+      INSTRUCTIONS,
+      CACHE_MISSES,
+      BRANCH_MISSES,
+      CONTEXT_SWITCHES,
+      NUM_EVENTS
+   };
+
+   //! \brief Constructor of the object.
+   Counters()
+   {
+      initialize();
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~Counters()
+   {
+      destroy();
+   }
+
+   //! \brief Initializes counters without events.
+   virtual void initialize()
+   {
+      for(size_t i = 0; i < NUM_EVENTS; i++)
+      {
+         _isSupported[i] = false;
+      }
+      reset();
+   }
+
+   //! \brief Destroys the counters, the group stays open for the thread.
+   virtual void destroy() { }
+
+   //! \brief Removes the counted values.
+   void reset()
+   {
+      std::memset(_values, 0, sizeof(_values));
+      std::memset(_starts, 0, sizeof(_starts));
+      _count = 0;
+   }
+
+   //! \brief Opens the group of the calling thread if it is not open yet.
+   //! \return True if at least one event is counted.
+   bool open()
+   {
+      const Group& group = GetGroup();
+      for(size_t i = 0; i < NUM_EVENTS; i++)
+      {
+         _isSupported[i] = _isSupported[i] || group.isSupported[i];
+      }
+      return isAvailable();
+   }
+
+   //! \brief Specifies if any event is counted.
+   bool isAvailable() const
+   {
+      for(size_t i = 0; i < NUM_EVENTS; i++)
+      {
+         if(_isSupported[i])
+         {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   //! \brief Specifies if an event is counted.
+   bool isSupported(Event event) const
+   {
+      return _isSupported[event];
+   }
+
+   //! \brief Starts a measured region, opens the group the first time.
+   void start()
+   {
+      open();
+      GetGroup().read(_starts);
+   }
+
+   //! \brief Stops a measured region and adds its counts.
+   void stop()
+   {
+      uint64_t stops[NUM_EVENTS + 2];
+      if(!GetGroup().read(stops))
+      {
+         return;
+      }
+
+      // Scale by the share of the time the group was on the CPU
+      double enabled = static_cast<double>(stops[NUM_EVENTS] - 
+         _starts[NUM_EVENTS]);
+      double running = static_cast<double>(stops[NUM_EVENTS + 1] - 
+         _starts[NUM_EVENTS + 1]);
+      double scale = (running > 0) ? enabled / running : 1.0;
+      for(size_t i = 0; i < NUM_EVENTS; i++)
+      {
+         _values[i] += static_cast<uint64_t>(
+            static_cast<double>(stops[i] - _starts[i]) * scale + 0.5);
+      }
+      _count++;
+   }
+
+   //! \brief Access to the count of an event of all regions.
+   //! \return The count, 0 if the event is unsupported.
+   uint64_t getValue(Event event) const
+   {
+      return _values[event];
+   }
+
+   //! \brief Access to the number of measured regions.
+   uint64_t getCount() const
+   {
+      return _count;
+   }
+
+   //! \brief Access to the instructions per cycle.
+   //! \return The ratio or 0 without cycles.
+   double getIpc() const
+   {
+      return (_values[CYCLES] > 0) ? static_cast<double>(
+         _values[INSTRUCTIONS]) / static_cast<double>(_values[CYCLES]) : 0;
+   }
+
+   //! \brief Adds the counts of other counters, e.g. of another thread.
+   void merge(const Counters& other)
+   {
+      for(size_t i = 0; i < NUM_EVENTS; i++)
+      {
+         _values[i] += other._values[i];
+         _isSupported[i] = _isSupported[i] || other._isSupported[i];
+      }
+      _count += other._count;
+   }
+
+   //! \brief Prints the counts and the instructions per cycle in one line.
+   //!
+   //! Unsupported events are printed as -.
+   //! \param stream The output stream to print to.
+   //! \param isAverage Specifies to print the counts per region.
+   template<class CharType>
+   void printCounts(std::basic_ostream<CharType>& stream, 
+      bool isAverage = false) const
+   {
+      const char* labels[NUM_EVENTS] = {"cycles ", " instructions ", 
+         " cache misses ", " branch misses ", " context switches "};
+      double regions = (isAverage && _count > 0) ? 
+         static_cast<double>(_count) : 1.0;
+      std::ios::fmtflags flags = stream.flags();
+      std::streamsize precision = stream.precision(3);
+      stream << std::scientific;
+      for(size_t i = 0; i < NUM_EVENTS; i++)
+      {
+         stream << labels[i];
+         if(_isSupported[i])
+         {
+            stream << static_cast<double>(_values[i]) / regions;
+         }
+         else
+         {
+            stream << "-";
+         }
+         if(i == INSTRUCTIONS && _isSupported[CYCLES] && 
+            _isSupported[INSTRUCTIONS])
+         {
+            stream << std::fixed << std::setprecision(2) << " IPC " 
+               << getIpc() << std::scientific << std::setprecision(3);
+         }
+      }
+      stream.precision(precision);
+      stream.flags(flags);
+   }
+
+private:
+   //! \brief The perf_event_open group of a thread.
+   struct Group
+   {
+      //! \brief File descriptors of the events, -1 if not opened.
+      int fds[NUM_EVENTS];
+
+      //! \brief Positions of the events in a read of the group.
+      size_t positions[NUM_EVENTS];
+
+      //! \brief Specifies which events are counted.
+      bool isSupported[NUM_EVENTS];
+
+      //! \brief Number of opened events.
+      size_t numOpen;
+
+      //! \brief Constructor that opens the events of the calling thread.
+      Group()
+      {
+         numOpen = 0;
+         for(size_t i = 0; i < NUM_EVENTS; i++)
+         {
+            fds[i] = -1;
+            positions[i] = 0;
+            isSupported[i] = false;
+         }
+         #if defined(AIRE_HAS_PERF)
+         const uint32_t types[NUM_EVENTS] = {PERF_TYPE_HARDWARE, 
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, 
+            PERF_TYPE_SOFTWARE};
+         const uint64_t configs[NUM_EVENTS] = {PERF_COUNT_HW_CPU_CYCLES, 
+            PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, 
+            PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_CONTEXT_SWITCHES};
+         int leader = -1;
+         for(size_t i = 0; i < NUM_EVENTS; i++)
+         {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP | 
+               PERF_FORMAT_TOTAL_TIME_ENABLED | 
+               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_hv = 1;
+
+            // Context switches happen in the kernel
+            attr.exclude_kernel = (types[i] == PERF_TYPE_HARDWARE) ? 1 : 0;
+            fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 
+               0, -1, leader, 0));
+            if(fds[i] < 0)
+            {
+               continue;
+            }
+            leader = (leader < 0) ? fds[i] : leader;
+            isSupported[i] = true;
+            positions[i] = numOpen++;
+         }
+         #endif
+      }
+
+      //! \brief Destructor that closes the events.
+      ~Group()
+      {
+         #if defined(AIRE_HAS_PERF)
+         for(size_t i = 0; i < NUM_EVENTS; i++)
+         {
+            if(fds[i] >= 0)
+            {
+               close(fds[i]);
+            }
+         }
+         #endif
+      }
+
+      //! \brief Reads the group.
+      //! \param values The counts by event, the enabled and running time.
+      //! \return False if no event is counted.
+      bool read(uint64_t* values) const
+      {
+         std::memset(values, 0, (NUM_EVENTS + 2) * sizeof(uint64_t));
+         #if defined(AIRE_HAS_PERF)
+         if(numOpen == 0)
+         {
+            return false;
+         }
+
+         // Number of events, enabled and running time, then the counts
+         uint64_t group[3 + NUM_EVENTS];
+         int leader = -1;
+         for(size_t i = 0; i < NUM_EVENTS && leader < 0; i++)
+         {
+            leader = fds[i];
+         }
+         ssize_t size = ::read(leader, group, sizeof(group));
+         if(size < static_cast<ssize_t>((3 + numOpen) * sizeof(uint64_t)))
+         {
+            return false;
+         }
+         for(size_t i = 0; i < NUM_EVENTS; i++)
+         {
+            values[i] = isSupported[i] ? group[3 + positions[i]] : 0;
+         }
+         values[NUM_EVENTS] = group[1];
+         values[NUM_EVENTS + 1] = group[2];
+         return true;
+         #else
+         return false;
+         #endif
+      }
+   };
+
+   //! \brief Specifies which events are counted.
+   bool _isSupported[NUM_EVENTS];
+
+   //! \brief Counts and enabled and running time at the start.
+   uint64_t _starts[NUM_EVENTS + 2];
+
+   //! \brief Counts of all regions.
+   uint64_t _values[NUM_EVENTS];
+
+   //! \brief Number of measured regions.
+   uint64_t _count;
+
+   //! \brief Access to the group of the calling thread, opened on the 
+   //! first access and closed when the thread ends.
+   static const Group& GetGroup()
+   {
+      static thread_local Group group;
+      return group;
+   }
+
+   //! \brief Private copy constructor. 
+   Counters(Counters const&);
+   
+   //! \brief Private assignment operator.
+   Counters& operator=(Counters const&);
+};
+
+}
+
+#endif
@@ -13,77 +13,516 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 //
 //! \file Event.h
-//! \brief Event class for thread signals. 
+//! \brief Event class for thread signals and counting primitives. 
 #ifndef EVENT_H
 #define EVENT_H
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#else
 #include <condition_variable>
 #include <mutex>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <climits>
 #include <cstdint>
+#include <cstddef>
+
+#include "System.h"
 
 //! \brief Global aire namespace.
 namespace aire 
 {
 
+//! \brief Parks threads on the value of an atomic word.
+//!
+//! On Linux this is the futex system call. Elsewhere the word is hashed 
+//! into a fixed table of condition variables, a wake notifies all threads 
+//! of the bucket and every thread checks its word again.
+class Futex
+{
+public:
+   //! \brief Sleeps while the word has the expected value.
+   //!
+   //! The call can return spuriously, the caller checks the word again.
+   //! \param word The atomic word.
+   //! \param expected The value to sleep on.
+   //! \param deadline The time to give up or nullptr to wait forever.
+   static void Wait(std::atomic<uint32_t>* word, uint32_t expected,
+      const std::chrono::steady_clock::time_point* deadline)
+   {
+      #if defined(__linux__)
+      struct timespec timeout;
+      struct timespec* timeoutPtr = nullptr;
+      if(deadline != nullptr)
+      {
+         auto span = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            *deadline - std::chrono::steady_clock::now()).count();
+         span = std::max<int64_t>(span, 0);
+         timeout.tv_sec = static_cast<time_t>(span / 1000000000);
+         timeout.tv_nsec = static_cast<long>(span % 1000000000);
+         timeoutPtr = &timeout;
+      }
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), 
+         FUTEX_WAIT_PRIVATE, expected, timeoutPtr, nullptr, 0);
+      #else
+      Bucket& bucket = GetBucket(word);
+      std::unique_lock<std::mutex> lock(bucket.mutex);
+      auto isChanged = [word, expected] () 
+      { 
+         return word->load() != expected; 
+      };
+      if(deadline != nullptr)
+      {
+         bucket.signal.wait_until(lock, *deadline, isChanged);
+      }
+      else
+      {
+         bucket.signal.wait(lock, isChanged);
+      }
+      #endif
+   }
+
+   //! \brief Wakes threads sleeping on the word.
+   //! \param word The atomic word.
+   //! \param count The maximal number of threads to wake.
+   static void Wake(std::atomic<uint32_t>* word, int count)
+   {
+      #if defined(__linux__)
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), 
+         FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+      #else
+      Bucket& bucket = GetBucket(word);
+      {
+         // Waiters check the word under the mutex
+         std::lock_guard<std::mutex> lock(bucket.mutex);
+      }
+      bucket.signal.notify_all();
+      #endif
+   }
+
+   //! \brief Hint to the CPU that the thread spins.
+   static void Pause()
+   {
+      #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      __builtin_ia32_pause();
+      #elif defined(_MSC_VER)
+      _mm_pause();
+      #else
+      std::this_thread::yield();
+      #endif
+   }
+
+private:
+   #if !defined(__linux__)
+   //! \brief Bucket of sleeping threads.
+   struct Bucket
+   {
+      //! \brief Mutex of the bucket.
+      std::mutex mutex;
+
+      //! \brief Condition of the bucket.
+      std::condition_variable signal;
+   };
+
+   //! \brief Access to the bucket of a word.
+   //! \param word The atomic word.
+   //! \return The bucket the word is hashed to.
+   static Bucket& GetBucket(std::atomic<uint32_t>* word)
+   {
+      static Bucket buckets[64];
+      return buckets[(reinterpret_cast<uintptr_t>(word) >> 4) % 64];
+   }
+   #endif
+};
+
 //! \brief Event class for thread signals.
+//!
+//! The event is an auto-reset event by default, a successful wait consumes 
+//! the signal and signal wakes one waiter. A manual-reset event stays 
+//! signaled until reset, signal wakes all waiters. The state is a single 
+//! atomic word, so signaling an event nobody waits for is one atomic 
+//! exchange. A waiter first spins a bounded number of times, the bound 
+//! adapts to how often spinning was successful. Then the waiter parks on 
+//! the state word, see Futex. WaitAny and WaitAll wait for several events. 
+//! A thread in WaitAny registers a waiter at each of its events, signal 
+//! only wakes the waiters of its own event.
 class Event
 {
 public:
+   //! \brief Not signaled and no waiter is parked.
+   static const uint32_t EMPTY = 0;
+
+   //! \brief Signaled and not yet consumed.
+   static const uint32_t SIGNALED = 1;
+
+   //! \brief Not signaled and a waiter might be parked.
+   static const uint32_t WAITING = 2;
+
+   //! \brief Minimal number of spins before parking.
+   static const uint32_t MIN_SPIN = 16;
+
+   //! \brief Maximal number of spins before parking.
+   static const uint32_t MAX_SPIN = 4096;
+
    //! \brief Constructor of the object.
-   Event()
+   //! \param isManual Specifies a manual-reset (broadcast) event.
+   Event(bool isManual = false)
    {
-      initialize();
+      initialize(isManual);
    }
    
    //! \brief Destructor of the object.
    virtual ~Event() { }
    
    //! \brief Initializes the default parameter of the object.
-   virtual void initialize()
+   //! \param isManual Specifies a manual-reset (broadcast) event.
+   virtual void initialize(bool isManual = false)
    {
-      _signaled = false;
+      _state = EMPTY;
+      _spinLimit = IsMultiCore() ? MIN_SPIN * 8 : 0;
+      _isManual = isManual;
+      _waiters = nullptr;
+      _lock = 0;
    }
    
    //! \brief Wait for signal with a timeout.
    //! \param timeout The timeout in milliseconds.
-   void wait(uint64_t timeout)
+   //! \return True if the signal was consumed, false on timeout.
+   bool wait(uint64_t timeout)
    {
-      std::unique_lock<std::mutex> lock(_mutex);
-      while(!_signaled) // loop to avoid spurious wakeups
-      {
-         _signal.wait_for(lock, std::chrono::milliseconds(timeout));
-      }
-      _signaled = false;   
+      auto deadline = std::chrono::steady_clock::now() + 
+         std::chrono::milliseconds(timeout);
+      return spin() || park(&deadline);
    }
    
    //! \brief Wait for signal without a timeout.
    void wait()
    {
-      std::unique_lock<std::mutex> lock(_mutex);
-      while(!_signaled) // loop to avoid spurious wakeups
+      if(!spin())
       {
-         _signal.wait(lock);
+         park(nullptr);
       }
-      _signaled = false; 
    }
    
    //! \brief Signal the event.
    void signal()
    {
-      std::unique_lock<std::mutex> lock(_mutex);
-      _signaled = true;
-      _signal.notify_one();  
+      if(_state.exchange(SIGNALED) == WAITING)
+      {
+         Futex::Wake(&_state, _isManual ? INT_MAX : 1);
+      }
+
+      // Wake the threads in WaitAny, the list is ordered after the state
+      if(_waiters.load() != nullptr)
+      {
+         lock();
+         for(Node* node = _waiters.load(std::memory_order_relaxed); 
+            node != nullptr; node = node->next)
+         {
+            (*node->word)++;
+            Futex::Wake(node->word, 1);
+         }
+         unlock();
+      }
+   }
+
+   //! \brief Resets a manual-reset event.
+   void reset()
+   {
+      uint32_t state = SIGNALED;
+      _state.compare_exchange_strong(state, EMPTY);
+   }
+
+   //! \brief Consumes the signal without waiting.
+   //!
+   //! A manual-reset event is not reset by a wait.
+   //! \return True if the event was signaled.
+   bool tryWait()
+   {
+      if(_isManual)
+      {
+         return _state.load(std::memory_order_acquire) == SIGNALED;
+      }
+      uint32_t state = SIGNALED;
+      return _state.compare_exchange_strong(state, EMPTY, 
+         std::memory_order_acquire);
+   }
+
+   //! \brief Waits until one of several events is signaled.
+   //! \param events The events to wait for.
+   //! \param timeout The timeout in milliseconds.
+   //! \return The index of the consumed event or -1 on timeout.
+   static int32_t WaitAny(const std::vector<Event*>& events, 
+      uint64_t timeout)
+   {
+      auto deadline = std::chrono::steady_clock::now() + 
+         std::chrono::milliseconds(timeout);
+      return waitAny(events, &deadline);
+   }
+
+   //! \brief Waits until one of several events is signaled.
+   //! \param events The events to wait for.
+   //! \return The index of the consumed event.
+   static int32_t WaitAny(const std::vector<Event*>& events)
+   {
+      return waitAny(events, nullptr);
+   }
+
+   //! \brief Waits until all of several events are signaled.
+   //!
+   //! The events are consumed one after another. On timeout the events 
+   //! consumed so far stay consumed.
+   //! \param events The events to wait for.
+   //! \param timeout The timeout in milliseconds.
+   //! \return True if all events were consumed, false on timeout.
+   static bool WaitAll(const std::vector<Event*>& events, uint64_t timeout)
+   {
+      auto deadline = std::chrono::steady_clock::now() + 
+         std::chrono::milliseconds(timeout);
+      for(size_t i = 0; i < events.size(); i++)
+      {
+         if(!events[i]->spin() && !events[i]->park(&deadline))
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   //! \brief Waits until all of several events are signaled.
+   //! \param events The events to wait for.
+   static void WaitAll(const std::vector<Event*>& events)
+   {
+      for(size_t i = 0; i < events.size(); i++)
+      {
+         events[i]->wait();
+      }
+   }
+
+   //! \brief Checks if spinning can succeed on this machine.
+   //!
+   //! Spinning is useless if the signaling thread can not run.
+   //! \return True if there is more than one core.
+   static bool IsMultiCore()
+   {
+      static const bool isMultiCore = System::GetNumCores() > 1;
+      return isMultiCore;
    }
    
 private:
-   //! \brief Mutex member.
-   std::mutex _mutex;
-   
-   //! \brief Signal condition.
-   std::condition_variable _signal;
- 
-   //! \brief Signal state variable.
-   bool _signaled;
+   //! \brief Registration of a thread in WaitAny at one event.
+   struct Node
+   {
+      //! \brief The word the thread parks on, shared by its nodes.
+      std::atomic<uint32_t>* word;
+
+      //! \brief The next waiter of the event.
+      Node* next;
+   };
+
+   //! \brief State of the event: EMPTY, SIGNALED or WAITING.
+   std::atomic<uint32_t> _state;
+
+   //! \brief Waiters of threads in WaitAny.
+   std::atomic<Node*> _waiters;
+
+   //! \brief Spin lock of the waiters.
+   std::atomic<uint32_t> _lock;
+
+   //! \brief Current number of spins before parking.
+   std::atomic<uint32_t> _spinLimit;
+
+   //! \brief Specifies a manual-reset event.
+   bool _isManual;
+
+   //! \brief Spins for the signal and adapts the number of spins.
+   //! \return True if the signal was consumed.
+   bool spin()
+   {
+      uint32_t limit = _spinLimit.load(std::memory_order_relaxed);
+      if(limit == 0)
+      {
+         return tryWait();
+      }
+      for(uint32_t i = 0; i < limit; i++)
+      {
+         if(_state.load(std::memory_order_relaxed) == SIGNALED && tryWait())
+         {
+            if(i > 0)
+            {
+               // Spinning paid off, allow longer spins
+               _spinLimit.store((2 * limit < MAX_SPIN) ? 2 * limit : MAX_SPIN,
+                  std::memory_order_relaxed);
+            }
+            return true;
+         }
+         Futex::Pause();
+      }
+      _spinLimit.store((limit / 2 > MIN_SPIN) ? limit / 2 : MIN_SPIN, 
+         std::memory_order_relaxed);
+      return false;
+   }
+
+   //! \brief Parks the thread until the signal is consumed.
+   //! \param deadline The time to give up or nullptr to wait forever.
+   //! \return True if the signal was consumed, false on timeout.
+   bool park(const std::chrono::steady_clock::time_point* deadline)
+   {
+      while(true)
+      {
+         // A parked thread leaves WAITING behind because other waiters 
+         // might still be parked
+         uint32_t state = _state.load(std::memory_order_relaxed);
+         if(state == SIGNALED)
+         {
+            if(_isManual || _state.compare_exchange_weak(state, WAITING,
+               std::memory_order_acquire))
+            {
+               return true;
+            }
+            continue;
+         }
+         if(state == EMPTY && !_state.compare_exchange_weak(state, WAITING,
+            std::memory_order_relaxed))
+         {
+            continue;
+         }
+         if(deadline != nullptr && 
+            std::chrono::steady_clock::now() >= *deadline)
+         {
+            return false;
+         }
+         Futex::Wait(&_state, WAITING, deadline);
+      }
+   }
+
+   //! \brief Waits until one of several events is signaled.
+   //! \param events The events to wait for.
+   //! \param deadline The time to give up or nullptr to wait forever.
+   //! \return The index of the consumed event or -1 on timeout.
+   static int32_t waitAny(const std::vector<Event*>& events, 
+      const std::chrono::steady_clock::time_point* deadline)
+   {
+      int32_t result = pollAny(events);
+      if(result >= 0)
+      {
+         return result;
+      }
+
+      // Register before the events are checked again, so a signal after 
+      // the check increments the generation of this thread
+      std::atomic<uint32_t> generation(0);
+      std::vector<Node> nodes(events.size());
+      for(size_t i = 0; i < events.size(); i++)
+      {
+         nodes[i].word = &generation;
+         events[i]->addWaiter(&nodes[i]);
+      }
+      while(true)
+      {
+         uint32_t current = generation.load();
+         result = pollAny(events);
+         if(result >= 0 || (deadline != nullptr &&
+            std::chrono::steady_clock::now() >= *deadline))
+         {
+            break;
+         }
+         Futex::Wait(&generation, current, deadline);
+      }
+      for(size_t i = 0; i < events.size(); i++)
+      {
+         events[i]->removeWaiter(&nodes[i]);
+      }
+      return result;
+   }
+
+   //! \brief Consumes the first signaled event.
+   //! \param events The events to check.
+   //! \return The index of the consumed event or -1.
+   static int32_t pollAny(const std::vector<Event*>& events)
+   {
+      // Order the check after the registration in WaitAny
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      for(size_t i = 0; i < events.size(); i++)
+      {
+         if(events[i]->tryWait())
+         {
+            return static_cast<int32_t>(i);
+         }
+      }
+      return -1;
+   }
+
+   //! \brief Registers a waiter of WaitAny.
+   //! \param node The waiter, it stays registered until it is removed.
+   void addWaiter(Node* node)
+   {
+      lock();
+      node->next = _waiters.load(std::memory_order_relaxed);
+      _waiters.store(node);
+      unlock();
+   }
+
+   //! \brief Removes a waiter of WaitAny.
+   //!
+   //! A signal holds the lock while it wakes, so the waiter can be freed 
+   //! afterwards.
+   //! \param node The registered waiter.
+   void removeWaiter(Node* node)
+   {
+      lock();
+      Node* previous = nullptr;
+      Node* current = _waiters.load(std::memory_order_relaxed);
+      while(current != node)
+      {
+         previous = current;
+         current = current->next;
+      }
+      if(previous == nullptr)
+      {
+         _waiters.store(node->next, std::memory_order_relaxed);
+      }
+      else
+      {
+         previous->next = node->next;
+      }
+      unlock();
+   }
+
+   //! \brief Locks the waiters.
+   void lock()
+   {
+      while(_lock.exchange(1, std::memory_order_acquire) != 0)
+      {
+         if(IsMultiCore())
+         {
+            Futex::Pause();
+         }
+         else
+         {
+            std::this_thread::yield();
+         }
+      }
+   }
+
+   //! \brief Unlocks the waiters.
+   void unlock()
+   {
+      _lock.store(0, std::memory_order_release);
+   }
 
    //! \brief Private copy constructor. 
    Event(Event const&);
@@ -92,5 +531,217 @@ private:
    Event& operator=(Event const&);
 };
 
+//! \brief Counting semaphore.
+//!
+//! The count is an atomic word, so release and acquire without contention 
+//! are one atomic operation. Waiters spin shortly and park on the count.
+class Semaphore
+{
+public:
+   //! \brief Constructor of the object.
+   //! \param count The initial count.
+   Semaphore(uint32_t count = 0)
+   {
+      initialize(count);
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~Semaphore() { }
+
+   //! \brief Initializes the default parameter of the object.
+   //! \param count The initial count.
+   virtual void initialize(uint32_t count = 0)
+   {
+      _count = count;
+      _numWaiters = 0;
+   }
+
+   //! \brief Decrements the count, waits while it is zero.
+   void acquire()
+   {
+      acquireUntil(nullptr);
+   }
+
+   //! \brief Decrements the count, waits while it is zero.
+   //! \param timeout The timeout in milliseconds.
+   //! \return True if the count was decremented, false on timeout.
+   bool acquire(uint64_t timeout)
+   {
+      auto deadline = std::chrono::steady_clock::now() + 
+         std::chrono::milliseconds(timeout);
+      return acquireUntil(&deadline);
+   }
+
+   //! \brief Decrements the count if it is not zero.
+   //! \return True if the count was decremented.
+   bool tryAcquire()
+   {
+      uint32_t count = _count.load(std::memory_order_relaxed);
+      while(count > 0)
+      {
+         if(_count.compare_exchange_weak(count, count - 1,
+            std::memory_order_acquire))
+         {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   //! \brief Increments the count and wakes waiters.
+   //! \param count The number to add.
+   void release(uint32_t count = 1)
+   {
+      _count.fetch_add(count);
+      if(_numWaiters.load() > 0)
+      {
+         Futex::Wake(&_count, static_cast<int>(std::min<uint32_t>(count,
+            INT_MAX)));
+      }
+   }
+
+private:
+   //! \brief The count.
+   std::atomic<uint32_t> _count;
+
+   //! \brief Number of parked threads.
+   std::atomic<uint32_t> _numWaiters;
+
+   //! \brief Decrements the count, waits while it is zero.
+   //! \param deadline The time to give up or nullptr to wait forever.
+   //! \return True if the count was decremented, false on timeout.
+   bool acquireUntil(const std::chrono::steady_clock::time_point* deadline)
+   {
+      uint32_t spins = Event::IsMultiCore() ? Event::MIN_SPIN * 8 : 1;
+      for(uint32_t i = 0; i < spins; i++)
+      {
+         if(tryAcquire())
+         {
+            return true;
+         }
+         Futex::Pause();
+      }
+
+      _numWaiters++;
+      bool result = false;
+      while(!(result = tryAcquire()))
+      {
+         if(deadline != nullptr && 
+            std::chrono::steady_clock::now() >= *deadline)
+         {
+            break;
+         }
+         Futex::Wait(&_count, 0, deadline);
+      }
+      _numWaiters--;
+      return result;
+   }
+
+   //! \brief Private copy constructor. 
+   Semaphore(Semaphore const&);
+   
+   //! \brief Private assignment operator.
+   Semaphore& operator=(Semaphore const&);
+};
+
+//! \brief Countdown latch.
+//!
+//! Threads wait until the count reaches zero, e.g. until all workers of 
+//! a fork-join phase are done. Reaching zero wakes all waiters at once.
+class Latch
+{
+public:
+   //! \brief Constructor of the object.
+   //! \param count The number of count downs to wait for.
+   Latch(uint32_t count = 0)
+   {
+      initialize(count);
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~Latch() { }
+
+   //! \brief Initializes the default parameter of the object.
+   //!
+   //! Resets the latch for the next phase, no thread may wait meanwhile.
+   //! \param count The number of count downs to wait for.
+   virtual void initialize(uint32_t count = 0)
+   {
+      _count = count;
+   }
+
+   //! \brief Decrements the count and wakes all waiters at zero.
+   //! \param count The number to subtract.
+   void countDown(uint32_t count = 1)
+   {
+      if(_count.fetch_sub(count) == count)
+      {
+         Futex::Wake(&_count, INT_MAX);
+      }
+   }
+
+   //! \brief Waits until the count is zero.
+   void wait()
+   {
+      waitUntil(nullptr);
+   }
+
+   //! \brief Waits until the count is zero.
+   //! \param timeout The timeout in milliseconds.
+   //! \return True if the count is zero, false on timeout.
+   bool wait(uint64_t timeout)
+   {
+      auto deadline = std::chrono::steady_clock::now() + 
+         std::chrono::milliseconds(timeout);
+      return waitUntil(&deadline);
+   }
+
+   //! \brief Checks the count without waiting.
+   //! \return True if the count is zero.
+   bool tryWait()
+   {
+      return _count.load(std::memory_order_acquire) == 0;
+   }
+
+private:
+   //! \brief The count.
+   std::atomic<uint32_t> _count;
+
+   //! \brief Waits until the count is zero.
+   //! \param deadline The time to give up or nullptr to wait forever.
+   //! \return True if the count is zero, false on timeout.
+   bool waitUntil(const std::chrono::steady_clock::time_point* deadline)
+   {
+      uint32_t spins = Event::IsMultiCore() ? Event::MIN_SPIN * 8 : 1;
+      for(uint32_t i = 0; i < spins; i++)
+      {
+         if(tryWait())
+         {
+            return true;
+         }
+         Futex::Pause();
+      }
+
+      uint32_t count = _count.load(std::memory_order_acquire);
+      while(count != 0)
+      {
+         if(deadline != nullptr && 
+            std::chrono::steady_clock::now() >= *deadline)
+         {
+            return false;
+         }
+         Futex::Wait(&_count, count, deadline);
+         count = _count.load(std::memory_order_acquire);
+      }
+      return true;
+   }
+
+   //! \brief Private copy constructor. 
+   Latch(Latch const&);
+   
+   //! \brief Private assignment operator.
+   Latch& operator=(Latch const&);
+};
+
 }
 #endif
@@ -0,0 +1,255 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file Histogram.h
+//! \brief Log bucketed histogram of latencies. 
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+//! \brief Global aire namespace.
+namespace aire
+{
+
+//! \brief Log bucketed histogram of latencies.
+//!
+//! The histogram uses the layout of a high dynamic range histogram. Values 
+//! below SUB_COUNT are counted exactly. Above, every power of two is split 
+//! into SUB_COUNT/2 linear buckets, so a value is resolved with a relative 
+//! error below 2/SUB_COUNT over the full 64 bit range. The memory is fixed 
+//! and recording a value is a few instructions, the bucket is computed 
+//! from the leading zero count without a branch on the magnitude. Without 
+//! a count leading zeros intrinsic the logarithm falls back to a loop.
+class Histogram
+{
+public:
+   //! \brief Number of bits of the linear sub buckets.
+   static const uint32_t SUB_BITS = 6;
+
+   //! \brief Number of exactly counted values.
+   static const uint32_t SUB_COUNT = 1u << SUB_BITS;
+
+   //! \brief Number of buckets per power of two.
+   static const uint32_t HALF_COUNT = SUB_COUNT / 2;
+
+   //! \brief Total number of buckets.
+   static const uint32_t NUM_BUCKETS = 
+      SUB_COUNT + (64 - SUB_BITS) * HALF_COUNT;
+
+   //! \brief Constructor of the object.
+   Histogram()
+   {
+      initialize();
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~Histogram() { }
+
+   //! \brief Initializes the histogram to be empty.
+   virtual void initialize()
+   {
+      reset();
+   }
+
+   //! \brief Removes all recorded values, e.g. to start a new interval.
+   void reset()
+   {
+      std::memset(_counts, 0, sizeof(_counts));
+      _count = 0;
+      _sum = 0;
+      _min = UINT64_MAX;
+      _max = 0;
+   }
+
+   //! \brief Records a value.
+   //! \param value The value to record.
+   void record(uint64_t value)
+   {
+      _counts[GetIndex(value)]++;
+      _count++;
+      _sum += static_cast<double>(value);
+      _min = std::min(_min, value);
+      _max = std::max(_max, value);
+   }
+
+   //! \brief Adds all values of another histogram.
+   //! \param other The histogram of another thread or interval.
+   void merge(const Histogram& other)
+   {
+      for(uint32_t i = 0; i < NUM_BUCKETS; i++)
+      {
+         _counts[i] += other._counts[i];
+      }
+      _count += other._count;
+      _sum += other._sum;
+      _min = std::min(_min, other._min);
+      _max = std::max(_max, other._max);
+   }
+
+   //! \brief Access to the number of recorded values.
+   //! \return The number of values.
+   uint64_t getCount() const
+   {
+      return _count;
+   }
+
+   //! \brief Access to the smallest recorded value.
+   //! \return The exact minimum or 0 if the histogram is empty.
+   uint64_t getMin() const
+   {
+      return (_count > 0) ? _min : 0;
+   }
+
+   //! \brief Access to the largest recorded value.
+   //! \return The exact maximum.
+   uint64_t getMax() const
+   {
+      return _max;
+   }
+
+   //! \brief Access to the mean of the recorded values.
+   //! \return The mean or 0 if the histogram is empty.
+   double getMean() const
+   {
+      return (_count > 0) ? _sum / static_cast<double>(_count) : 0.0;
+   }
+
+   //! \brief Access to a percentile.
+   //! \param percent The percentile between 0 and 100, e.g. 99.9.
+   //! \return The highest value of the bucket holding the percentile.
+   uint64_t getPercentile(double percent) const
+   {
+      if(_count == 0)
+      {
+         return 0;
+      }
+      percent = std::min(std::max(percent, 0.0), 100.0);
+      uint64_t rank = static_cast<uint64_t>(
+         percent / 100.0 * static_cast<double>(_count) + 0.5);
+      rank = std::max<uint64_t>(rank, 1);
+      uint64_t seen = 0;
+      for(uint32_t i = 0; i < NUM_BUCKETS; i++)
+      {
+         seen += _counts[i];
+         if(seen >= rank)
+         {
+            return std::min(std::max(GetHighest(i), _min), _max);
+         }
+      }
+      return _max;
+   }
+
+   //! \brief Prints min, p50, p90, p99, p99.9 and max in one line.
+   //! \param stream The output stream to print to.
+   //! \param scale Factor to convert the values into the printed unit.
+   template<class CharType>
+   void printPercentiles(std::basic_ostream<CharType>& stream, 
+      double scale = 1.0) const
+   {
+      const double percents[] = { 50.0, 90.0, 99.0, 99.9 };
+      const char* labels[] = { " p50 ", " p90 ", " p99 ", " p99.9 " };
+      std::ios::fmtflags flags = stream.flags();
+      std::streamsize precision = stream.precision(3);
+      stream << std::scientific << "min " << getMin() * scale;
+      for(uint32_t i = 0; i < 4; i++)
+      {
+         stream << labels[i] << getPercentile(percents[i]) * scale;
+      }
+      stream << " max " << getMax() * scale;
+      stream.precision(precision);
+      stream.flags(flags);
+   }
+
+   //! \brief Computes the bucket of a value.
+   //! \param value The value to look up.
+   //! \return The index of the bucket.
+   static uint32_t GetIndex(uint64_t value)
+   {
+      // Values below SUB_COUNT get the shift 0 and map to themselves
+      uint32_t shift = Log2(value | (SUB_COUNT - 1)) + 1 - SUB_BITS;
+      return shift * HALF_COUNT + static_cast<uint32_t>(value >> shift);
+   }
+
+   //! \brief Computes the highest value of a bucket.
+   //! \param index The index of the bucket.
+   //! \return The largest value that maps to the bucket.
+   static uint64_t GetHighest(uint32_t index)
+   {
+      if(index < SUB_COUNT)
+      {
+         return index;
+      }
+      uint32_t k = index - SUB_COUNT;
+      uint32_t shift = k / HALF_COUNT + 1;
+      uint64_t mantissa = k % HALF_COUNT + HALF_COUNT + 1;
+      return (mantissa << shift) - 1;
+   }
+
+private:
+   //! \brief Counts per bucket.
+   uint64_t _counts[NUM_BUCKETS];
+
+   //! \brief Number of recorded values.
+   uint64_t _count;
+
+   //! \brief Sum of all recorded values.
+   double _sum;
+
+   //! \brief Smallest recorded value.
+   uint64_t _min;
+
+   //! \brief Largest recorded value.
+   uint64_t _max;
+
+   //! \brief Computes the position of the highest set bit.
+   //! \param value A value larger than 0.
+   //! \return The base 2 logarithm rounded down.
+   static uint32_t Log2(uint64_t value)
+   {
+      #if defined(__GNUC__) || defined(__clang__)
+      return 63 - __builtin_clzll(value);
+      #elif defined(_MSC_VER) && defined(_M_X64)
+      unsigned long index;
+      _BitScanReverse64(&index, value);
+      return index;
+      #else
+      uint32_t result = 0;
+      while(value >>= 1)
+      {
+         result++;
+      }
+      return result;
+      #endif
+   }
+
+   //! \brief Private copy constructor. 
+   Histogram(Histogram const&);
+   
+   //! \brief Private assignment operator. 
+   Histogram& operator=(Histogram const&); 
+};
+
+}
+
+#endif
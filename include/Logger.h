@@ -0,0 +1,633 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file Logger.h
+//! \brief Asynchronous logger with a background writer thread. 
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/uio.h>
+#include <cerrno>
+#endif
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <streambuf>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+
+#include "Event.h"
+#include "Singleton.h"
+
+//! \brief Global aire namespace.
+namespace aire
+{
+
+//! \brief Asynchronous logger with a background writer thread.
+//!
+//! Every thread formats its lines into records of a preallocated buffer of 
+//! its own. A finished record is pushed to a lock-free multi-producer 
+//! single-consumer queue. The writer thread pops the records in batches 
+//! and writes a batch with one writev call to the file descriptor, then it 
+//! returns the records to the buffers of their threads. No lock and no 
+//! allocation is taken per line once a thread has its buffer. A thread 
+//! whose records are all in flight waits for the writer. Lines longer than 
+//! LINE_SIZE are truncated. Use LogStream to write a line. Interrupted and 
+//! partial writes are resumed, a batch is only dropped on a write error, 
+//! see getNumDropped and getError.
+class Logger
+{
+public:
+   //! \brief Maximal number of bytes of a line.
+   static const size_t LINE_SIZE = 256;
+
+   //! \brief Maximal number of lines of a write call.
+   static const size_t MAX_BATCH = 256;
+
+   //! \brief Constructor of the object.
+   //! \param fd The file descriptor to write to, standard output by default.
+   //! \param numRecords The number of records per thread.
+   Logger(int fd = 1, size_t numRecords = 1024)
+   {
+      initialize(fd, numRecords);
+   }
+
+   //! \brief Destructor of the object that writes all pending lines.
+   virtual ~Logger()
+   {
+      destroy();
+   }
+
+   //! \brief Starts the writer thread.
+   //! \param fd The file descriptor to write to.
+   //! \param numRecords The number of records per thread.
+   virtual void initialize(int fd = 1, size_t numRecords = 1024)
+   {
+      _id = GetNextId();
+      _fd = fd;
+      _numRecords = (numRecords > 0) ? numRecords : 1;
+      _stub.next = nullptr;
+      _head = &_stub;
+      _tail = &_stub;
+      _numPushed = 0;
+      _numWritten = 0;
+      _numDropped = 0;
+      _error = 0;
+      _isIdle = 0;
+      _epoch = 0;
+      _isStopping = false;
+      _writer = std::thread(&Logger::run, this);
+   }
+
+   //! \brief Writes all pending lines and stops the writer thread.
+   virtual void destroy()
+   {
+      if(_writer.joinable())
+      {
+         _isStopping = true;
+         wake();
+         _writer.join();
+      }
+      std::lock_guard<std::mutex> lock(_mutex);
+      _threads.clear();
+      _buffers.clear();
+
+      // Thread local caches must not point to the freed buffers
+      _id = GetNextId();
+   }
+
+   //! \brief Waits until all lines pushed before the call are written.
+   void flush()
+   {
+      uint64_t target = _numPushed.load();
+      while(_numWritten.load(std::memory_order_acquire) < target)
+      {
+         wake();
+         std::this_thread::yield();
+      }
+   }
+
+   //! \brief Access to the number of written lines.
+   //! \return The number of lines, including dropped lines.
+   uint64_t getNumLines() const
+   {
+      return _numWritten.load(std::memory_order_acquire);
+   }
+
+   //! \brief Access to the number of lines lost by write errors.
+   //! \return The number of lines that were not or only partly written.
+   uint64_t getNumDropped() const
+   {
+      return _numDropped.load(std::memory_order_acquire);
+   }
+
+   //! \brief Access to the last write error.
+   //! \return The errno of the last failed write or 0.
+   int getError() const
+   {
+      return _error.load(std::memory_order_acquire);
+   }
+
+private:
+   friend class LogStream;
+
+   //! \brief Link of the queue and of the free lists.
+   struct Node
+   {
+      //! \brief The next node.
+      std::atomic<Node*> next;
+   };
+
+   struct Buffer;
+
+   //! \brief One line of a thread.
+   struct Record : Node
+   {
+      //! \brief The buffer the record belongs to.
+      Buffer* owner;
+
+      //! \brief The number of bytes of the line.
+      size_t size;
+
+      //! \brief The line.
+      char data[LINE_SIZE];
+   };
+
+   //! \brief Stream buffer on the data of a record.
+   class LineBuf : public std::streambuf
+   {
+   public:
+      //! \brief Points the stream buffer to a record.
+      void reset(Record* record)
+      {
+         setp(record->data, record->data + LINE_SIZE);
+      }
+
+      //! \brief Access to the number of written bytes.
+      size_t getSize() const
+      {
+         return static_cast<size_t>(pptr() - pbase());
+      }
+   };
+
+   //! \brief Records and formatting stream of a thread.
+   struct Buffer
+   {
+      //! \brief Constructor that links all records into the free list.
+      //! \param numRecords The number of records.
+      Buffer(size_t numRecords) : records(new Record[numRecords]), 
+         free(nullptr), returned(nullptr), stream(&line)
+      {
+         for(size_t i = 0; i < numRecords; i++)
+         {
+            records[i].owner = this;
+            records[i].next.store(free, std::memory_order_relaxed);
+            free = &records[i];
+         }
+      }
+
+      //! \brief The records.
+      std::unique_ptr<Record[]> records;
+
+      //! \brief Free records, only used by the owner thread.
+      Node* free;
+
+      //! \brief Records returned by the writer.
+      std::atomic<Node*> returned;
+
+      //! \brief Stream buffer of the current line.
+      LineBuf line;
+
+      //! \brief Stream of the current line.
+      std::ostream stream;
+   };
+
+   //! \brief Thread local cache entry for the buffer of the thread.
+   struct Cache
+   {
+      //! \brief Id of the logger the entry belongs to.
+      uint64_t id;
+
+      //! \brief Buffer of the thread.
+      Buffer* buffer;
+   };
+
+   //! \brief Unique id of the object.
+   uint64_t _id;
+
+   //! \brief File descriptor of the output.
+   int _fd;
+
+   //! \brief Number of records per thread.
+   size_t _numRecords;
+
+   //! \brief Mutex for the registration of the threads.
+   std::mutex _mutex;
+
+   //! \brief Buffers in registration order.
+   std::vector<std::unique_ptr<Buffer>> _buffers;
+
+   //! \brief Index into the buffers by thread.
+   std::map<std::thread::id, size_t> _threads;
+
+   //! \brief Node of the empty queue.
+   Node _stub;
+
+   //! \brief Newest node of the queue, written by the producers.
+   std::atomic<Node*> _head;
+
+   //! \brief Oldest node of the queue, only used by the writer.
+   Node* _tail;
+
+   //! \brief Number of pushed lines.
+   std::atomic<uint64_t> _numPushed;
+
+   //! \brief Number of written lines.
+   std::atomic<uint64_t> _numWritten;
+
+   //! \brief Number of lines lost by write errors.
+   std::atomic<uint64_t> _numDropped;
+
+   //! \brief Errno of the last failed write.
+   std::atomic<int> _error;
+
+   //! \brief Specifies that the writer looks for lines to park.
+   std::atomic<uint32_t> _isIdle;
+
+   //! \brief Word the writer parks on.
+   std::atomic<uint32_t> _epoch;
+
+   //! \brief Specifies that the writer exits when the queue is empty.
+   std::atomic<bool> _isStopping;
+
+   //! \brief The writer thread.
+   std::thread _writer;
+
+   //! \brief Unique id to detect stale thread local caches.
+   //! \return A new id, never 0.
+   static uint64_t GetNextId()
+   {
+      static std::atomic<uint64_t> nextId(1);
+      return nextId++;
+   }
+
+   //! \brief Access to the thread local cache.
+   //! \return The cache entry of the calling thread.
+   static Cache& GetCache()
+   {
+      static thread_local Cache cache = {0, nullptr};
+      return cache;
+   }
+
+   //! \brief Access to the buffer of the calling thread.
+   //! \return The cached buffer of the calling thread.
+   Buffer& local()
+   {
+      Cache& cache = GetCache();
+      if(cache.id != _id)
+      {
+         cache.buffer = &attach();
+         cache.id = _id;
+      }
+      return *cache.buffer;
+   }
+
+   //! \brief Looks up or creates the buffer of the calling thread.
+   //! \return The buffer of the calling thread.
+   Buffer& attach()
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::thread::id tid = std::this_thread::get_id();
+      auto it = _threads.find(tid);
+      if(it != _threads.end())
+      {
+         return *_buffers[it->second];
+      }
+      _threads[tid] = _buffers.size();
+      _buffers.push_back(std::unique_ptr<Buffer>(new Buffer(_numRecords)));
+      return *_buffers.back();
+   }
+
+   //! \brief Takes a free record of the calling thread.
+   //! \return The record.
+   Record* acquire()
+   {
+      Buffer& buffer = local();
+      while(buffer.free == nullptr)
+      {
+         buffer.free = buffer.returned.exchange(nullptr, 
+            std::memory_order_acquire);
+         if(buffer.free == nullptr)
+         {
+            // All records are in flight
+            wake();
+            std::this_thread::yield();
+         }
+      }
+      Record* record = static_cast<Record*>(buffer.free);
+      buffer.free = record->next.load(std::memory_order_relaxed);
+      return record;
+   }
+
+   //! \brief Pushes a record to the queue and wakes the writer.
+   //! \param record The record.
+   void commit(Record* record)
+   {
+      record->next.store(nullptr, std::memory_order_relaxed);
+      Node* prev = _head.exchange(record, std::memory_order_acq_rel);
+      prev->next.store(record, std::memory_order_release);
+      _numPushed.fetch_add(1, std::memory_order_relaxed);
+
+      // Order the push before the check of the idle writer
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if(_isIdle.load(std::memory_order_relaxed) != 0)
+      {
+         wake();
+      }
+   }
+
+   //! \brief Wakes the writer.
+   void wake()
+   {
+      _epoch++;
+      Futex::Wake(&_epoch, 1);
+   }
+
+   //! \brief Pops the oldest node of the queue, only called by the writer.
+   //! \return The record or nullptr if the queue is empty.
+   Record* pop()
+   {
+      Node* tail = _tail;
+      Node* next = tail->next.load(std::memory_order_acquire);
+      if(tail == &_stub)
+      {
+         if(next == nullptr)
+         {
+            return nullptr;
+         }
+         _tail = next;
+         tail = next;
+         next = next->next.load(std::memory_order_acquire);
+      }
+      if(next != nullptr)
+      {
+         _tail = next;
+         return static_cast<Record*>(tail);
+      }
+      if(tail != _head.load(std::memory_order_acquire))
+      {
+         // A producer has not linked its record yet
+         return nullptr;
+      }
+      _stub.next.store(nullptr, std::memory_order_relaxed);
+      Node* prev = _head.exchange(&_stub, std::memory_order_acq_rel);
+      prev->next.store(&_stub, std::memory_order_release);
+      next = tail->next.load(std::memory_order_acquire);
+      if(next != nullptr)
+      {
+         _tail = next;
+         return static_cast<Record*>(tail);
+      }
+      return nullptr;
+   }
+
+   //! \brief Returns a record to the buffer of its thread.
+   //! \param record The record.
+   static void release(Record* record)
+   {
+      std::atomic<Node*>& returned = record->owner->returned;
+      Node* head = returned.load(std::memory_order_relaxed);
+      do
+      {
+         record->next.store(head, std::memory_order_relaxed);
+      }
+      while(!returned.compare_exchange_weak(head, record, 
+         std::memory_order_release, std::memory_order_relaxed));
+   }
+
+   //! \brief Writes a batch of lines.
+   //! \param records The records.
+   //! \param count The number of records.
+   void write(Record** records, size_t count)
+   {
+      #if defined(__linux__) || defined(__APPLE__)
+      struct iovec vectors[MAX_BATCH];
+      for(size_t i = 0; i < count; i++)
+      {
+         vectors[i].iov_base = records[i]->data;
+         vectors[i].iov_len = records[i]->size;
+      }
+      struct iovec* vector = vectors;
+      int numVectors = static_cast<int>(count);
+      while(numVectors > 0)
+      {
+         ssize_t written = ::writev(_fd, vector, numVectors);
+         if(written < 0 && errno == EINTR)
+         {
+            continue;
+         }
+         if(written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         {
+            // A non-blocking descriptor is full, wait for the reader
+            std::this_thread::yield();
+            continue;
+         }
+         if(written <= 0)
+         {
+            // Drop the rest of the batch, the line in progress included
+            _error.store((written < 0) ? errno : EIO, 
+               std::memory_order_release);
+            _numDropped.fetch_add(static_cast<uint64_t>(numVectors), 
+               std::memory_order_release);
+            break;
+         }
+
+         // Skip what is written after a partial write
+         size_t bytes = static_cast<size_t>(written);
+         while(numVectors > 0 && bytes >= vector->iov_len)
+         {
+            bytes -= vector->iov_len;
+            vector++;
+            numVectors--;
+         }
+         if(numVectors > 0)
+         {
+            vector->iov_base = static_cast<char*>(vector->iov_base) + bytes;
+            vector->iov_len -= bytes;
+         }
+      }
+      #else
+      for(size_t i = 0; i < count; i++)
+      {
+         std::cout.write(records[i]->data, records[i]->size);
+      }
+      std::cout.flush();
+      #endif
+   }
+
+   //! \brief Writes and releases the queued lines in batches.
+   //! \return The number of written lines.
+   size_t drain()
+   {
+      Record* batch[MAX_BATCH];
+      size_t total = 0;
+      size_t count = 0;
+      do
+      {
+         count = 0;
+         Record* record = nullptr;
+         while(count < MAX_BATCH && (record = pop()) != nullptr)
+         {
+            batch[count++] = record;
+         }
+         if(count > 0)
+         {
+            write(batch, count);
+            for(size_t i = 0; i < count; i++)
+            {
+               release(batch[i]);
+            }
+            _numWritten.fetch_add(count, std::memory_order_release);
+            total += count;
+         }
+      }
+      while(count == MAX_BATCH);
+      return total;
+   }
+
+   //! \brief Main loop of the writer.
+   void run()
+   {
+      while(true)
+      {
+         if(drain() > 0)
+         {
+            continue;
+         }
+
+         // Register as idle before the last look for lines
+         _isIdle = 1;
+         uint32_t epoch = _epoch.load();
+         if(drain() > 0)
+         {
+            _isIdle = 0;
+            continue;
+         }
+         if(_isStopping.load())
+         {
+            _isIdle = 0;
+            if(_numWritten.load() == _numPushed.load())
+            {
+               break;
+            }
+            std::this_thread::yield();
+            continue;
+         }
+         Futex::Wait(&_epoch, epoch, nullptr);
+         _isIdle = 0;
+      }
+   }
+
+   //! \brief Private copy constructor. 
+   Logger(Logger const&);
+   
+   //! \brief Private assignment operator.
+   Logger& operator=(Logger const&);
+};
+
+//! \brief Stream of one line of the asynchronous logger.
+//!
+//! The line is formatted into a record of the thread and pushed to the 
+//! logger when the stream is destroyed. Use it as a temporary:
+//! aire::LogStream(logger) << "ID:" << id << "\n";
+//! A LogStream must not be created while another one of the same thread 
+//! and logger is alive.
+class LogStream
+{
+public:
+   //! \brief Constructor of a line of the default logger.
+   LogStream()
+   {
+      initialize(*Singleton<Logger>::GetInstance());
+   }
+
+   //! \brief Constructor of the object.
+   //! \param logger The logger to write to.
+   LogStream(Logger& logger)
+   {
+      initialize(logger);
+   }
+
+   //! \brief Destructor of the object that pushes the line.
+   virtual ~LogStream()
+   {
+      destroy();
+   }
+
+   //! \brief Takes a record of the calling thread.
+   //! \param logger The logger to write to.
+   virtual void initialize(Logger& logger)
+   {
+      _logger = &logger;
+      _record = logger.acquire();
+      Logger::Buffer* buffer = _record->owner;
+      buffer->line.reset(_record);
+      buffer->stream.clear();
+   }
+
+   //! \brief Pushes the line to the logger.
+   virtual void destroy()
+   {
+      if(_record != nullptr)
+      {
+         _record->size = _record->owner->line.getSize();
+         _logger->commit(_record);
+         _record = nullptr;
+      }
+   }
+
+   //! \brief Formats data into the line.
+   //! \param data The data to format.
+   //! \return The stream itself.
+   template<class StreamType> LogStream& operator<<(const StreamType& data)
+   {
+      _record->owner->stream << data;
+      return *this;
+   }
+
+private:
+   //! \brief The logger of the line.
+   Logger* _logger;
+
+   //! \brief The record of the line.
+   Logger::Record* _record;
+
+   //! \brief Private copy constructor. 
+   LogStream(LogStream const&);
+   
+   //! \brief Private assignment operator.
+   LogStream& operator=(LogStream const&);
+};
+
+}
+
+#endif
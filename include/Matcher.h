@@ -0,0 +1,643 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file Matcher.h
+//! \brief Multi-pattern substring search. 
+#ifndef MATCHER_H
+#define MATCHER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+#include "StringRef.h"
+#include "TextChunk.h"
+
+//! \brief Global aire namespace.
+namespace aire 
+{
+
+//! \brief Multi-pattern substring search with the Aho-Corasick automaton.
+//!
+//! The keys are compiled into a deterministic automaton, so the text is 
+//! scanned once with one table lookup per character for any number of 
+//! keys. Like String::CountSubstr and String::ReplaceSubstr the matches are 
+//! leftmost and do not overlap, of several keys starting at the same 
+//! position the longest wins. Characters that occur in no key share one 
+//! column of the table. Use it as:
+//! Matcher<char> matcher; matcher.add("key", "value"); matcher.compile();
+//! std::string result = matcher.replaceAll(text);
+template<class CharType>
+class Matcher
+{
+public:
+   //! \brief Occurrence of a key.
+   struct Match
+   {
+      //! \brief Index of the first character in the text.
+      size_t position;
+
+      //! \brief Length of the key.
+      size_t length;
+
+      //! \brief Index of the key.
+      uint32_t key;
+   };
+
+   //! \brief Constructor of the object.
+   Matcher()
+   {
+      initialize();
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~Matcher()
+   {
+      destroy();
+   }
+
+   //! \brief Initializes an empty matcher.
+   virtual void initialize()
+   {
+      _numClasses = 1;
+      _maxLength = 0;
+      std::fill(_narrow, _narrow + NUM_NARROW, 0);
+   }
+
+   //! \brief Frees the keys and the automaton.
+   virtual void destroy()
+   {
+      _keys.clear();
+      _values.clear();
+      _next.clear();
+      _depths.clear();
+      _outputs.clear();
+      _links.clear();
+      _wide.clear();
+   }
+
+   //! \brief Adds a key, call compile before the next search.
+   //! \param key The substring to search for, an empty key never matches.
+   //! \param value The substitution of the key for replaceAll.
+   //! \return The index of the key.
+   uint32_t add(const std::basic_string<CharType>& key, 
+      const std::basic_string<CharType>& value = 
+      std::basic_string<CharType>())
+   {
+      _keys.push_back(key);
+      _values.push_back(value);
+      return static_cast<uint32_t>(_keys.size() - 1);
+   }
+
+   //! \brief Access to the number of keys.
+   //! \return The number of keys.
+   size_t getNumKeys() const
+   {
+      return _keys.size();
+   }
+
+   //! \brief Access to a key.
+   //! \param key The index of the key.
+   //! \return The key.
+   const std::basic_string<CharType>& getKey(uint32_t key) const
+   {
+      return _keys[key];
+   }
+
+   //! \brief Builds the automaton of all added keys.
+   void compile()
+   {
+      buildClasses();
+      size_t numClasses = _numClasses;
+
+      // Trie of the keys, a zero entry is a missing edge
+      _next.assign(numClasses, 0);
+      _depths.assign(1, 0);
+      _outputs.assign(1, static_cast<uint32_t>(NONE));
+      _maxLength = 0;
+      for(size_t k = 0; k < _keys.size(); k++)
+      {
+         _maxLength = std::max(_maxLength, _keys[k].size());
+         uint32_t state = 0;
+         for(size_t i = 0; i < _keys[k].size(); i++)
+         {
+            size_t slot = state * numClasses + getClass(_keys[k][i]);
+            if(_next[slot] == 0)
+            {
+               _next[slot] = static_cast<uint32_t>(_depths.size());
+               _next.resize(_next.size() + numClasses, 0);
+               _depths.push_back(_depths[state] + 1);
+               _outputs.push_back(static_cast<uint32_t>(NONE));
+            }
+            state = _next[slot];
+         }
+         if(state != 0 && _outputs[state] == NONE)
+         {
+            _outputs[state] = static_cast<uint32_t>(k);
+         }
+      }
+
+      // Failure links in breadth first order turn the trie into a 
+      // deterministic automaton, links chain the states with an output
+      std::vector<uint32_t> failures(_depths.size(), 0);
+      _links.assign(_depths.size(), 0);
+      std::deque<uint32_t> queue;
+      for(size_t c = 0; c < numClasses; c++)
+      {
+         if(_next[c] != 0)
+         {
+            queue.push_back(_next[c]);
+         }
+      }
+      while(!queue.empty())
+      {
+         uint32_t state = queue.front();
+         queue.pop_front();
+         uint32_t failure = failures[state];
+         _links[state] = (_outputs[failure] != NONE) ? failure : 
+            _links[failure];
+         for(size_t c = 0; c < numClasses; c++)
+         {
+            uint32_t& next = _next[state * numClasses + c];
+            uint32_t fallback = _next[failure * numClasses + c];
+            if(next != 0)
+            {
+               failures[next] = fallback;
+               queue.push_back(next);
+            }
+            else
+            {
+               next = fallback;
+            }
+         }
+      }
+   }
+
+   //! \brief Counts the occurrences of all keys.
+   //! \param text String to analyze, any string converts to the view.
+   //! \return Number of occurrences.
+   size_t count(StringRef<CharType> text) const
+   {
+      size_t count = 0;
+      scan(text.getData(), text.getSize(), 
+         [&count] (const Match&) { count++; });
+      return count;
+   }
+
+   //! \brief Finds the occurrences of all keys.
+   //! \param text String to analyze.
+   //! \return The occurrences in the order of the text.
+   std::vector<Match> findAll(StringRef<CharType> text) const
+   {
+      std::vector<Match> matches;
+      scan(text.getData(), text.getSize(), [&matches] (const Match& match)
+         {
+            matches.push_back(match);
+         }
+      );
+      return matches;
+   }
+
+   //! \brief Substitutes the occurrences of all keys by their values.
+   //!
+   //! The matches are collected first, so the result is allocated once.
+   //! \param text String to transform.
+   //! \return New string with the substitutions.
+   std::basic_string<CharType> replaceAll(StringRef<CharType> text) const
+   {
+      std::vector<Match> matches = findAll(text);
+      size_t size = text.getSize();
+      for(size_t i = 0; i < matches.size(); i++)
+      {
+         size += _values[matches[i].key].size() - matches[i].length;
+      }
+      std::basic_string<CharType> result;
+      result.reserve(size);
+      size_t position = 0;
+      for(size_t i = 0; i < matches.size(); i++)
+      {
+         result.append(text.getData() + position, 
+            matches[i].position - position);
+         result.append(_values[matches[i].key]);
+         position = matches[i].position + matches[i].length;
+      }
+      result.append(text.getData() + position, text.getSize() - position);
+      return result;
+   }
+
+   //! \brief Counts the occurrences of all keys with a thread pool.
+   //!
+   //! The text is scanned in chunks in parallel, a chunk reads the longest 
+   //! key - 1 characters of the next one to see the matches that cross the 
+   //! boundary. Such a match moves the start of the next chunk, it is 
+   //! scanned again from there until its matches meet the matches of the 
+   //! parallel scan. The result equals count without a pool.
+   //! \param pool The pool that runs the chunks.
+   //! \param text String to analyze.
+   //! \param grain Number of characters of a chunk, 0 for a few per thread.
+   //! \return Number of occurrences.
+   size_t count(ThreadPool& pool, StringRef<CharType> text, 
+      size_t grain = 0) const
+   {
+      std::vector<Chunk> chunks;
+      scanChunks(pool, text, grain, false, chunks);
+      return TextChunk::GetCount(chunks);
+   }
+
+   //! \brief Finds the occurrences of all keys with a thread pool.
+   //! \param pool The pool that runs the chunks.
+   //! \param text String to analyze.
+   //! \param grain Number of characters of a chunk, 0 for a few per thread.
+   //! \return The occurrences in the order of the text.
+   std::vector<Match> findAll(ThreadPool& pool, StringRef<CharType> text, 
+      size_t grain = 0) const
+   {
+      std::vector<Chunk> chunks;
+      scanChunks(pool, text, grain, true, chunks);
+      std::vector<Match> matches;
+      matches.reserve(TextChunk::GetCount(chunks));
+      for(size_t i = 0; i < chunks.size(); i++)
+      {
+         matches.insert(matches.end(), chunks[i].matches.begin(), 
+            chunks[i].matches.end());
+      }
+      return matches;
+   }
+
+   //! \brief Substitutes the occurrences of all keys with a thread pool.
+   //!
+   //! Every chunk writes its part of the result in parallel.
+   //! \param pool The pool that runs the chunks.
+   //! \param text String to transform.
+   //! \param grain Number of characters of a chunk, 0 for a few per thread.
+   //! \return New string with the substitutions.
+   std::basic_string<CharType> replaceAll(ThreadPool& pool, 
+      StringRef<CharType> text, size_t grain = 0) const
+   {
+      std::vector<Chunk> chunks;
+      scanChunks(pool, text, grain, true, chunks);
+
+      // A chunk owns the text up to the start of the next chunk
+      std::vector<size_t> offsets(chunks.size() + 1, 0);
+      for(size_t i = 0; i < chunks.size(); i++)
+      {
+         size_t size = TextChunk::GetStart(chunks, i + 1, text.getSize()) - 
+            chunks[i].start;
+         for(size_t j = 0; j < chunks[i].matches.size(); j++)
+         {
+            const Match& match = chunks[i].matches[j];
+            size += _values[match.key].size() - match.length;
+         }
+         offsets[i + 1] = offsets[i] + size;
+      }
+      std::basic_string<CharType> result(offsets.back(), CharType());
+      pool.parallelFor(0, chunks.size(), 1, [&] (size_t i)
+         {
+            typedef std::char_traits<CharType> Traits;
+            const std::vector<Match>& matches = chunks[i].matches;
+            CharType* output = &result[0] + offsets[i];
+            size_t position = chunks[i].start;
+            for(size_t j = 0; j < matches.size(); j++)
+            {
+               const std::basic_string<CharType>& value = 
+                  _values[matches[j].key];
+               Traits::copy(output, text.getData() + position, 
+                  matches[j].position - position);
+               output += matches[j].position - position;
+               Traits::copy(output, value.data(), value.size());
+               output += value.size();
+               position = matches[j].position + matches[j].length;
+            }
+            Traits::copy(output, text.getData() + position, 
+               TextChunk::GetStart(chunks, i + 1, text.getSize()) - position);
+         }
+      );
+      return result;
+   }
+
+   //! \brief Calls a function for the occurrences of all keys.
+   //! \param text The first character to analyze.
+   //! \param size The number of characters.
+   //! \param func The function that takes a Match.
+   template<class FuncType>
+   void scan(const CharType* text, size_t size, FuncType func) const
+   {
+      if(_depths.empty())
+      {
+         return;
+      }
+
+      // Matches wait until no longer or more left match can follow
+      std::vector<Match> pending;
+      size_t minStart = 0;
+      uint32_t state = 0;
+      for(size_t i = 0; i < size; i++)
+      {
+         state = _next[state * _numClasses + getClass(text[i])];
+         uint32_t output = (_outputs[state] != NONE) ? state : _links[state];
+         while(output != 0)
+         {
+            size_t start = i + 1 - _depths[output];
+            if(start >= minStart)
+            {
+               Match match = {start, _depths[output], _outputs[output]};
+               pending.push_back(match);
+            }
+            output = _links[output];
+         }
+         if(!pending.empty())
+         {
+            commit(pending, minStart, i + 1 - _depths[state], func);
+         }
+      }
+      commit(pending, minStart, size + 1, func);
+   }
+
+private:
+   //! \brief Marks states without output.
+   static const uint32_t NONE = 0xffffffff;
+
+   //! \brief Number of characters with a class in a table.
+   static const size_t NUM_NARROW = 256;
+
+   //! \brief Part of a text that is scanned by one task.
+   struct Chunk : public TextChunk
+   {
+      //! \brief The matches if they are collected.
+      std::vector<Match> matches;
+   };
+
+   //! \brief The keys.
+   std::vector<std::basic_string<CharType>> _keys;
+
+   //! \brief The substitutions of the keys.
+   std::vector<std::basic_string<CharType>> _values;
+
+   //! \brief Number of character classes.
+   size_t _numClasses;
+
+   //! \brief Length of the longest key.
+   size_t _maxLength;
+
+   //! \brief Classes of the characters below NUM_NARROW.
+   uint32_t _narrow[NUM_NARROW];
+
+   //! \brief Sorted classes of the other characters of the keys.
+   std::vector<std::pair<CharType, uint32_t>> _wide;
+
+   //! \brief Transitions by state and class.
+   std::vector<uint32_t> _next;
+
+   //! \brief Length of the prefix of every state.
+   std::vector<size_t> _depths;
+
+   //! \brief Key that ends in a state or NONE.
+   std::vector<uint32_t> _outputs;
+
+   //! \brief Next shorter suffix state with an output, 0 if none.
+   std::vector<uint32_t> _links;
+
+   //! \brief Assigns a class to every character that occurs in a key.
+   void buildClasses()
+   {
+      std::fill(_narrow, _narrow + NUM_NARROW, 0);
+      _wide.clear();
+      _numClasses = 1;
+      for(size_t k = 0; k < _keys.size(); k++)
+      {
+         for(size_t i = 0; i < _keys[k].size(); i++)
+         {
+            CharType c = _keys[k][i];
+            if(getClass(c) != 0)
+            {
+               continue;
+            }
+            if(Unsigned(c) < NUM_NARROW)
+            {
+               _narrow[Unsigned(c)] = static_cast<uint32_t>(_numClasses);
+            }
+            else
+            {
+               std::pair<CharType, uint32_t> entry(c, 
+                  static_cast<uint32_t>(_numClasses));
+               _wide.insert(std::upper_bound(_wide.begin(), _wide.end(), 
+                  entry), entry);
+            }
+            _numClasses++;
+         }
+      }
+   }
+
+   //! \brief Access to the class of a character.
+   //! \param c The character.
+   //! \return The class, 0 for characters that occur in no key.
+   uint32_t getClass(CharType c) const
+   {
+      if(Unsigned(c) < NUM_NARROW)
+      {
+         return _narrow[Unsigned(c)];
+      }
+      typename std::vector<std::pair<CharType, uint32_t>>::const_iterator 
+         it = std::lower_bound(_wide.begin(), _wide.end(), 
+         std::pair<CharType, uint32_t>(c, 0));
+      return (it != _wide.end() && it->first == c) ? it->second : 0;
+   }
+
+   //! \brief Scans the chunks of a text in parallel.
+   //! \param pool The pool that runs the chunks.
+   //! \param text String to analyze.
+   //! \param grain The requested number of characters, 0 for automatic.
+   //! \param isCollect Specifies if the matches are kept.
+   //! \param chunks The chunks with the matches of a sequential scan.
+   void scanChunks(ThreadPool& pool, StringRef<CharType> text, size_t grain,
+      bool isCollect, std::vector<Chunk>& chunks) const
+   {
+      size_t size = text.getSize();
+      size_t chunkSize = TextChunk::GetSize(pool, size, _maxLength, grain);
+      chunks.resize((size + chunkSize - 1) / chunkSize);
+      pool.parallelFor(0, chunks.size(), 1, [&] (size_t i)
+         {
+            Chunk& chunk = chunks[i];
+            chunk.place(i, chunkSize, size);
+            scanPart(text, chunk.first, getLimit(chunk, size), chunk.last, 
+               isCollect, chunk);
+         }
+      );
+
+      // Matches across a boundary move the start of the next chunk
+      for(size_t i = 1; i < chunks.size(); i++)
+      {
+         if(chunks[i - 1].end > chunks[i].first)
+         {
+            resync(text, chunks[i - 1].end, isCollect, chunks[i]);
+         }
+      }
+   }
+
+   //! \brief Scans the matches of a chunk from a later start.
+   //!
+   //! The matches from both starts are compared in growing windows. Once 
+   //! they meet, the rest of the matches is the same and the chunk is 
+   //! corrected, else the chunk is scanned to its end.
+   //! \param text String to analyze.
+   //! \param start The position behind the last match of the chunk before.
+   //! \param isCollect Specifies if the matches are kept.
+   //! \param chunk The chunk with the matches from its first position.
+   void resync(StringRef<CharType> text, size_t start, bool isCollect, 
+      Chunk& chunk) const
+   {
+      size_t limit = getLimit(chunk, text.getSize());
+      size_t window = 16 * _maxLength;
+      Chunk old;
+      Chunk moved;
+      while(true)
+      {
+         // Matches are stable if the longest key fits into the window
+         size_t end = (limit - start > window) ? start + window : limit;
+         size_t stable = (end == limit) ? chunk.last : 
+            std::min(chunk.last, end + 1 - _maxLength);
+         scanPart(text, chunk.first, end, stable, true, old);
+         scanPart(text, start, end, stable, true, moved);
+         size_t k = 0;
+         for(size_t j = 0; j < moved.count; j++)
+         {
+            size_t position = moved.matches[j].position;
+            while(k < old.count && old.matches[k].position < position)
+            {
+               k++;
+            }
+            if(k < old.count && old.matches[k].position == position)
+            {
+               chunk.start = start;
+               chunk.count = j + chunk.count - k;
+               if(isCollect)
+               {
+                  moved.matches.resize(j);
+                  moved.matches.insert(moved.matches.end(), 
+                     chunk.matches.begin() + k, chunk.matches.end());
+                  chunk.matches.swap(moved.matches);
+               }
+               return;
+            }
+         }
+         if(end == limit)
+         {
+            // The matches never meet, the chunk is scanned completely
+            chunk.start = start;
+            chunk.end = moved.end;
+            chunk.count = moved.count;
+            chunk.matches.swap(moved.matches);
+            return;
+         }
+         window *= 4;
+      }
+   }
+
+   //! \brief Scans the matches of a part of a text.
+   //! \param text String to analyze.
+   //! \param start The position the matches start from.
+   //! \param end The position behind the characters to read.
+   //! \param stable The position behind the matches to take.
+   //! \param isCollect Specifies if the matches are kept.
+   //! \param part The part with the matches, positions are in the text.
+   void scanPart(StringRef<CharType> text, size_t start, size_t end, 
+      size_t stable, bool isCollect, Chunk& part) const
+   {
+      part.start = start;
+      part.end = start;
+      part.count = 0;
+      part.matches.clear();
+      scan(text.getData() + start, end - start, [&] (const Match& match)
+         {
+            if(start + match.position < stable)
+            {
+               Match found = {start + match.position, match.length, 
+                  match.key};
+               part.end = found.position + found.length;
+               part.count++;
+               if(isCollect)
+               {
+                  part.matches.push_back(found);
+               }
+            }
+         }
+      );
+   }
+
+   //! \brief Position behind the characters a chunk reads.
+   size_t getLimit(const Chunk& chunk, size_t size) const
+   {
+      return TextChunk::GetLimit(chunk, _maxLength, size);
+   }
+
+   //! \brief Converts a character to its unsigned code.
+   static uint64_t Unsigned(CharType c)
+   {
+      return static_cast<typename std::make_unsigned<CharType>::type>(c);
+   }
+
+   //! \brief Reports the leftmost longest pending matches.
+   //! \param pending The pending matches.
+   //! \param minStart The first position a match may start at.
+   //! \param alive The first position a later match can start at.
+   //! \param func The function that takes a Match.
+   template<class FuncType>
+   static void commit(std::vector<Match>& pending, size_t& minStart, 
+      size_t alive, FuncType& func)
+   {
+      while(!pending.empty())
+      {
+         size_t best = 0;
+         for(size_t j = 1; j < pending.size(); j++)
+         {
+            if(pending[j].position < pending[best].position || 
+               (pending[j].position == pending[best].position && 
+               pending[j].length > pending[best].length))
+            {
+               best = j;
+            }
+         }
+         if(pending[best].position >= alive)
+         {
+            break;
+         }
+         func(pending[best]);
+         minStart = pending[best].position + pending[best].length;
+         size_t kept = 0;
+         for(size_t j = 0; j < pending.size(); j++)
+         {
+            if(pending[j].position >= minStart)
+            {
+               pending[kept++] = pending[j];
+            }
+         }
+         pending.resize(kept);
+      }
+   }
+
+   //! \brief Private copy constructor. 
+   Matcher(Matcher const&);
+   
+   //! \brief Private assignment operator.
+   Matcher& operator=(Matcher const&);
+};
+
+}
+
+#endif
@@ -0,0 +1,461 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file Regression.h
+//! \brief Comparison of the benchmark results of two runs. 
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <istream>
+#include <ostream>
+#include <iterator>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+
+#include "Test.h"
+
+//! \brief Global aire namespace.
+namespace aire
+{
+
+//! \brief Compares the benchmarks of two JSON result files of Test.
+//!
+//! A benchmark is slower if its median grew by more than a threshold and a 
+//! one-sided Mann-Whitney U test of the samples is significant. The U test 
+//! compares the ranks of the samples, so it does not assume normal 
+//! distributed times and single outliers have little weight. For up to 
+//! EXACT_MAX pairs of samples the exact distribution of U is used, else 
+//! its normal approximation. Use it as:
+//! std::vector<Test::Benchmark> baseline, current; 
+//! Regression::Read(baselineFile, baseline); Regression::Read(file, current);
+//! Regression::Print(std::cout, Regression::Compare(baseline, current));
+class Regression
+{
+public:
+   //! \brief Change of a benchmark between two runs.
+   struct Change
+   {
+      //! \brief Name of the benchmark.
+      std::string name;
+
+      //! \brief Median of the baseline in nanoseconds.
+      double baseline;
+
+      //! \brief Median of the current run in nanoseconds.
+      double current;
+
+      //! \brief Probability of the change if the runs do not differ.
+      double probability;
+
+      //! \brief Specifies a significant slowdown.
+      bool isSlower;
+
+      //! \brief Specifies a significant speedup.
+      bool isFaster;
+   };
+
+   //! \brief Maximal product of the sample counts of the exact U test.
+   static const size_t EXACT_MAX = 400;
+
+   Regression() { }
+   virtual ~Regression() { }
+
+   //! \brief Reads the benchmarks of a JSON result file.
+   //! \param stream The stream of the file that Test::writeJson wrote.
+   //! \param benchmarks The benchmarks of the file.
+   //! \return False if the stream is no valid result file.
+   static bool Read(std::istream& stream, 
+      std::vector<Test::Benchmark>& benchmarks)
+   {
+      std::string text((std::istreambuf_iterator<char>(stream)), 
+         std::istreambuf_iterator<char>());
+      size_t position = 0;
+      benchmarks.clear();
+      if(!Expect(text, position, '{'))
+      {
+         return false;
+      }
+      std::string key;
+      while(!Expect(text, position, '}'))
+      {
+         if(!ParseString(text, position, key) || 
+            !Expect(text, position, ':'))
+         {
+            return false;
+         }
+         if(key != "benchmarks")
+         {
+            if(!Skip(text, position))
+            {
+               return false;
+            }
+         }
+         else if(!ParseBenchmarks(text, position, benchmarks))
+         {
+            return false;
+         }
+         Expect(text, position, ',');
+      }
+      return true;
+   }
+
+   //! \brief Compares the benchmarks that are in both runs.
+   //! \param baseline The benchmarks of the earlier run.
+   //! \param current The benchmarks of the current run.
+   //! \param threshold The relative change of the median to report.
+   //! \param alpha The significance level of the U test.
+   //! \return The changes in the order of the current run.
+   static std::vector<Change> Compare(
+      const std::vector<Test::Benchmark>& baseline, 
+      const std::vector<Test::Benchmark>& current, double threshold = 0.05, 
+      double alpha = 0.05)
+   {
+      std::vector<Change> changes;
+      for(size_t i = 0; i < current.size(); i++)
+      {
+         for(size_t k = 0; k < baseline.size(); k++)
+         {
+            if(baseline[k].name != current[i].name)
+            {
+               continue;
+            }
+            Change change;
+            change.name = current[i].name;
+            change.baseline = baseline[k].median;
+            change.current = current[i].median;
+            double slower = GetProbability(current[i].samples, 
+               baseline[k].samples);
+            double faster = GetProbability(baseline[k].samples, 
+               current[i].samples);
+            change.probability = std::min(slower, faster);
+            change.isSlower = slower < alpha && 
+               change.current > change.baseline * (1 + threshold);
+            change.isFaster = faster < alpha && 
+               change.current * (1 + threshold) < change.baseline;
+            changes.push_back(change);
+            break;
+         }
+      }
+      return changes;
+   }
+
+   //! \brief Prints the changes.
+   //! \param stream The output stream.
+   //! \param changes The changes of the benchmarks.
+   //! \return The number of slowdowns.
+   static size_t Print(std::ostream& stream, 
+      const std::vector<Change>& changes)
+   {
+      std::ios::fmtflags flags = stream.flags();
+      size_t numSlower = 0;
+      for(size_t i = 0; i < changes.size(); i++)
+      {
+         const Change& change = changes[i];
+         double percent = (change.baseline > 0) ? 
+            100 * (change.current / change.baseline - 1) : 0;
+         stream << std::fixed << std::setprecision(2) << change.name << ": " 
+            << change.baseline << " -> " << change.current << " ns/op (" 
+            << std::showpos << percent << std::noshowpos << "%, p=" 
+            << std::setprecision(4) << change.probability << ")" 
+            << (change.isSlower ? " SLOWER" : "") 
+            << (change.isFaster ? " faster" : "") << std::endl;
+         numSlower += change.isSlower ? 1 : 0;
+      }
+      stream.flags(flags);
+      return numSlower;
+   }
+
+   //! \brief Probability that the first samples are this much larger.
+   //!
+   //! The one-sided p-value of the Mann-Whitney U test. U counts the pairs 
+   //! in which the first sample is larger, ties count one half.
+   //! \param larger The samples that are tested to be larger.
+   //! \param smaller The other samples.
+   //! \return The probability of U or more if both have one distribution.
+   static double GetProbability(const std::vector<double>& larger, 
+      const std::vector<double>& smaller)
+   {
+      size_t n1 = larger.size();
+      size_t n2 = smaller.size();
+      if(n1 == 0 || n2 == 0)
+      {
+         return 1;
+      }
+      double u = 0;
+      for(size_t i = 0; i < n1; i++)
+      {
+         for(size_t j = 0; j < n2; j++)
+         {
+            u += (larger[i] > smaller[j]) ? 1 : 
+               ((larger[i] == smaller[j]) ? 0.5 : 0);
+         }
+      }
+      if(n1 * n2 > EXACT_MAX)
+      {
+         double mean = static_cast<double>(n1 * n2) / 2;
+         double deviation = std::sqrt(static_cast<double>(n1 * n2) * 
+            static_cast<double>(n1 + n2 + 1) / 12);
+         return 0.5 * std::erfc((u - mean - 0.5) / deviation / std::sqrt(2.0));
+      }
+
+      // Orderings of i and j samples by U, the largest sample is either of 
+      // the first samples and exceeds all j others or of the second ones
+      std::vector<std::vector<double>> previous(n2 + 1, 
+         std::vector<double>(1, 1.0));
+      std::vector<std::vector<double>> row(n2 + 1);
+      for(size_t i = 1; i <= n1; i++)
+      {
+         row[0].assign(1, 1.0);
+         for(size_t j = 1; j <= n2; j++)
+         {
+            row[j].assign(i * j + 1, 0.0);
+            for(size_t k = 0; k < previous[j].size(); k++)
+            {
+               row[j][k + j] += previous[j][k];
+            }
+            for(size_t k = 0; k < row[j - 1].size(); k++)
+            {
+               row[j][k] += row[j - 1][k];
+            }
+         }
+         previous.swap(row);
+      }
+      const std::vector<double>& counts = previous[n2];
+      double total = 0;
+      double tail = 0;
+      for(size_t k = 0; k < counts.size(); k++)
+      {
+         total += counts[k];
+         tail += (static_cast<double>(k) >= u) ? counts[k] : 0;
+      }
+      return tail / total;
+   }
+
+private:
+   //! \brief Skips white space.
+   static void SkipSpace(const std::string& text, size_t& position)
+   {
+      while(position < text.size() && 
+         (text[position] == ' ' || text[position] == '\n' || 
+         text[position] == '\r' || text[position] == '\t'))
+      {
+         position++;
+      }
+   }
+
+   //! \brief Skips white space and consumes an expected character.
+   //! \return False if the next character differs.
+   static bool Expect(const std::string& text, size_t& position, char c)
+   {
+      SkipSpace(text, position);
+      if(position < text.size() && text[position] == c)
+      {
+         position++;
+         return true;
+      }
+      return false;
+   }
+
+   //! \brief Parses a JSON string, \u escapes are converted to UTF-8.
+   static bool ParseString(const std::string& text, size_t& position, 
+      std::string& value)
+   {
+      value.clear();
+      if(!Expect(text, position, '"'))
+      {
+         return false;
+      }
+      while(position < text.size() && text[position] != '"')
+      {
+         char c = text[position++];
+         if(c != '\\' || position >= text.size())
+         {
+            value += c;
+            continue;
+         }
+         c = text[position++];
+         const char* escapes = "b\bf\fn\nr\rt\t";
+         const char* found = 
+            (c != '\0') ? std::strchr(escapes, c) : nullptr;
+         if(c == 'u' && position + 4 <= text.size())
+         {
+            uint32_t code = static_cast<uint32_t>(std::strtoul(
+               text.substr(position, 4).c_str(), nullptr, 16));
+            position += 4;
+            if(code < 0x80)
+            {
+               value += static_cast<char>(code);
+            }
+            else if(code < 0x800)
+            {
+               value += static_cast<char>(0xc0 | (code >> 6));
+               value += static_cast<char>(0x80 | (code & 0x3f));
+            }
+            else
+            {
+               value += static_cast<char>(0xe0 | (code >> 12));
+               value += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+               value += static_cast<char>(0x80 | (code & 0x3f));
+            }
+         }
+         else
+         {
+            value += (found != nullptr && (found - escapes) % 2 == 0) ? 
+               found[1] : c;
+         }
+      }
+      return Expect(text, position, '"');
+   }
+
+   //! \brief Parses a JSON number.
+   static bool ParseNumber(const std::string& text, size_t& position, 
+      double& value)
+   {
+      SkipSpace(text, position);
+      const char* start = text.c_str() + position;
+      char* end = nullptr;
+      value = std::strtod(start, &end);
+      position += end - start;
+      return end != start;
+   }
+
+   //! \brief Skips a JSON value of any type.
+   static bool Skip(const std::string& text, size_t& position)
+   {
+      std::string word;
+      double number = 0;
+      if(Expect(text, position, '{'))
+      {
+         while(!Expect(text, position, '}'))
+         {
+            if(!ParseString(text, position, word) || 
+               !Expect(text, position, ':') || !Skip(text, position))
+            {
+               return false;
+            }
+            Expect(text, position, ',');
+         }
+         return true;
+      }
+      if(Expect(text, position, '['))
+      {
+         while(!Expect(text, position, ']'))
+         {
+            if(!Skip(text, position))
+            {
+               return false;
+            }
+            Expect(text, position, ',');
+         }
+         return true;
+      }
+      SkipSpace(text, position);
+      if(position < text.size() && text[position] == '"')
+      {
+         return ParseString(text, position, word);
+      }
+      const char* literals[] = {"true", "false", "null"};
+      for(size_t i = 0; i < 3; i++)
+      {
+         if(text.compare(position, std::strlen(literals[i]), literals[i]) == 0)
+         {
+            position += std::strlen(literals[i]);
+            return true;
+         }
+      }
+      return ParseNumber(text, position, number);
+   }
+
+   //! \brief Parses the array of the benchmarks.
+   static bool ParseBenchmarks(const std::string& text, size_t& position, 
+      std::vector<Test::Benchmark>& benchmarks)
+   {
+      if(!Expect(text, position, '['))
+      {
+         return false;
+      }
+      std::string key;
+      while(!Expect(text, position, ']'))
+      {
+         Test::Benchmark benchmark = {std::string(), 0, std::vector<double>(),
+            0, 0, 0, 0};
+         if(!Expect(text, position, '{'))
+         {
+            return false;
+         }
+         while(!Expect(text, position, '}'))
+         {
+            double number = 0;
+            if(!ParseString(text, position, key) || 
+               !Expect(text, position, ':'))
+            {
+               return false;
+            }
+            bool isValid = true;
+            if(key == "name")
+            {
+               isValid = ParseString(text, position, benchmark.name);
+            }
+            else if(key == "samples" && Expect(text, position, '['))
+            {
+               while(isValid && !Expect(text, position, ']'))
+               {
+                  isValid = ParseNumber(text, position, number);
+                  benchmark.samples.push_back(number);
+                  Expect(text, position, ',');
+               }
+            }
+            else if(key == "iterations" || key == "median" || 
+               key == "deviation" || key == "minimum" || 
+               key == "opsPerSecond")
+            {
+               isValid = ParseNumber(text, position, number);
+               benchmark.iterations = (key == "iterations") ? 
+                  static_cast<uint64_t>(number) : benchmark.iterations;
+               benchmark.median = (key == "median") ? 
+                  number : benchmark.median;
+               benchmark.deviation = (key == "deviation") ? 
+                  number : benchmark.deviation;
+               benchmark.minimum = (key == "minimum") ? 
+                  number : benchmark.minimum;
+               benchmark.opsPerSecond = (key == "opsPerSecond") ? 
+                  number : benchmark.opsPerSecond;
+            }
+            else
+            {
+               isValid = Skip(text, position);
+            }
+            if(!isValid)
+            {
+               return false;
+            }
+            Expect(text, position, ',');
+         }
+         benchmarks.push_back(benchmark);
+         Expect(text, position, ',');
+      }
+      return true;
+   }
+};
+
+}
+
+#endif
@@ -13,27 +13,42 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 //
 //! \file Singleton.h
-//! \brief Singleton templated design pattern. 
+//! \brief Singleton templated design pattern with per-thread and sharded 
+//! variants. 
 #ifndef SINGLETON_H
 #define SINGLETON_H
 
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
 #include <cassert>
 #include <new>
 #include <cstdlib>
+#include <iostream>
+#include <atomic>
 #include <mutex>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+#include "System.h"
 
 //! \brief Global aire namespace.
 namespace aire
 {
 
-std::mutex globalMutex;
-
 //! \brief Singleton templated design pattern.
 //
 // As we now from: Scott Meyers and Andrei Alexandrescu. 
 // C++ and the Perils of Double-Checked Locking, Doctor Dobb's Journal, 2004.
-// Locking every time the Singleton is accessed is the best way to ensure 
-// thread safety.
+// The double-checked locking is safe with the C++11 memory model if the 
+// instance pointer is an atomic that is published with release and read 
+// with acquire semantics. After the construction GetInstance is a single 
+// load without any lock. Every singleton type has its own mutex that is 
+// only taken to construct or destroy the instance.
 template<class ClassType>
 class Singleton
 {
@@ -42,30 +57,37 @@ public:
    //! \return The instance of the singleton.
    static ClassType* GetInstance()
    {
-      std::lock_guard<std::mutex> lock(globalMutex);
-      if(_instance == nullptr) 
+      ClassType* instance = _instance.load(std::memory_order_acquire);
+      if(instance == nullptr) 
       {
-         try
-         {
-            _instance = new ClassType;
-            atexit(Singleton<ClassType>::destroy);
-         }
-         catch(std::bad_alloc& e)
+         std::lock_guard<std::mutex> lock(_mutex);
+         instance = _instance.load(std::memory_order_relaxed);
+         if(instance == nullptr) 
          {
-			   std::cerr << "Allocate error: " << e.what() << std::endl;
-            exit(EXIT_FAILURE);
+            try
+            {
+               instance = new ClassType;
+               atexit(Singleton<ClassType>::destroy);
+            }
+            catch(std::bad_alloc& e)
+            {
+               std::cerr << "Allocate error: " << e.what() << std::endl;
+               exit(EXIT_FAILURE);
+            }
+            _instance.store(instance, std::memory_order_release);
          }
       }
-      assert(_instance != nullptr);
-      return _instance;
+      assert(instance != nullptr);
+      return instance;
    }
   
   static void destroy()
   {
-      std::lock_guard<std::mutex> lock(globalMutex);
-      if(_instance != nullptr)
+      std::lock_guard<std::mutex> lock(_mutex);
+      ClassType* instance = _instance.exchange(nullptr);
+      if(instance != nullptr)
       {
-         delete _instance;
+         delete instance;
       }
   }
   
@@ -78,7 +100,10 @@ protected:
   
 private:
    //! \brief The singleton class instance.
-   static ClassType* _instance;
+   static std::atomic<ClassType*> _instance;
+
+   //! \brief Mutex for the construction of this singleton type.
+   static std::mutex _mutex;
    
    //! \brief Private copy constructor.
    Singleton(Singleton const&);
@@ -89,7 +114,221 @@ private:
 
 // Initialize static instance to null.
 template<class ClassType> 
-ClassType* Singleton<ClassType>::_instance = nullptr;
+std::atomic<ClassType*> Singleton<ClassType>::_instance(nullptr);
+
+// Mutex per singleton type.
+template<class ClassType> 
+std::mutex Singleton<ClassType>::_mutex;
+
+//! \brief Singleton with one instance per thread.
+//
+// The instance of a thread is constructed on the first access of the 
+// thread and destroyed when the thread exits. The access does not need 
+// any synchronization.
+template<class ClassType>
+class ThreadSingleton
+{
+public:
+   //! \brief Access the instance of the calling thread.
+   //! \return The instance of the calling thread.
+   static ClassType* GetInstance()
+   {
+      static thread_local std::unique_ptr<ClassType> instance;
+      if(!instance)
+      {
+         instance.reset(new ClassType());
+      }
+      return instance.get();
+   }
+
+protected:
+   //! \brief Constructor of the object.
+   ThreadSingleton() { }
+
+   //! \brief Destructor of the object.
+   virtual ~ThreadSingleton() { }
+
+private:
+   //! \brief Private copy constructor.
+   ThreadSingleton(ThreadSingleton const&);
+   
+   //! \brief Private assignment operator. 
+   ThreadSingleton& operator=(ThreadSingleton const&);
+};
+
+//! \brief Singleton with a fixed number of instances (shards).
+//
+// There is one shard per core. GetInstance picks the shard of the CPU the 
+// thread runs on, GetByThread picks the shard by a hash of the thread id. 
+// A thread can migrate or share its shard with other threads, so the 
+// ClassType must still be thread safe, e.g. use atomics. Visit iterates 
+// over all shards to aggregate them. The shards are constructed on the 
+// first access like the Singleton. Every shard starts on its own cache 
+// line, so small shards like counters of different cores do not share one.
+template<class ClassType>
+class ShardedSingleton
+{
+public:
+   //! \brief Access the shard of the current CPU.
+   //!
+   //! Falls back to GetByThread if the CPU can not be queried.
+   //! \return The instance of the shard.
+   static ClassType* GetInstance()
+   {
+      #if defined(__linux__)
+      int cpu = sched_getcpu();
+      if(cpu >= 0)
+      {
+         return GetShard(static_cast<size_t>(cpu));
+      }
+      #endif
+      return GetByThread();
+   }
+
+   //! \brief Access the shard of the calling thread.
+   //! \return The instance of the shard.
+   static ClassType* GetByThread()
+   {
+      static thread_local size_t hash = 
+         std::hash<std::thread::id>()(std::this_thread::get_id());
+      return GetShard(hash);
+   }
+
+   //! \brief Access to the number of shards.
+   //! \return The number of instances.
+   static size_t GetNumShards()
+   {
+      GetShards();
+      return _numShards;
+   }
+
+   //! \brief Calls a function for every shard.
+   //! \param func The function that takes a reference of an instance.
+   template<class FuncType>
+   static void Visit(FuncType func)
+   {
+      Slot* shards = GetShards();
+      for(size_t i = 0; i < _numShards; i++)
+      {
+         func(shards[i].instance);
+      }
+   }
+
+   //! \brief Destroys all shards.
+   static void destroy()
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      Slot* shards = _shards.exchange(nullptr);
+      if(shards != nullptr)
+      {
+         for(size_t i = 0; i < _numShards; i++)
+         {
+            shards[i].~Slot();
+         }
+         ::operator delete(_memory);
+         _memory = nullptr;
+      }
+   }
+
+protected:
+   //! \brief Constructor of the object.
+   ShardedSingleton() { }
+
+   //! \brief Destructor of the object.
+   virtual ~ShardedSingleton() { }
+
+private:
+   //! \brief Size of the cache line the shards are aligned to.
+   static const size_t LINE_SIZE = 64;
+
+   //! \brief Instance of a shard padded to whole cache lines.
+   struct alignas(LINE_SIZE) Slot
+   {
+      //! \brief The instance of the shard.
+      ClassType instance;
+   };
+
+   //! \brief The instances of the shards.
+   static std::atomic<Slot*> _shards;
+
+   //! \brief The memory of the shards before the alignment.
+   static void* _memory;
+
+   //! \brief The number of shards.
+   static size_t _numShards;
+
+   //! \brief Mutex for the construction of the shards.
+   static std::mutex _mutex;
+
+   //! \brief Access a shard by an arbitrary index.
+   //! \param index Any number, it is reduced modulo the number of shards.
+   //! \return The instance of the shard.
+   static ClassType* GetShard(size_t index)
+   {
+      Slot* shards = GetShards();
+      return &shards[index % _numShards].instance;
+   }
+
+   //! \brief Access the shards with double-checked construction.
+   //! \return The array of instances.
+   static Slot* GetShards()
+   {
+      Slot* shards = _shards.load(std::memory_order_acquire);
+      if(shards == nullptr)
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         shards = _shards.load(std::memory_order_relaxed);
+         if(shards == nullptr)
+         {
+            try
+            {
+               int32_t numCores = System::GetNumCores();
+               _numShards = (numCores > 0) ? numCores : 1;
+               // Operator new only aligns to the fundamental alignment
+               _memory = ::operator new(_numShards * sizeof(Slot) + 
+                  LINE_SIZE);
+               shards = reinterpret_cast<Slot*>((reinterpret_cast<uintptr_t>(
+                  _memory) + LINE_SIZE - 1) & ~(LINE_SIZE - 1));
+               for(size_t i = 0; i < _numShards; i++)
+               {
+                  new(&shards[i]) Slot();
+               }
+               atexit(ShardedSingleton<ClassType>::destroy);
+            }
+            catch(std::bad_alloc& e)
+            {
+               std::cerr << "Allocate error: " << e.what() << std::endl;
+               exit(EXIT_FAILURE);
+            }
+            _shards.store(shards, std::memory_order_release);
+         }
+      }
+      return shards;
+   }
+
+   //! \brief Private copy constructor.
+   ShardedSingleton(ShardedSingleton const&);
+   
+   //! \brief Private assignment operator. 
+   ShardedSingleton& operator=(ShardedSingleton const&);
+};
+
+// Initialize static shards to null.
+template<class ClassType> 
+std::atomic<typename ShardedSingleton<ClassType>::Slot*> 
+   ShardedSingleton<ClassType>::_shards(nullptr);
+
+// Unaligned memory of the shards.
+template<class ClassType> 
+void* ShardedSingleton<ClassType>::_memory = nullptr;
+
+// Number of shards, set on construction.
+template<class ClassType> 
+size_t ShardedSingleton<ClassType>::_numShards = 0;
+
+// Mutex per sharded singleton type.
+template<class ClassType> 
+std::mutex ShardedSingleton<ClassType>::_mutex;
 
 }
 #endif
@@ -0,0 +1,453 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file StateMachine.h
+//! \brief Table driven finite state machine. 
+#ifndef STATEMACHINE_H
+#define STATEMACHINE_H
+
+#include <cstdint>
+#include <cstddef>
+
+//! \brief Global aire namespace.
+namespace aire
+{
+
+//! \brief Transition of a state machine.
+//!
+//! A transition is taken if the machine is in the state from, gets the 
+//! event and the guard returns true or is nullptr. The action is called 
+//! before the machine enters the state to. All members are constant 
+//! expressions, so a table of transitions is constexpr.
+template<class ContextType, class StateType, class EventType>
+struct Transition
+{
+   //! \brief The state the transition leaves.
+   StateType from;
+
+   //! \brief The event that triggers the transition.
+   EventType event;
+
+   //! \brief The state the transition enters.
+   StateType to;
+
+   //! \brief Optional condition on the context, nullptr always passes.
+   bool (*guard)(const ContextType&);
+
+   //! \brief Optional action on the context, nullptr does nothing.
+   void (*action)(ContextType&);
+};
+
+//! \brief Compile time sequence of indices.
+template<size_t... I>
+struct Indices
+{
+};
+
+//! \brief Appends the second sequence shifted behind the first one.
+template<class FirstType, class SecondType>
+struct ConcatIndices;
+
+//! \brief Appends the second sequence shifted behind the first one.
+template<size_t... I, size_t... J>
+struct ConcatIndices<Indices<I...>, Indices<J...>>
+{
+   typedef Indices<I..., (sizeof...(I) + J)...> Type;
+};
+
+//! \brief Sequence of the indices 0 to N - 1 with a logarithmic depth.
+template<size_t N>
+struct MakeIndices
+{
+   typedef typename ConcatIndices<typename MakeIndices<N / 2>::Type, 
+      typename MakeIndices<N - N / 2>::Type>::Type Type;
+};
+
+//! \brief Empty sequence of indices.
+template<>
+struct MakeIndices<0>
+{
+   typedef Indices<> Type;
+};
+
+//! \brief Sequence of the index 0.
+template<>
+struct MakeIndices<1>
+{
+   typedef Indices<0> Type;
+};
+
+//! \brief Cells of a transition table, evaluated once per table.
+//! \see TransitionSearch
+template<class TableType, class TransitionsType, class BlocksType>
+struct CellTable;
+
+//! \brief Compile time search in a transition table.
+//!
+//! The searches split their ranges into halves like MakeIndices, so the 
+//! recursion depth is logarithmic in the number of transitions. The cells 
+//! of the transitions are evaluated once into CellTable with the smallest 
+//! and largest cell of every block of BLOCK_SIZE transitions, a search 
+//! skips the blocks that can not contain its cell.
+//! \see StateMachine
+template<class TableType>
+struct TransitionSearch
+{
+   //! \brief Number of transitions of the table.
+   static const size_t NUM_TRANSITIONS = sizeof(TableType::TRANSITIONS) / 
+      sizeof(TableType::TRANSITIONS[0]);
+
+   //! \brief Number of transitions of a block.
+   static const size_t BLOCK_SIZE = 32;
+
+   //! \brief Number of blocks of the table.
+   static const size_t NUM_BLOCKS = (NUM_TRANSITIONS + BLOCK_SIZE - 1) / 
+      BLOCK_SIZE;
+
+   //! \brief The cells of the table.
+   typedef CellTable<TableType, typename MakeIndices<NUM_TRANSITIONS>::Type,
+      typename MakeIndices<NUM_BLOCKS>::Type> Cells;
+
+   //! \brief Cell of a transition.
+   //! \param index The index of the transition.
+   //! \return The index of the cell or NUM_STATES * NUM_EVENTS if the 
+   //! state or event is out of range.
+   static constexpr size_t GetCell(size_t index)
+   {
+      return (static_cast<size_t>(TableType::TRANSITIONS[index].from) < 
+         TableType::NUM_STATES && static_cast<size_t>(
+         TableType::TRANSITIONS[index].event) < TableType::NUM_EVENTS) ? 
+         static_cast<size_t>(TableType::TRANSITIONS[index].from) * 
+         TableType::NUM_EVENTS + static_cast<size_t>(
+         TableType::TRANSITIONS[index].event) : 
+         TableType::NUM_STATES * TableType::NUM_EVENTS;
+   }
+
+   //! \brief Index behind the last transition of a block.
+   static constexpr size_t GetBlockEnd(size_t block)
+   {
+      return ((block + 1) * BLOCK_SIZE < NUM_TRANSITIONS) ? 
+         (block + 1) * BLOCK_SIZE : NUM_TRANSITIONS;
+   }
+
+   //! \brief Smallest cell of a range of transitions.
+   //! \param first The index of the first transition.
+   //! \param last The index behind the last transition, above first.
+   static constexpr size_t GetMinCell(size_t first, size_t last)
+   {
+      return (last - first > 1) ? Min(GetMinCell(first, 
+         first + (last - first) / 2), GetMinCell(first + (last - first) / 2,
+         last)) : GetCell(first);
+   }
+
+   //! \brief Largest cell of a range of transitions.
+   //! \param first The index of the first transition.
+   //! \param last The index behind the last transition, above first.
+   static constexpr size_t GetMaxCell(size_t first, size_t last)
+   {
+      return (last - first > 1) ? Max(GetMaxCell(first, 
+         first + (last - first) / 2), GetMaxCell(first + (last - first) / 2,
+         last)) : GetCell(first);
+   }
+
+   //! \brief Finds the first transition of a cell from an index on.
+   //! \param cell The index of the cell.
+   //! \param index The index of the first transition to check.
+   //! \return The index + 1 of the transition or 0 if there is none.
+   static constexpr uint16_t Find(size_t cell, size_t index)
+   {
+      return First(FindIn(cell, index, GetBlockEnd(index / BLOCK_SIZE)), 
+         FindBlocks(cell, index / BLOCK_SIZE + 1, NUM_BLOCKS));
+   }
+
+   //! \brief Checks the states and events of a range of transitions.
+   //! \param first The index of the first transition to check.
+   //! \param last The index behind the last transition to check.
+   //! \return True if all states and events are in range.
+   static constexpr bool IsValid(size_t first, size_t last)
+   {
+      return (last - first > 1) ? IsValid(first, first + (last - first) / 2)
+         && IsValid(first + (last - first) / 2, last) : (first == last) || 
+         (GetCell(first) < TableType::NUM_STATES * TableType::NUM_EVENTS && 
+         static_cast<size_t>(TableType::TRANSITIONS[first].to) < 
+         TableType::NUM_STATES);
+   }
+
+private:
+   //! \brief Finds the first transition of a cell in a range.
+   //! \return The index + 1 of the transition or 0 if there is none.
+   static constexpr uint16_t FindIn(size_t cell, size_t first, size_t last)
+   {
+      return (last > first + 1) ? First(FindIn(cell, first, 
+         first + (last - first) / 2), FindIn(cell, 
+         first + (last - first) / 2, last)) : (first < last && 
+         Cells::CELLS[first] == cell) ? static_cast<uint16_t>(first + 1) : 0;
+   }
+
+   //! \brief Finds the first transition of a cell in a range of blocks.
+   //! \return The index + 1 of the transition or 0 if there is none.
+   static constexpr uint16_t FindBlocks(size_t cell, size_t first, 
+      size_t last)
+   {
+      return (last > first + 1) ? First(FindBlocks(cell, first, 
+         first + (last - first) / 2), FindBlocks(cell, 
+         first + (last - first) / 2, last)) : (first < last && 
+         Cells::MIN_CELLS[first] <= cell && cell <= Cells::MAX_CELLS[first]) ?
+         FindIn(cell, first * BLOCK_SIZE, GetBlockEnd(first)) : 0;
+   }
+
+   //! \brief The first found transition of two searches.
+   static constexpr uint16_t First(uint16_t found, uint16_t behind)
+   {
+      return (found != 0) ? found : behind;
+   }
+
+   //! \brief Smaller of two cells.
+   static constexpr size_t Min(size_t a, size_t b)
+   {
+      return (a < b) ? a : b;
+   }
+
+   //! \brief Larger of two cells.
+   static constexpr size_t Max(size_t a, size_t b)
+   {
+      return (a > b) ? a : b;
+   }
+};
+
+//! \brief Cells of the transitions and the smallest and largest cell of 
+//! every block of a transition table.
+template<class TableType, size_t... T, size_t... B>
+struct CellTable<TableType, Indices<T...>, Indices<B...>>
+{
+   //! \brief Search in the transition table.
+   typedef TransitionSearch<TableType> Search;
+
+   //! \brief Cell per transition.
+   static constexpr size_t CELLS[sizeof...(T)] = {Search::GetCell(T)...};
+
+   //! \brief Smallest cell per block.
+   static constexpr size_t MIN_CELLS[sizeof...(B)] = {Search::GetMinCell(
+      B * Search::BLOCK_SIZE, Search::GetBlockEnd(B))...};
+
+   //! \brief Largest cell per block.
+   static constexpr size_t MAX_CELLS[sizeof...(B)] = {Search::GetMaxCell(
+      B * Search::BLOCK_SIZE, Search::GetBlockEnd(B))...};
+};
+
+template<class TableType, size_t... T, size_t... B>
+constexpr size_t CellTable<TableType, Indices<T...>, 
+   Indices<B...>>::CELLS[sizeof...(T)];
+
+template<class TableType, size_t... T, size_t... B>
+constexpr size_t CellTable<TableType, Indices<T...>, 
+   Indices<B...>>::MIN_CELLS[sizeof...(B)];
+
+template<class TableType, size_t... T, size_t... B>
+constexpr size_t CellTable<TableType, Indices<T...>, 
+   Indices<B...>>::MAX_CELLS[sizeof...(B)];
+
+//! \brief Dense jump table of a transition table built at compile time.
+//!
+//! FIRST has one cell per state and event with the index + 1 of the first 
+//! transition of the cell, NEXT has the index + 1 of the next transition 
+//! of the same cell per transition, 0 ends both.
+//! \see StateMachine
+template<class TableType, class CellsType, class TransitionsType>
+struct JumpTable;
+
+//! \brief Dense jump table of a transition table built at compile time.
+template<class TableType, size_t... C, size_t... T>
+struct JumpTable<TableType, Indices<C...>, Indices<T...>>
+{
+   //! \brief Search in the transition table.
+   typedef TransitionSearch<TableType> Search;
+
+   //! \brief First transition per cell of state and event.
+   static constexpr uint16_t FIRST[sizeof...(C)] = {
+      Search::Find(C, 0)...};
+
+   //! \brief Next transition of the same cell per transition.
+   static constexpr uint16_t NEXT[sizeof...(T)] = {
+      Search::Find(Search::Cells::CELLS[T], T + 1)...};
+};
+
+template<class TableType, size_t... C, size_t... T>
+constexpr uint16_t JumpTable<TableType, Indices<C...>, 
+   Indices<T...>>::FIRST[sizeof...(C)];
+
+template<class TableType, size_t... C, size_t... T>
+constexpr uint16_t JumpTable<TableType, Indices<C...>, 
+   Indices<T...>>::NEXT[sizeof...(T)];
+
+//! \brief Finite state machine driven by a constexpr transition table.
+//!
+//! The TableType describes the machine:
+//!
+//! struct Table
+//! {
+//!    typedef Context ContextType;
+//!    typedef State StateType;
+//!    typedef Event EventType;
+//!    static const size_t NUM_STATES = 3;
+//!    static const size_t NUM_EVENTS = 2;
+//!    static const State INITIAL = IDLE;
+//!    static constexpr aire::Transition<Context, State, Event> 
+//!       TRANSITIONS[] = {{IDLE, GO, RUN, nullptr, &start}, ...};
+//! };
+//! constexpr aire::Transition<Context, State, Event> Table::TRANSITIONS[];
+//!
+//! States and events are enums numbered from 0. The transitions are 
+//! compiled into a dense jump table with one cell per state and event, so 
+//! an event is dispatched by one table lookup without branches on the 
+//! state. Transitions of the same state and event are tried in the order 
+//! of the table until a guard passes. The tables are shared by all 
+//! machines of a type, a machine is the current state and the context.
+template<class TableType>
+class StateMachine
+{
+public:
+   //! \brief The context the guards and actions work on.
+   typedef typename TableType::ContextType ContextType;
+
+   //! \brief The state enum of the machine.
+   typedef typename TableType::StateType StateType;
+
+   //! \brief The event enum of the machine.
+   typedef typename TableType::EventType EventType;
+
+   //! \brief Transition of the machine.
+   typedef Transition<ContextType, StateType, EventType> TransitionType;
+
+   //! \brief Number of states.
+   static const size_t NUM_STATES = TableType::NUM_STATES;
+
+   //! \brief Number of events.
+   static const size_t NUM_EVENTS = TableType::NUM_EVENTS;
+
+   //! \brief Constructor of a machine without context, see setContext.
+   StateMachine()
+   {
+      _context = nullptr;
+      initialize();
+   }
+
+   //! \brief Constructor of the object.
+   //! \param context The context of the guards and actions.
+   explicit StateMachine(ContextType& context)
+   {
+      _context = &context;
+      initialize();
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~StateMachine() { }
+
+   //! \brief Initializes the machine to the initial state.
+   virtual void initialize()
+   {
+      _state = TableType::INITIAL;
+   }
+
+   //! \brief Sets the context of the guards and actions.
+   //! \param context The context, e.g. of one controller of many.
+   void setContext(ContextType& context)
+   {
+      _context = &context;
+   }
+
+   //! \brief Access to the context of the guards and actions.
+   ContextType* getContext() const
+   {
+      return _context;
+   }
+
+   //! \brief Access to the current state.
+   StateType getState() const
+   {
+      return _state;
+   }
+
+   //! \brief Processes an event.
+   //!
+   //! The first transition of the state and event with a passing guard 
+   //! calls its action and enters its state. Events without a transition 
+   //! are ignored.
+   //! \param event The event to process.
+   //! \return True if a transition was taken.
+   bool process(EventType event)
+   {
+      size_t index = static_cast<size_t>(event);
+      if(index >= NUM_EVENTS)
+      {
+         return false;
+      }
+      index += static_cast<size_t>(_state) * NUM_EVENTS;
+      for(uint16_t i = Jumps::FIRST[index]; i != 0; i = Jumps::NEXT[i - 1])
+      {
+         const TransitionType& transition = TableType::TRANSITIONS[i - 1];
+         if(transition.guard == nullptr || transition.guard(*_context))
+         {
+            if(transition.action != nullptr)
+            {
+               transition.action(*_context);
+            }
+            _state = transition.to;
+            return true;
+         }
+      }
+      return false;
+   }
+
+   //! \brief Checks if a state has a transition for an event.
+   //! \param state The state.
+   //! \param event The event.
+   //! \return True if there is a transition, regardless of its guard.
+   static bool HasTransition(StateType state, EventType event)
+   {
+      return static_cast<size_t>(state) < NUM_STATES && 
+         static_cast<size_t>(event) < NUM_EVENTS && 
+         Jumps::FIRST[static_cast<size_t>(state) * NUM_EVENTS + 
+         static_cast<size_t>(event)] != 0;
+   }
+
+private:
+   //! \brief Jump table of the transition table.
+   typedef JumpTable<TableType, typename MakeIndices<
+      TableType::NUM_STATES * TableType::NUM_EVENTS>::Type, 
+      typename MakeIndices<sizeof(TableType::TRANSITIONS) / 
+      sizeof(TableType::TRANSITIONS[0])>::Type> Jumps;
+
+   static_assert(Jumps::Search::NUM_TRANSITIONS < UINT16_MAX, 
+      "The jump table holds at most 65534 transitions");
+   static_assert(Jumps::Search::IsValid(0, 
+      Jumps::Search::NUM_TRANSITIONS), 
+      "A state or event of a transition is out of range");
+
+   //! \brief Context of the guards and actions.
+   ContextType* _context;
+
+   //! \brief Current state.
+   StateType _state;
+
+   //! \brief Private copy constructor. 
+   StateMachine(StateMachine const&);
+   
+   //! \brief Private assignment operator.
+   StateMachine& operator=(StateMachine const&);
+};
+
+}
+
+#endif
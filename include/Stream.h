@@ -19,6 +19,14 @@
 
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 //! \brief Global aire namespace.
 namespace aire 
@@ -29,6 +37,7 @@ namespace aire
 //! This class implements a stream that is synchronized for output from 
 //! different threads. Use it as:
 //! std::cout<<(Stream()<<"ID:"<<omp_get_thread_num()<<"\n").toString();  
+//! FixedStream formats without allocations on hot paths.
 class Stream
 {
 public:
@@ -70,5 +79,393 @@ template<class StreamType> Stream& Stream::operator<<(const StreamType& data)
    return *this;
 }
 
+//! \brief Stream that formats into a fixed inline buffer.
+//!
+//! Unlike Stream there is no heap allocation and no locale, the buffer is 
+//! part of the object, e.g. on the stack. Integers, floating point numbers, 
+//! pointers, characters and strings are formatted by hand like the default 
+//! format of std::ostream, exact ties of a number round to even like printf.
+//! With 15 or more digits the last digit of a number can differ. The text 
+//! is cut at SIZE - 1 characters and kept zero terminated. Use it as:
+//! FixedStream<> line; line << "ID:" << id << "\n";
+//! fwrite(line.getData(), 1, line.getSize(), stdout);
+template<size_t SIZE = 256>
+class FixedStream
+{
+public:
+   //! \brief Constructor of the object.
+   FixedStream()
+   {
+      initialize();
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~FixedStream()
+   {
+      destroy();
+   }
+
+   //! \brief Initializes an empty text.
+   virtual void initialize()
+   {
+      _size = 0;
+      _data[0] = '\0';
+      _isTruncated = false;
+      _precision = 6;
+   }
+
+   //! \brief Nothing to free.
+   virtual void destroy()
+   {
+   }
+
+   //! \brief Empties the text and keeps the precision.
+   void clear()
+   {
+      _size = 0;
+      _data[0] = '\0';
+      _isTruncated = false;
+   }
+
+   //! \brief Sets the number of significant digits of floating point numbers.
+   //! \param precision The number of digits between 1 and 17.
+   void setPrecision(int32_t precision)
+   {
+      _precision = (precision < 1) ? 1 : ((precision > 17) ? 17 : precision);
+   }
+
+   //! \brief Access to the zero terminated text.
+   //! \return The text in the buffer.
+   const char* getData() const
+   {
+      return _data;
+   }
+
+   //! \brief Access to the length of the text.
+   //! \return The number of characters.
+   size_t getSize() const
+   {
+      return _size;
+   }
+
+   //! \brief Specifies if the text was cut at the end of the buffer.
+   //! \return True if characters were lost.
+   bool isTruncated() const
+   {
+      return _isTruncated;
+   }
+
+   //! \brief Copies the text to a string.
+   //! \return A standard string.
+   std::string toString() const
+   {
+      return std::string(_data, _size);
+   }
+
+   #if __cplusplus >= 201703L
+   //! \brief Access to the text without a copy.
+   //! \return A view of the buffer, valid until the stream is changed.
+   std::string_view toView() const
+   {
+      return std::string_view(_data, _size);
+   }
+   #endif
+
+   //! \brief Appends characters like std::ostream::write.
+   //! \param data The characters.
+   //! \param size The number of characters.
+   //! \return The stream itself.
+   FixedStream& write(const char* data, size_t size)
+   {
+      append(data, size);
+      return *this;
+   }
+
+   //! \brief Appends a character.
+   FixedStream& operator<<(char data)
+   {
+      append(&data, 1);
+      return *this;
+   }
+
+   //! \brief Appends a character.
+   FixedStream& operator<<(signed char data)
+   {
+      return *this << static_cast<char>(data);
+   }
+
+   //! \brief Appends a character.
+   FixedStream& operator<<(unsigned char data)
+   {
+      return *this << static_cast<char>(data);
+   }
+
+   //! \brief Appends a zero terminated string.
+   FixedStream& operator<<(const char* data)
+   {
+      append(data, std::strlen(data));
+      return *this;
+   }
+
+   //! \brief Appends a string.
+   FixedStream& operator<<(const std::string& data)
+   {
+      append(data.data(), data.size());
+      return *this;
+   }
+
+   //! \brief Appends a boolean as 0 or 1 like std::ostream.
+   FixedStream& operator<<(bool data)
+   {
+      return *this << (data ? '1' : '0');
+   }
+
+   //! \brief Appends an integer.
+   //! \param data The signed or unsigned integer.
+   //! \return The stream itself.
+   template<class IntType>
+   typename std::enable_if<std::is_integral<IntType>::value, 
+      FixedStream&>::type operator<<(IntType data)
+   {
+      if(data < static_cast<IntType>(0) && std::is_signed<IntType>::value)
+      {
+         // Negate in unsigned arithmetic to handle the minimum
+         append("-", 1);
+         writeUnsigned(0 - static_cast<uint64_t>(data));
+      }
+      else
+      {
+         writeUnsigned(static_cast<uint64_t>(data));
+      }
+      return *this;
+   }
+
+   //! \brief Appends a floating point number like %g of printf.
+   FixedStream& operator<<(double data)
+   {
+      writeDouble(data);
+      return *this;
+   }
+
+   //! \brief Appends a floating point number like %g of printf.
+   FixedStream& operator<<(float data)
+   {
+      writeDouble(data);
+      return *this;
+   }
+
+   //! \brief Appends a floating point number with double precision.
+   FixedStream& operator<<(long double data)
+   {
+      writeDouble(static_cast<double>(data));
+      return *this;
+   }
+
+   //! \brief Appends a pointer in hexadecimal.
+   FixedStream& operator<<(const void* data)
+   {
+      char digits[2 * sizeof(uintptr_t) + 2];
+      char* end = digits + sizeof(digits);
+      char* begin = end;
+      uintptr_t value = reinterpret_cast<uintptr_t>(data);
+      do
+      {
+         *--begin = "0123456789abcdef"[value & 0xf];
+         value >>= 4;
+      }
+      while(value != 0);
+      *--begin = 'x';
+      *--begin = '0';
+      append(begin, end - begin);
+      return *this;
+   }
+
+private:
+   //! \brief The zero terminated text.
+   char _data[SIZE];
+
+   //! \brief Length of the text.
+   size_t _size;
+
+   //! \brief Specifies if characters were lost.
+   bool _isTruncated;
+
+   //! \brief Significant digits of floating point numbers.
+   int32_t _precision;
+
+   //! \brief Appends characters as far as they fit.
+   //! \param data The characters.
+   //! \param size The number of characters.
+   void append(const char* data, size_t size)
+   {
+      size_t room = SIZE - 1 - _size;
+      if(size > room)
+      {
+         size = room;
+         _isTruncated = true;
+      }
+      std::memcpy(_data + _size, data, size);
+      _size += size;
+      _data[_size] = '\0';
+   }
+
+   //! \brief Appends the decimal digits of an unsigned integer.
+   //! \param value The integer.
+   void writeUnsigned(uint64_t value)
+   {
+      char digits[20];
+      char* end = digits + sizeof(digits);
+      char* begin = end;
+      do
+      {
+         *--begin = static_cast<char>('0' + value % 10);
+         value /= 10;
+      }
+      while(value != 0);
+      append(begin, end - begin);
+   }
+
+   //! \brief Appends a floating point number with the precision.
+   //!
+   //! The number is scaled to an integer of precision digits. The integer 
+   //! is placed in fixed notation if the exponent is in [-4, precision) and 
+   //! in scientific notation otherwise, trailing zeros are removed. An exact
+   //! tie rounds to the even digit like printf. With 15 or more digits the
+   //! scaling is inexact and the last digit can differ from printf.
+   //! \param value The number.
+   void writeDouble(double value)
+   {
+      if(std::isnan(value))
+      {
+         append("nan", 3);
+         return;
+      }
+      if(std::signbit(value))
+      {
+         append("-", 1);
+         value = -value;
+      }
+      if(std::isinf(value))
+      {
+         append("inf", 3);
+         return;
+      }
+      if(value == 0.0)
+      {
+         append("0", 1);
+         return;
+      }
+
+      // Digits of the mantissa, the scaling is split for subnormals
+      int32_t exponent = static_cast<int32_t>(std::floor(std::log10(value)));
+      uint64_t lower = Power(_precision - 1);
+      uint64_t upper = Power(_precision);
+      uint64_t mantissa = 0;
+      for(int32_t pass = 0; pass < 2; pass++)
+      {
+         // Small powers of ten are exact, so a tie of a short precision 
+         // stays exact when the number is divided instead of multiplied
+         int32_t scale = _precision - 1 - exponent;
+         long double scaled = value;
+         if(scale >= 0)
+         {
+            scaled = scaled * std::pow(10.0L, scale / 2) * 
+               std::pow(10.0L, scale - scale / 2);
+         }
+         else
+         {
+            scaled = scaled / std::pow(10.0L, -scale / 2) / 
+               std::pow(10.0L, -scale + scale / 2);
+         }
+         long double whole = std::floor(scaled);
+         long double fraction = scaled - whole;
+         mantissa = static_cast<uint64_t>(whole);
+         if(fraction > 0.5L || (fraction == 0.5L && mantissa % 2 == 1))
+         {
+            mantissa++;
+         }
+         if(mantissa >= upper)
+         {
+            exponent++;
+         }
+         else if(mantissa < lower)
+         {
+            exponent--;
+         }
+         else
+         {
+            break;
+         }
+      }
+      if(mantissa >= upper)
+      {
+         mantissa = (mantissa + 5) / 10;
+         exponent += (mantissa >= upper) ? 1 : 0;
+         mantissa = (mantissa >= upper) ? mantissa / 10 : mantissa;
+      }
+      char digits[20];
+      int32_t numDigits = _precision;
+      for(int32_t i = numDigits - 1; i >= 0; i--)
+      {
+         digits[i] = static_cast<char>('0' + mantissa % 10);
+         mantissa /= 10;
+      }
+      while(numDigits > 1 && digits[numDigits - 1] == '0')
+      {
+         numDigits--;
+      }
+
+      if(exponent < -4 || exponent >= _precision)
+      {
+         append(digits, 1);
+         if(numDigits > 1)
+         {
+            append(".", 1);
+            append(digits + 1, numDigits - 1);
+         }
+         append(exponent < 0 ? "e-" : "e+", 2);
+         uint32_t magnitude = (exponent < 0) ? -exponent : exponent;
+         if(magnitude < 10)
+         {
+            append("0", 1);
+         }
+         writeUnsigned(magnitude);
+      }
+      else if(exponent < 0)
+      {
+         append("0.", 2);
+         append("0000", -exponent - 1);
+         append(digits, numDigits);
+      }
+      else
+      {
+         int32_t numInteger = exponent + 1;
+         append(digits, (numDigits < numInteger) ? numDigits : numInteger);
+         for(int32_t i = numDigits; i < numInteger; i++)
+         {
+            append("0", 1);
+         }
+         if(numDigits > numInteger)
+         {
+            append(".", 1);
+            append(digits + numInteger, numDigits - numInteger);
+         }
+      }
+   }
+
+   //! \brief Computes a power of ten.
+   //! \param exponent The exponent between 0 and 19.
+   //! \return The power.
+   static uint64_t Power(int32_t exponent)
+   {
+      uint64_t power = 1;
+      for(int32_t i = 0; i < exponent; i++)
+      {
+         power *= 10;
+      }
+      return power;
+   }
+};
+
 }
 #endif
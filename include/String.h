@@ -17,52 +17,719 @@
 #ifndef STRING_H
 #define STRING_H
 
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define AIRE_HAS_SSE2
+#if defined(__GNUC__)
+#define AIRE_HAS_AVX2
+#endif
+#elif defined(_M_X64)
+#include <intrin.h>
+#define AIRE_HAS_SSE2
+#endif
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "StringRef.h"
+#include "TextChunk.h"
+
 //! \brief Global aire namespace.
 namespace aire 
 {
 
 //! \brief Implements some utility functions for strings.
+//!
+//! The functions take StringRef views, so strings, literals, slices and 
+//! string_views are passed without a copy. The character type is deduced 
+//! from the first argument or given explicitly, e.g. CountSubstr<char>.
 class String 
 {
 public:
    //! \brief Count the occurrences of a substring.
+   //!
+   //! The occurrences do not overlap. For char a vectorized filter on the 
+   //! first and last character of the key selects the candidates. Without 
+   //! SSE2 keys of HORSPOOL_MIN or more characters use Boyer-Moore-Horspool.
    //! \param text String to analyze.
-   //! \param key Substring to search for.
+   //! \param key Substring to search for, an empty key never matches.
    //! \return Number of substring occurrences. 
    template<class CharType>
-   static uint32_t CountSubstr(const std::basic_string<CharType>& text,
-      const std::basic_string<CharType>& key)
+   static uint64_t CountSubstr(StringRef<CharType> text, 
+      StringRef<CharType> key)
    {
-      uint32_t count = 0;
-      size_t pos = text.find(key);
-      while(pos != std::string::npos)
+      size_t end = 0;
+      return Count(text.getData(), text.getSize(), key.getData(), 
+         key.getSize(), end);
+   }
+
+   //! \brief Substitute all substrings in a string using.
+   //!
+   //! The matches are counted first, so the result is allocated once and 
+   //! every character is copied once.
+   //! \param text String to transform.
+   //! \param key Substring to search for, an empty key never matches.
+   //! \param value Substitution string.
+   //! \return New string with the substitutions.
+   template<class CharType>
+   static std::basic_string<CharType> ReplaceSubstr(StringRef<CharType> text,
+      StringRef<CharType> key, StringRef<CharType> value)
+   {
+      std::basic_string<CharType> result;
+      ReplaceSubstr(text, key, value, result);
+      return result;
+   }
+
+   //! \brief Appends a string with substituted substrings to an output.
+   //!
+   //! The capacity of the output is reused, it grows at most once.
+   //! \param text String to transform.
+   //! \param key Substring to search for, an empty key never matches.
+   //! \param value Substitution string.
+   //! \param output String to append the result to.
+   template<class CharType>
+   static void ReplaceSubstr(StringRef<CharType> text, 
+      StringRef<CharType> key, StringRef<CharType> value,
+      std::basic_string<CharType>& output)
+   {
+      output.reserve(output.size() + GetReplaceSize(text, key, value));
+      Replace(text, key, value, [&output] (const CharType* data, size_t size)
+         {
+            output.append(data, size);
+         }
+      );
+   }
+
+   //! \brief Writes a string with substituted substrings to a buffer.
+   //! \param text String to transform.
+   //! \param key Substring to search for, an empty key never matches.
+   //! \param value Substitution string.
+   //! \param output Buffer for the result, it is not zero terminated.
+   //! \param capacity Number of characters of the buffer.
+   //! \return Size of the result, nothing is written if it exceeds capacity.
+   template<class CharType>
+   static size_t ReplaceSubstr(StringRef<CharType> text, 
+      StringRef<CharType> key, StringRef<CharType> value, 
+      CharType* output, size_t capacity)
+   {
+      size_t size = GetReplaceSize(text, key, value);
+      if(size <= capacity)
       {
-         count++;
-         pos = text.find(key, pos+key.length());
+         Replace(text, key, value, [&output] (const CharType* data, 
+            size_t count)
+            {
+               std::char_traits<CharType>::copy(output, data, count);
+               output += count;
+            }
+         );
       }
-      return count;
+      return size;
    }
 
-   //! \brief Substitute all substrings in a string using.
+   //! \brief Splits a text at a separator.
+   //!
+   //! Empty tokens are kept, e.g. "a,,b" has the tokens "a", "" and "b".
+   //! \param text String to split, it must outlive the tokenizer.
+   //! \param separator The separator, an empty separator does not split.
+   //! \return The lazy tokenizer.
+   template<class CharType>
+   static Tokenizer<CharType> Split(StringRef<CharType> text, 
+      StringRef<CharType> separator)
+   {
+      return Tokenizer<CharType>(text, separator, false);
+   }
+
+   //! \brief Splits a text at any of some delimiters.
+   //!
+   //! Empty tokens are skipped, e.g. " a  b " has the tokens "a" and "b".
+   //! \param text String to split, it must outlive the tokenizer.
+   //! \param delimiters The delimiter characters.
+   //! \return The lazy tokenizer.
+   template<class CharType>
+   static Tokenizer<CharType> Tokenize(StringRef<CharType> text, 
+      StringRef<CharType> delimiters)
+   {
+      return Tokenizer<CharType>(text, delimiters, true);
+   }
+
+   //! \brief Counts the occurrences of a substring with a thread pool.
+   //!
+   //! The text is split into chunks that are counted in parallel, a chunk 
+   //! reads key length - 1 characters of the next one to see the matches 
+   //! that cross the boundary. Such a match moves the start of the next 
+   //! chunk, so a chunk also counts from the starts a match can leave until 
+   //! their matches meet its own. The result equals CountSubstr.
+   //! \param pool The pool that runs the chunks.
+   //! \param text String to analyze.
+   //! \param key Substring to search for, an empty key never matches.
+   //! \param grain Number of characters of a chunk, 0 for a few per thread.
+   //! \return Number of substring occurrences. 
+   template<class CharType>
+   static uint64_t CountSubstr(ThreadPool& pool, StringRef<CharType> text, 
+      StringRef<CharType> key, size_t grain = 0)
+   {
+      std::vector<Chunk> chunks;
+      CountChunks(pool, text, key, grain, chunks);
+      return TextChunk::GetCount(chunks);
+   }
+
+   //! \brief Substitutes all substrings in a string with a thread pool.
+   //!
+   //! The matches are counted in chunks like by CountSubstr with a pool, 
+   //! then every chunk writes its part of the result in parallel.
+   //! \param pool The pool that runs the chunks.
    //! \param text String to transform.
-   //! \param key Substring to search for.
+   //! \param key Substring to search for, an empty key never matches.
    //! \param value Substitution string.
+   //! \param grain Number of characters of a chunk, 0 for a few per thread.
    //! \return New string with the substitutions.
    template<class CharType>
-   static std::basic_string<CharType> ReplaceSubstr(
-      const std::basic_string<CharType>& text,
-      const std::basic_string<CharType>& key,
-      const std::basic_string<CharType>& value)
+   static std::basic_string<CharType> ReplaceSubstr(ThreadPool& pool, 
+      StringRef<CharType> text, StringRef<CharType> key, 
+      StringRef<CharType> value, size_t grain = 0)
    {
-      std::basic_string<CharType> result(text);
-      size_t pos = result.find(key);
-      while(pos != std::string::npos)
+      std::vector<Chunk> chunks;
+      CountChunks(pool, text, key, grain, chunks);
+
+      // A chunk owns the text up to the start of the next chunk
+      std::vector<size_t> offsets(chunks.size() + 1, 0);
+      for(size_t i = 0; i < chunks.size(); i++)
       {
-         result.replace(pos, key.length(), value);
-         pos = result.find(key, pos + value.length());
+         size_t count = chunks[i].count;
+         size_t next = TextChunk::GetStart(chunks, i + 1, text.getSize());
+         offsets[i + 1] = offsets[i] + next - chunks[i].start + 
+            count * value.getSize() - count * key.getSize();
       }
+      std::basic_string<CharType> result(offsets.back(), CharType());
+      pool.parallelFor(0, chunks.size(), 1, [&] (size_t i)
+         {
+            CharType* output = &result[0] + offsets[i];
+            size_t start = chunks[i].start;
+            size_t next = TextChunk::GetStart(chunks, i + 1, text.getSize());
+            Replace(text.slice(start, next - start), key, value, 
+               [&output] (const CharType* data, size_t count)
+               {
+                  std::char_traits<CharType>::copy(output, data, count);
+                  output += count;
+               }
+            );
+         }
+      );
       return result;
    }
+
+   //! \brief Deduces the character type of CountSubstr from the text.
+   template<class TextType, class... ArgTypes>
+   static auto CountSubstr(const TextType& text, ArgTypes&&... args) -> 
+      decltype(CountSubstr<typename CharOf<TextType>::Type>(text, 
+      std::forward<ArgTypes>(args)...))
+   {
+      return CountSubstr<typename CharOf<TextType>::Type>(text, 
+         std::forward<ArgTypes>(args)...);
+   }
+
+   //! \brief Deduces the character type of ReplaceSubstr from the text.
+   template<class TextType, class... ArgTypes>
+   static auto ReplaceSubstr(const TextType& text, ArgTypes&&... args) -> 
+      decltype(ReplaceSubstr<typename CharOf<TextType>::Type>(text, 
+      std::forward<ArgTypes>(args)...))
+   {
+      return ReplaceSubstr<typename CharOf<TextType>::Type>(text, 
+         std::forward<ArgTypes>(args)...);
+   }
+
+   //! \brief Deduces the character type of CountSubstr from the text.
+   template<class TextType, class... ArgTypes>
+   static auto CountSubstr(ThreadPool& pool, const TextType& text, 
+      ArgTypes&&... args) -> decltype(CountSubstr<
+      typename CharOf<TextType>::Type>(pool, text, 
+      std::forward<ArgTypes>(args)...))
+   {
+      return CountSubstr<typename CharOf<TextType>::Type>(pool, text, 
+         std::forward<ArgTypes>(args)...);
+   }
+
+   //! \brief Deduces the character type of ReplaceSubstr from the text.
+   template<class TextType, class... ArgTypes>
+   static auto ReplaceSubstr(ThreadPool& pool, const TextType& text, 
+      ArgTypes&&... args) -> decltype(ReplaceSubstr<
+      typename CharOf<TextType>::Type>(pool, text, 
+      std::forward<ArgTypes>(args)...))
+   {
+      return ReplaceSubstr<typename CharOf<TextType>::Type>(pool, text, 
+         std::forward<ArgTypes>(args)...);
+   }
+
+   //! \brief Deduces the character type of Split from the text.
+   template<class TextType, class SeparatorType>
+   static Tokenizer<typename CharOf<TextType>::Type> Split(
+      const TextType& text, const SeparatorType& separator)
+   {
+      return Split<typename CharOf<TextType>::Type>(text, separator);
+   }
+
+   //! \brief Deduces the character type of Tokenize from the text.
+   template<class TextType, class DelimiterType>
+   static Tokenizer<typename CharOf<TextType>::Type> Tokenize(
+      const TextType& text, const DelimiterType& delimiters)
+   {
+      return Tokenize<typename CharOf<TextType>::Type>(text, delimiters);
+   }
+
+private:
+   //! \brief Size of a string after the substitution of a substring.
+   template<class CharType>
+   static size_t GetReplaceSize(StringRef<CharType> text, 
+      StringRef<CharType> key, StringRef<CharType> value)
+   {
+      size_t count = CountSubstr(text, key);
+      return text.getSize() + count * value.getSize() - 
+         count * key.getSize();
+   }
+
+   //! \brief Passes the pieces of a substituted string to a function.
+   //! \param text String to transform.
+   //! \param key Substring to search for.
+   //! \param value Substitution string.
+   //! \param append The function that takes characters and their number.
+   template<class CharType, class FuncType>
+   static void Replace(StringRef<CharType> text, StringRef<CharType> key,
+      StringRef<CharType> value, FuncType append)
+   {
+      const size_t npos = StringRef<CharType>::NPOS;
+      size_t position = 0;
+      size_t found = key.isEmpty() ? npos : text.find(key);
+      while(found != npos)
+      {
+         append(text.getData() + position, found - position);
+         append(value.getData(), value.getSize());
+         position = found + key.getSize();
+         found = text.find(key, position);
+      }
+      append(text.getData() + position, text.getSize() - position);
+   }
+
+   //! \brief Part of a text that is counted by one task.
+   struct Chunk : public TextChunk
+   {
+      //! \brief The counts from the later starts first + 1, first + 2, ...
+      std::vector<size_t> counts;
+
+      //! \brief The ends of the matches from the later starts.
+      std::vector<size_t> ends;
+   };
+
+   //! \brief Matches of a chunk from one start.
+   struct Chain
+   {
+      //! \brief The position the search continues from.
+      size_t position;
+
+      //! \brief The number of matches.
+      size_t count;
+
+      //! \brief The position behind the last match, the start if none.
+      size_t end;
+
+      //! \brief The matches from the first position when both met.
+      size_t base;
+
+      //! \brief Specifies if the chain met the matches from the first 
+      //! position.
+      bool isMet;
+   };
+
+   //! \brief Maximal number of later starts a chunk counts in parallel, 
+   //! longer keys count the start they need afterwards.
+   static const size_t SHIFT_MAX = 8;
+
+   //! \brief Number of characters a start counted afterwards is compared 
+   //! with the first position, then it is counted alone.
+   static const size_t MEET_MAX = 1 << 14;
+
+   //! \brief Counts the matches of every chunk in parallel.
+   //!
+   //! A match across a boundary ends at most key length - 1 characters 
+   //! behind it, so every chunk also counts from these later starts if the 
+   //! pool has a thread for each. The correction of a moved start is then a 
+   //! lookup, else the chunk is counted from the moved start afterwards.
+   //! \param pool The pool that runs the chunks.
+   //! \param text String to analyze.
+   //! \param key Substring to search for.
+   //! \param grain The requested number of characters, 0 for automatic.
+   //! \param chunks The chunks with the matches of a sequential count.
+   template<class CharType>
+   static void CountChunks(ThreadPool& pool, StringRef<CharType> text, 
+      StringRef<CharType> key, size_t grain, std::vector<Chunk>& chunks)
+   {
+      size_t size = text.getSize();
+      size_t length = key.getSize();
+      size_t chunkSize = TextChunk::GetSize(pool, size, length, grain);
+      size_t numShifts = (length > 1) ? length - 1 : 0;
+      if(numShifts > SHIFT_MAX || numShifts >= pool.getNumThreads())
+      {
+         // In a periodic text every start is counted to the end
+         numShifts = 0;
+      }
+      chunks.resize((size + chunkSize - 1) / chunkSize);
+      pool.parallelFor(0, chunks.size(), 1, [&] (size_t i)
+         {
+            Chunk& chunk = chunks[i];
+            chunk.place(i, chunkSize, size);
+            CountChunk(text, key, 1, (i > 0) ? numShifts : 0, false, chunk);
+         }
+      );
+
+      // Matches across a boundary move the start of the next chunk
+      for(size_t i = 1; i < chunks.size(); i++)
+      {
+         Chunk& chunk = chunks[i];
+         size_t start = chunks[i - 1].end;
+         if(start > chunk.first)
+         {
+            size_t shift = start - chunk.first;
+            if(shift > chunk.counts.size())
+            {
+               CountChunk(text, key, shift, 1, true, chunk);
+               shift = 1;
+            }
+            chunk.start = start;
+            chunk.count = chunk.counts[shift - 1];
+            chunk.end = chunk.ends[shift - 1];
+         }
+      }
+   }
+
+   //! \brief Counts the matches of a chunk from its first position and 
+   //! from later starts.
+   //!
+   //! The matches from all starts are counted side by side in growing 
+   //! windows with the vectorized Count. A later start that continues from 
+   //! the same position as the first one after a window has the same 
+   //! matches from there, its count is corrected and it stops. In periodic 
+   //! texts the starts may never meet and are counted to the end.
+   //! \param text String to analyze.
+   //! \param key Substring to search for.
+   //! \param shift The distance of the first later start to the first 
+   //! position.
+   //! \param numShifts The number of later starts, one character apart.
+   //! \param isCounted Specifies if count and end of the chunk are set 
+   //! already, then the later starts are compared with the first position 
+   //! for MEET_MAX characters.
+   //! \param chunk The chunk with the counts and ends of the later starts.
+   template<class CharType>
+   static void CountChunk(StringRef<CharType> text, StringRef<CharType> key,
+      size_t shift, size_t numShifts, bool isCounted, Chunk& chunk)
+   {
+      size_t length = key.getSize();
+      size_t limit = TextChunk::GetLimit(chunk, length, text.getSize());
+      Chain first = {chunk.first, 0, chunk.first, 0, false};
+      std::vector<Chain> chains(numShifts, first);
+      for(size_t k = 0; k < numShifts; k++)
+      {
+         size_t start = chunk.first + shift + k;
+         chains[k].position = (start < limit) ? start : limit;
+         chains[k].end = chains[k].position;
+      }
+      size_t numOpen = numShifts;
+      size_t stop = chunk.first;
+      size_t window = 16 * length;
+      while(numOpen > 0 && stop < limit && 
+         !(isCounted && stop - chunk.first >= MEET_MAX))
+      {
+         stop = (limit - stop > window) ? stop + window : limit;
+         Advance(text.getData(), key, stop, first);
+         for(size_t k = 0; k < numShifts; k++)
+         {
+            Chain& chain = chains[k];
+            if(!chain.isMet)
+            {
+               Advance(text.getData(), key, stop, chain);
+               if(chain.position == first.position)
+               {
+                  chain.base = first.count;
+                  chain.isMet = true;
+                  numOpen--;
+               }
+            }
+         }
+         window *= 4;
+      }
+      for(size_t k = 0; k < numShifts; k++)
+      {
+         if(!chains[k].isMet)
+         {
+            Advance(text.getData(), key, limit, chains[k]);
+         }
+      }
+      if(!isCounted)
+      {
+         Advance(text.getData(), key, limit, first);
+         chunk.count = first.count;
+         chunk.end = first.end;
+      }
+      chunk.counts.resize(numShifts);
+      chunk.ends.resize(numShifts);
+      for(size_t k = 0; k < numShifts; k++)
+      {
+         const Chain& chain = chains[k];
+         chunk.counts[k] = chain.count;
+         chunk.ends[k] = chain.end;
+         if(chain.isMet)
+         {
+            // The matches behind the meeting are the ones of the chunk
+            chunk.counts[k] += chunk.count - chain.base;
+            chunk.ends[k] = (chunk.count > chain.base) ? chunk.end : 
+               chain.end;
+         }
+      }
+   }
+
+   //! \brief Counts the matches of a chain up to a position.
+   //! \param text The first character of the text.
+   //! \param key Substring to search for.
+   //! \param stop The position behind the characters to read.
+   //! \param chain The chain that continues from its position.
+   template<class CharType>
+   static void Advance(const CharType* text, StringRef<CharType> key, 
+      size_t stop, Chain& chain)
+   {
+      size_t length = key.getSize();
+      if(length == 0 || stop - chain.position < length)
+      {
+         return;
+      }
+      size_t end = 0;
+      size_t count = Count(text + chain.position, stop - chain.position, 
+         key.getData(), length, end);
+      if(count > 0)
+      {
+         chain.count += count;
+         chain.end = chain.position + end;
+      }
+
+      // A match that starts before the last key length - 1 characters is 
+      // counted already
+      size_t next = stop + 1 - length;
+      chain.position = (chain.end > next) ? chain.end : next;
+   }
+
+   //! \brief Minimal key length for the Horspool search.
+   static const size_t HORSPOOL_MIN = 32;
+
+   //! \brief Counts the occurrences of a key by the first character.
+   //! \param text The first character to analyze.
+   //! \param size The number of characters.
+   //! \param key The first character of the key.
+   //! \param length The number of characters of the key.
+   //! \param end The position behind the last occurrence, 0 if none.
+   //! \return Number of occurrences.
+   template<class CharType>
+   static uint64_t Count(const CharType* text, size_t size, 
+      const CharType* key, size_t length, size_t& end)
+   {
+      typedef std::char_traits<CharType> Traits;
+      uint64_t count = 0;
+      end = 0;
+      if(length == 0 || length > size)
+      {
+         return count;
+      }
+      size_t position = 0;
+      size_t last = size - length;
+      while(position <= last)
+      {
+         const CharType* found = Traits::find(text + position, 
+            last - position + 1, key[0]);
+         if(found == nullptr)
+         {
+            break;
+         }
+         position = found - text;
+         if(Traits::compare(found, key, length) == 0)
+         {
+            count++;
+            position += length;
+            end = position;
+         }
+         else
+         {
+            position++;
+         }
+      }
+      return count;
+   }
+
+   //! \brief Counts the occurrences of a key with the fastest search.
+   static uint64_t Count(const char* text, size_t size, const char* key, 
+      size_t length, size_t& end)
+   {
+      end = 0;
+      if(length == 0 || length > size)
+      {
+         return 0;
+      }
+      #if defined(AIRE_HAS_AVX2)
+      static const bool isAvx2 = __builtin_cpu_supports("avx2");
+      if(isAvx2)
+      {
+         return CountAvx2(text, size, key, length, end);
+      }
+      #endif
+      #if defined(AIRE_HAS_SSE2)
+      return CountSse2(text, size, key, length, end);
+      #else
+      if(length >= HORSPOOL_MIN)
+      {
+         return CountHorspool(text, size, key, length, end);
+      }
+      return Count<char>(text, size, key, length, end);
+      #endif
+   }
+
+   //! \brief Counts the occurrences of a long key by Boyer-Moore-Horspool.
+   static uint64_t CountHorspool(const char* text, size_t size, 
+      const char* key, size_t length, size_t& end)
+   {
+      // Shift by the distance of the last character to its end in the key
+      size_t shifts[256];
+      std::fill(shifts, shifts + 256, length);
+      for(size_t i = 0; i + 1 < length; i++)
+      {
+         shifts[static_cast<unsigned char>(key[i])] = length - 1 - i;
+      }
+      unsigned char lastChar = static_cast<unsigned char>(key[length - 1]);
+      uint64_t count = 0;
+      size_t position = 0;
+      while(position + length <= size)
+      {
+         unsigned char c = 
+            static_cast<unsigned char>(text[position + length - 1]);
+         if(c == lastChar && std::memcmp(text + position, key, length) == 0)
+         {
+            count++;
+            position += length;
+            end = position;
+         }
+         else
+         {
+            position += shifts[c];
+         }
+      }
+      return count;
+   }
+
+   //! \brief Index of the lowest set bit.
+   static uint32_t Ctz(uint32_t mask)
+   {
+      #if defined(__GNUC__)
+      return __builtin_ctz(mask);
+      #elif defined(_MSC_VER)
+      unsigned long index = 0;
+      _BitScanForward(&index, mask);
+      return index;
+      #else
+      uint32_t index = 0;
+      while((mask & 1) == 0)
+      {
+         mask >>= 1;
+         index++;
+      }
+      return index;
+      #endif
+   }
+
+   //! \brief Counts the verified candidates of a bit mask.
+   //!
+   //! A block has at most 32 candidates, so its count has 32 bit.
+   //! \param text The text.
+   //! \param block The position of the first bit.
+   //! \param mask The candidates with equal first and last character.
+   //! \param key The key.
+   //! \param length The number of characters of the key.
+   //! \param next The first position a match may start at.
+   //! \return Number of occurrences.
+   static uint32_t Verify(const char* text, size_t block, uint32_t mask,
+      const char* key, size_t length, size_t& next)
+   {
+      uint32_t count = 0;
+      while(mask != 0)
+      {
+         size_t position = block + Ctz(mask);
+         mask &= mask - 1;
+         if(position >= next && 
+            std::memcmp(text + position, key, length) == 0)
+         {
+            count++;
+            next = position + length;
+         }
+      }
+      return count;
+   }
+
+   #if defined(AIRE_HAS_SSE2)
+   //! \brief Counts the occurrences of a key with 16 byte vectors.
+   static uint64_t CountSse2(const char* text, size_t size, 
+      const char* key, size_t length, size_t& end)
+   {
+      const __m128i first = _mm_set1_epi8(key[0]);
+      const __m128i last = _mm_set1_epi8(key[length - 1]);
+      uint64_t count = 0;
+      size_t next = 0;
+      size_t i = 0;
+      while(i + length - 1 + 16 <= size)
+      {
+         __m128i blockFirst = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text + i));
+         __m128i blockLast = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(text + i + length - 1));
+         uint32_t mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(first, blockFirst), 
+            _mm_cmpeq_epi8(last, blockLast)));
+         count += Verify(text, i, mask, key, length, next);
+         i = (next > i + 16) ? next : i + 16;
+      }
+      i = (next > i) ? next : i;
+      count += Count<char>(text + i, size - i, key, length, end);
+      end = (end > 0) ? i + end : next;
+      return count;
+   }
+   #endif
+
+   #if defined(AIRE_HAS_AVX2)
+   //! \brief Counts the occurrences of a key with 32 byte vectors.
+   __attribute__((target("avx2")))
+   static uint64_t CountAvx2(const char* text, size_t size, 
+      const char* key, size_t length, size_t& end)
+   {
+      const __m256i first = _mm256_set1_epi8(key[0]);
+      const __m256i last = _mm256_set1_epi8(key[length - 1]);
+      uint64_t count = 0;
+      size_t next = 0;
+      size_t i = 0;
+      while(i + length - 1 + 32 <= size)
+      {
+         __m256i blockFirst = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(text + i));
+         __m256i blockLast = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(text + i + length - 1));
+         uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(first, blockFirst), 
+            _mm256_cmpeq_epi8(last, blockLast)));
+         count += Verify(text, i, mask, key, length, next);
+         i = (next > i + 32) ? next : i + 32;
+      }
+      i = (next > i) ? next : i;
+      count += Count<char>(text + i, size - i, key, length, end);
+      end = (end > 0) ? i + end : next;
+      return count;
+   }
+   #endif
 };
 
 }
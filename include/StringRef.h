@@ -0,0 +1,404 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file StringRef.h
+//! \brief Views of strings and a tokenizer. 
+#ifndef STRINGREF_H
+#define STRINGREF_H
+
+#include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#include <cstddef>
+
+//! \brief Global aire namespace.
+namespace aire 
+{
+
+//! \brief Read-only view of characters.
+//!
+//! A StringRef points to characters it does not own, like the string_view 
+//! of C++17, so slices of a big buffer are passed without a copy. It is 
+//! created implicitly from a string, a zero terminated string and a 
+//! string_view, and converts back to a string_view with C++17. The viewed 
+//! characters must outlive the StringRef.
+template<class CharType>
+class StringRef
+{
+public:
+   //! \brief Traits of the characters.
+   typedef std::char_traits<CharType> Traits;
+
+   //! \brief Position of a failed search.
+   static const size_t NPOS = static_cast<size_t>(-1);
+
+   //! \brief Constructor of an empty view.
+   StringRef() : _data(nullptr), _size(0) 
+   { 
+   }
+
+   //! \brief Constructor of a view of a zero terminated string.
+   StringRef(const CharType* data) : _data(data), 
+      _size((data != nullptr) ? Traits::length(data) : 0) 
+   { 
+   }
+
+   //! \brief Constructor of a view of characters.
+   StringRef(const CharType* data, size_t size) : _data(data), _size(size) 
+   { 
+   }
+
+   //! \brief Constructor of a view of a string.
+   StringRef(const std::basic_string<CharType>& text) : _data(text.data()), 
+      _size(text.size()) 
+   { 
+   }
+
+   #if __cplusplus >= 201703L
+   //! \brief Constructor of a view of a string_view.
+   StringRef(std::basic_string_view<CharType> text) : _data(text.data()), 
+      _size(text.size()) 
+   { 
+   }
+
+   //! \brief Converts the view to a string_view.
+   operator std::basic_string_view<CharType>() const
+   {
+      return std::basic_string_view<CharType>(_data, _size);
+   }
+   #endif
+
+   //! \brief Access to the first character.
+   const CharType* getData() const
+   {
+      return _data;
+   }
+
+   //! \brief Access to the number of characters.
+   size_t getSize() const
+   {
+      return _size;
+   }
+
+   //! \brief Specifies if the view has no characters.
+   bool isEmpty() const
+   {
+      return _size == 0;
+   }
+
+   //! \brief Access to a character.
+   const CharType& operator[](size_t index) const
+   {
+      return _data[index];
+   }
+
+   //! \brief Iterator to the first character.
+   const CharType* begin() const
+   {
+      return _data;
+   }
+
+   //! \brief Iterator behind the last character.
+   const CharType* end() const
+   {
+      return _data + _size;
+   }
+
+   //! \brief Copies the characters to a string.
+   std::basic_string<CharType> toString() const
+   {
+      return std::basic_string<CharType>(_data, _size);
+   }
+
+   //! \brief Access to a part of the view.
+   //! \param position The first character, at most the size.
+   //! \param count The maximal number of characters.
+   //! \return The view of the part.
+   StringRef slice(size_t position, size_t count = NPOS) const
+   {
+      position = (position < _size) ? position : _size;
+      count = (count < _size - position) ? count : _size - position;
+      return StringRef(_data + position, count);
+   }
+
+   //! \brief Searches a substring.
+   //! \param key Substring to search for.
+   //! \param position The first position to look at.
+   //! \return The position of the substring or NPOS.
+   size_t find(StringRef key, size_t position = 0) const
+   {
+      if(key._size > _size)
+      {
+         return NPOS;
+      }
+      size_t last = _size - key._size;
+      if(key._size == 0)
+      {
+         return (position <= _size) ? position : NPOS;
+      }
+      while(position <= last)
+      {
+         const CharType* found = Traits::find(_data + position, 
+            last - position + 1, key._data[0]);
+         if(found == nullptr)
+         {
+            return NPOS;
+         }
+         position = found - _data;
+         if(Traits::compare(found, key._data, key._size) == 0)
+         {
+            return position;
+         }
+         position++;
+      }
+      return NPOS;
+   }
+
+   //! \brief Compares the characters of two views.
+   bool operator==(StringRef other) const
+   {
+      return _size == other._size && 
+         (_size == 0 || Traits::compare(_data, other._data, _size) == 0);
+   }
+
+   //! \brief Compares the characters of two views.
+   bool operator!=(StringRef other) const
+   {
+      return !(*this == other);
+   }
+
+private:
+   //! \brief The first character.
+   const CharType* _data;
+
+   //! \brief The number of characters.
+   size_t _size;
+};
+
+//! \brief Character type of a string type, no Type for other types.
+template<class TextType>
+struct CharOf
+{
+};
+
+//! \brief Character type of a string.
+template<class CharType>
+struct CharOf<std::basic_string<CharType>>
+{
+   typedef CharType Type;
+};
+
+//! \brief Character type of a view.
+template<class CharType>
+struct CharOf<StringRef<CharType>>
+{
+   typedef CharType Type;
+};
+
+//! \brief Character type of a zero terminated string.
+template<class CharType>
+struct CharOf<const CharType*>
+{
+   typedef CharType Type;
+};
+
+//! \brief Character type of a zero terminated string.
+template<class CharType>
+struct CharOf<CharType*>
+{
+   typedef CharType Type;
+};
+
+//! \brief Character type of a literal.
+template<class CharType, size_t SIZE>
+struct CharOf<CharType[SIZE]>
+{
+   typedef CharType Type;
+};
+
+#if __cplusplus >= 201703L
+//! \brief Character type of a string_view.
+template<class CharType>
+struct CharOf<std::basic_string_view<CharType>>
+{
+   typedef CharType Type;
+};
+#endif
+
+//! \brief Lazy split of a text into views of its tokens.
+//!
+//! The tokens are found one at a time while iterating, nothing is copied 
+//! or allocated. Use it as:
+//! for(StringRef<char> token : String::Split(text, ",")) { ... }
+template<class CharType>
+class Tokenizer
+{
+public:
+   //! \brief Input iterator over the tokens.
+   class Iterator
+   {
+   public:
+      //! \brief Constructor of an iterator at the first token.
+      //! \param tokenizer The tokenizer, nullptr for the end.
+      Iterator(const Tokenizer* tokenizer) : _isEnd(tokenizer == nullptr)
+      {
+         if(!_isEnd)
+         {
+            _tokenizer = *tokenizer;
+            _isEnd = !_tokenizer.next(_token);
+         }
+      }
+
+      //! \brief Access to the current token.
+      const StringRef<CharType>& operator*() const
+      {
+         return _token;
+      }
+
+      //! \brief Access to the current token.
+      const StringRef<CharType>* operator->() const
+      {
+         return &_token;
+      }
+
+      //! \brief Moves to the next token.
+      Iterator& operator++()
+      {
+         _isEnd = !_tokenizer.next(_token);
+         return *this;
+      }
+
+      //! \brief Compares two iterators, only the end compares equal.
+      bool operator==(const Iterator& other) const
+      {
+         return _isEnd == other._isEnd && 
+            (_isEnd || _token.getData() == other._token.getData());
+      }
+
+      //! \brief Compares two iterators.
+      bool operator!=(const Iterator& other) const
+      {
+         return !(*this == other);
+      }
+
+   private:
+      //! \brief The remaining text.
+      Tokenizer _tokenizer;
+
+      //! \brief The current token.
+      StringRef<CharType> _token;
+
+      //! \brief Specifies if there are no more tokens.
+      bool _isEnd;
+   };
+
+   //! \brief Constructor of an empty tokenizer.
+   Tokenizer() : _position(0), _isAnyOf(false), _isDone(true)
+   {
+   }
+
+   //! \brief Constructor of the object.
+   //! \param text The text to split.
+   //! \param separator The separator, or the delimiters if isAnyOf.
+   //! \param isAnyOf True to split at any of the delimiters and to skip 
+   //!                empty tokens, false to split at the separator.
+   Tokenizer(StringRef<CharType> text, StringRef<CharType> separator, 
+      bool isAnyOf) : _text(text), _separator(separator), _position(0), 
+      _isAnyOf(isAnyOf), _isDone(false)
+   {
+   }
+
+   //! \brief Moves to the next token.
+   //! \param token The view of the token.
+   //! \return False if there are no more tokens.
+   bool next(StringRef<CharType>& token)
+   {
+      typedef std::char_traits<CharType> Traits;
+      const CharType* data = _text.getData();
+      size_t size = _text.getSize();
+      if(_isAnyOf)
+      {
+         // Skip the delimiters, the token ends at the next delimiter
+         const CharType* delimiters = _separator.getData();
+         size_t numDelimiters = _separator.getSize();
+         while(_position < size && 
+            Traits::find(delimiters, numDelimiters, data[_position]))
+         {
+            _position++;
+         }
+         if(_position >= size)
+         {
+            _isDone = true;
+            return false;
+         }
+         size_t start = _position;
+         while(_position < size && 
+            !Traits::find(delimiters, numDelimiters, data[_position]))
+         {
+            _position++;
+         }
+         token = StringRef<CharType>(data + start, _position - start);
+         return true;
+      }
+      if(_isDone)
+      {
+         return false;
+      }
+      size_t found = _separator.isEmpty() ? StringRef<CharType>::NPOS : 
+         _text.find(_separator, _position);
+      if(found == StringRef<CharType>::NPOS)
+      {
+         // The rest of the text is the last token
+         token = StringRef<CharType>(data + _position, size - _position);
+         _isDone = true;
+         return true;
+      }
+      token = StringRef<CharType>(data + _position, found - _position);
+      _position = found + _separator.getSize();
+      return true;
+   }
+
+   //! \brief Iterator at the first token.
+   Iterator begin() const
+   {
+      return Iterator(this);
+   }
+
+   //! \brief Iterator behind the last token.
+   Iterator end() const
+   {
+      return Iterator(nullptr);
+   }
+
+private:
+   //! \brief The text to split.
+   StringRef<CharType> _text;
+
+   //! \brief The separator or the delimiters.
+   StringRef<CharType> _separator;
+
+   //! \brief Position of the next token.
+   size_t _position;
+
+   //! \brief Specifies if any delimiter splits.
+   bool _isAnyOf;
+
+   //! \brief Specifies if the last token was returned.
+   bool _isDone;
+};
+
+}
+
+#endif
@@ -19,6 +19,8 @@
 
 #if defined(__linux__) 
 #include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
 #elif defined(__APPLE__)
 #include <sys/param.h>
 #include <sys/sysctl.h>
@@ -27,10 +29,68 @@
 #endif
 
 #include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <utility>
 
 //! \brief Global aire namespace.
 namespace aire {
 
+//! \brief CPU topology of the machine and the limits of the process.
+//!
+//! The per-CPU vectors are indexed by the logical CPU id and hold -1 for 
+//! CPUs that are offline or unknown. Sizes are in bytes, 0 if unknown.
+struct Topology
+{
+   //! \brief Number of physical packages.
+   int32_t numSockets;
+
+   //! \brief Number of physical cores over all sockets.
+   int32_t numCores;
+
+   //! \brief Number of online logical CPUs, SMT siblings included.
+   int32_t numThreads;
+
+   //! \brief Number of NUMA nodes with CPUs.
+   int32_t numNodes;
+
+   //! \brief Size of the level 1 data cache of a core.
+   int64_t cacheL1;
+
+   //! \brief Size of the level 2 cache.
+   int64_t cacheL2;
+
+   //! \brief Size of the level 3 cache.
+   int64_t cacheL3;
+
+   //! \brief Size of a cache line.
+   int32_t lineSize;
+
+   //! \brief Number of CPUs the cgroup quota allows, 0 if unlimited.
+   double cpuQuota;
+
+   //! \brief CPUs the process may run on.
+   std::vector<int32_t> cpuset;
+
+   //! \brief Socket of every CPU.
+   std::vector<int32_t> sockets;
+
+   //! \brief Core of every CPU, unique over all sockets.
+   std::vector<int32_t> cores;
+
+   //! \brief NUMA node of every CPU.
+   std::vector<int32_t> nodes;
+
+   //! \brief Model name of the CPU.
+   std::string model;
+};
+
 //! \brief System helper class.
 class System 
 {
@@ -73,6 +133,485 @@ public:
       return 0;
       #endif   
    }
+
+   //! \brief Access to the number of CPUs the process can use.
+   //!
+   //! Unlike GetNumCores this respects the affinity mask, the cpuset and 
+   //! the CPU quota of the cgroup, e.g. the limits of a container.
+   //! \return The number of CPUs, at least 1.
+   static int32_t GetNumAvailable()
+   {
+      const Topology& topology = GetTopology();
+      int32_t count = static_cast<int32_t>(topology.cpuset.size());
+      if(count < 1)
+      {
+         count = GetNumCores();
+      }
+      if(topology.cpuQuota > 0.0)
+      {
+         int32_t quota = static_cast<int32_t>(std::ceil(topology.cpuQuota));
+         count = (quota < count) ? quota : count;
+      }
+      return (count > 0) ? count : 1;
+   }
+
+   //! \brief Access to the CPU topology, read once on the first call.
+   //! \return The topology.
+   static const Topology& GetTopology()
+   {
+      static const Topology topology = ReadTopology();
+      return topology;
+   }
+
+   //! \brief Access to the CPU the calling thread runs on.
+   //! \return The logical CPU id or -1 if unknown.
+   static int32_t GetCurrentCpu()
+   {
+      #if defined(__linux__)
+      return sched_getcpu();
+      #else
+      return -1;
+      #endif
+   }
+
+   //! \brief Pins the calling thread to a CPU.
+   //! \param cpu The logical CPU id.
+   //! \return True if the affinity was set.
+   static bool PinThread(int32_t cpu)
+   {
+      #if defined(__linux__)
+      return SetAffinity(pthread_self(), std::vector<int32_t>(1, cpu));
+      #else
+      return false;
+      #endif
+   }
+
+   //! \brief Pins a thread to a CPU.
+   //! \param thread The thread.
+   //! \param cpu The logical CPU id.
+   //! \return True if the affinity was set.
+   static bool PinThread(std::thread& thread, int32_t cpu)
+   {
+      #if defined(__linux__)
+      return SetAffinity(thread.native_handle(), 
+         std::vector<int32_t>(1, cpu));
+      #else
+      return false;
+      #endif
+   }
+
+   //! \brief Pins the calling thread to all SMT siblings of a core.
+   //! \param core The core id of Topology::cores.
+   //! \return True if the affinity was set.
+   static bool PinToCore(int32_t core)
+   {
+      #if defined(__linux__)
+      const Topology& topology = GetTopology();
+      std::vector<int32_t> cpus;
+      for(size_t i = 0; i < topology.cores.size(); i++)
+      {
+         if(topology.cores[i] == core)
+         {
+            cpus.push_back(static_cast<int32_t>(i));
+         }
+      }
+      return !cpus.empty() && SetAffinity(pthread_self(), cpus);
+      #else
+      return false;
+      #endif
+   }
+
+private:
+   #if defined(__linux__)
+   //! \brief Sets the affinity of a thread.
+   //! \param thread The native handle of the thread.
+   //! \param cpus The logical CPU ids.
+   //! \return True if the affinity was set.
+   static bool SetAffinity(pthread_t thread, const std::vector<int32_t>& cpus)
+   {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for(size_t i = 0; i < cpus.size(); i++)
+      {
+         if(cpus[i] < 0 || cpus[i] >= CPU_SETSIZE)
+         {
+            return false;
+         }
+         CPU_SET(cpus[i], &set);
+      }
+      return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+   }
+   #endif
+
+   //! \brief Reads the first line of a file.
+   //! \param path The path of the file.
+   //! \param line The line that is read.
+   //! \return True if the file could be read.
+   static bool ReadLine(const std::string& path, std::string& line)
+   {
+      std::ifstream file(path.c_str());
+      line.clear();
+      return std::getline(file, line).good() || !line.empty();
+   }
+
+   //! \brief Reads an integer file, e.g. of sysfs.
+   //! \param path The path of the file.
+   //! \param value The default that is kept if the file can not be read.
+   //! \return The value.
+   static int64_t ReadValue(const std::string& path, int64_t value)
+   {
+      std::string line;
+      if(ReadLine(path, line) && !line.empty())
+      {
+         value = std::strtoll(line.c_str(), nullptr, 10);
+      }
+      return value;
+   }
+
+   //! \brief Parses a CPU list like "0-3,8,10-11".
+   //! \param list The list.
+   //! \return The CPU ids.
+   static std::vector<int32_t> ParseList(const std::string& list)
+   {
+      std::vector<int32_t> cpus;
+      std::istringstream stream(list);
+      std::string range;
+      while(std::getline(stream, range, ','))
+      {
+         size_t dash = range.find('-');
+         int32_t first = std::atoi(range.c_str());
+         int32_t last = (dash == std::string::npos) ? first : 
+            std::atoi(range.c_str() + dash + 1);
+         for(int32_t cpu = first; cpu <= last && !range.empty(); cpu++)
+         {
+            cpus.push_back(cpu);
+         }
+      }
+      return cpus;
+   }
+
+   //! \brief Parses a size like "32K" or "8192 KB".
+   //! \param size The size.
+   //! \return The size in bytes.
+   static int64_t ParseSize(const std::string& size)
+   {
+      char* end = nullptr;
+      int64_t value = std::strtoll(size.c_str(), &end, 10);
+      while(end != nullptr && *end == ' ')
+      {
+         end++;
+      }
+      if(end != nullptr && (*end == 'K' || *end == 'k'))
+      {
+         value <<= 10;
+      }
+      else if(end != nullptr && *end == 'M')
+      {
+         value <<= 20;
+      }
+      return value;
+   }
+
+   //! \brief Reads the topology from the operating system.
+   //! \return The topology.
+   static Topology ReadTopology()
+   {
+      Topology topology = Topology();
+      topology.numThreads = GetNumCores();
+      #if defined(__linux__)
+      ReadSysfs(topology);
+      ReadCpuinfo(topology);
+      ReadCgroup(topology);
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if(sched_getaffinity(0, sizeof(set), &set) == 0)
+      {
+         for(int32_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+         {
+            if(CPU_ISSET(cpu, &set))
+            {
+               topology.cpuset.push_back(cpu);
+            }
+         }
+      }
+      if(topology.lineSize == 0)
+      {
+         topology.lineSize = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+      }
+      #elif defined(__APPLE__)
+      int64_t value = 0;
+      size_t length = sizeof(value);
+      if(sysctlbyname("hw.packages", &value, &length, NULL, 0) == 0)
+      {
+         topology.numSockets = static_cast<int32_t>(value);
+      }
+      length = sizeof(value);
+      if(sysctlbyname("hw.physicalcpu", &value, &length, NULL, 0) == 0)
+      {
+         topology.numCores = static_cast<int32_t>(value);
+      }
+      length = sizeof(value);
+      sysctlbyname("hw.l1dcachesize", &topology.cacheL1, &length, NULL, 0);
+      length = sizeof(value);
+      sysctlbyname("hw.l2cachesize", &topology.cacheL2, &length, NULL, 0);
+      length = sizeof(value);
+      sysctlbyname("hw.l3cachesize", &topology.cacheL3, &length, NULL, 0);
+      length = sizeof(value);
+      if(sysctlbyname("hw.cachelinesize", &value, &length, NULL, 0) == 0)
+      {
+         topology.lineSize = static_cast<int32_t>(value);
+      }
+      #endif
+
+      // Assume one socket without SMT for what is still unknown
+      if(topology.numThreads < 1)
+      {
+         topology.numThreads = 1;
+      }
+      if(topology.numSockets < 1)
+      {
+         topology.numSockets = 1;
+      }
+      if(topology.numCores < 1)
+      {
+         topology.numCores = topology.numThreads;
+      }
+      if(topology.numNodes < 1)
+      {
+         topology.numNodes = 1;
+      }
+      return topology;
+   }
+
+   #if defined(__linux__)
+   //! \brief Reads sockets, cores, nodes and caches from sysfs.
+   //! \param topology The topology that is filled.
+   static void ReadSysfs(Topology& topology)
+   {
+      const std::string root = "/sys/devices/system/cpu/";
+      std::string line;
+      if(!ReadLine(root + "online", line))
+      {
+         return;
+      }
+      std::vector<int32_t> online = ParseList(line);
+      if(online.empty())
+      {
+         return;
+      }
+      size_t numIds = static_cast<size_t>(online.back()) + 1;
+      topology.sockets.assign(numIds, -1);
+      topology.cores.assign(numIds, -1);
+      topology.nodes.assign(numIds, -1);
+      topology.numThreads = static_cast<int32_t>(online.size());
+
+      // Number the distinct (socket, core) pairs
+      std::set<int32_t> sockets;
+      std::vector<std::pair<int32_t, int32_t>> cores;
+      for(size_t i = 0; i < online.size(); i++)
+      {
+         std::ostringstream path;
+         path << root << "cpu" << online[i] << "/topology/";
+         int32_t socket = static_cast<int32_t>(
+            ReadValue(path.str() + "physical_package_id", 0));
+         int32_t core = static_cast<int32_t>(
+            ReadValue(path.str() + "core_id", online[i]));
+         std::pair<int32_t, int32_t> key(socket, core);
+         size_t index = 0;
+         while(index < cores.size() && cores[index] != key)
+         {
+            index++;
+         }
+         if(index == cores.size())
+         {
+            cores.push_back(key);
+         }
+         sockets.insert(socket);
+         topology.sockets[online[i]] = socket;
+         topology.cores[online[i]] = static_cast<int32_t>(index);
+      }
+      topology.numSockets = static_cast<int32_t>(sockets.size());
+      topology.numCores = static_cast<int32_t>(cores.size());
+
+      // NUMA nodes list their CPUs
+      if(ReadLine("/sys/devices/system/node/online", line))
+      {
+         std::vector<int32_t> nodes = ParseList(line);
+         for(size_t i = 0; i < nodes.size(); i++)
+         {
+            std::ostringstream path;
+            path << "/sys/devices/system/node/node" << nodes[i] << "/cpulist";
+            std::string list;
+            std::vector<int32_t> cpus;
+            if(ReadLine(path.str(), list))
+            {
+               cpus = ParseList(list);
+            }
+            for(size_t j = 0; j < cpus.size(); j++)
+            {
+               if(cpus[j] >= 0 && static_cast<size_t>(cpus[j]) < numIds)
+               {
+                  topology.nodes[cpus[j]] = nodes[i];
+               }
+            }
+            topology.numNodes += cpus.empty() ? 0 : 1;
+         }
+      }
+
+      // Caches of the first online CPU
+      for(int32_t index = 0; ; index++)
+      {
+         std::ostringstream path;
+         path << root << "cpu" << online[0] << "/cache/index" << index << "/";
+         std::string type;
+         std::string size;
+         if(!ReadLine(path.str() + "type", type) || 
+            !ReadLine(path.str() + "size", size))
+         {
+            break;
+         }
+         if(type == "Instruction")
+         {
+            continue;
+         }
+         int64_t level = ReadValue(path.str() + "level", 0);
+         int64_t bytes = ParseSize(size);
+         if(level == 1)
+         {
+            topology.cacheL1 = bytes;
+            topology.lineSize = static_cast<int32_t>(
+               ReadValue(path.str() + "coherency_line_size", 0));
+         }
+         else if(level == 2)
+         {
+            topology.cacheL2 = bytes;
+         }
+         else if(level == 3)
+         {
+            topology.cacheL3 = bytes;
+         }
+      }
+   }
+
+   //! \brief Reads the model and fills gaps of sysfs from /proc/cpuinfo.
+   //! \param topology The topology that is filled.
+   static void ReadCpuinfo(Topology& topology)
+   {
+      std::ifstream file("/proc/cpuinfo");
+      std::string line;
+      std::set<int32_t> sockets;
+      std::set<std::pair<int32_t, int32_t>> cores;
+      int32_t socket = 0;
+      int64_t cacheSize = 0;
+      while(std::getline(file, line))
+      {
+         size_t colon = line.find(':');
+         if(colon == std::string::npos || colon == 0)
+         {
+            continue;
+         }
+         std::string key = line.substr(0, line.find_last_not_of(" \t", 
+            colon - 1) + 1);
+         std::string value = (colon + 2 <= line.size()) ? 
+            line.substr(colon + 2) : std::string();
+         if(key == "model name" && topology.model.empty())
+         {
+            topology.model = value;
+         }
+         else if(key == "physical id")
+         {
+            socket = std::atoi(value.c_str());
+            sockets.insert(socket);
+         }
+         else if(key == "core id")
+         {
+            cores.insert(std::make_pair(socket, std::atoi(value.c_str())));
+         }
+         else if(key == "cache size")
+         {
+            cacheSize = ParseSize(value);
+         }
+         else if(key == "cache_alignment" && topology.lineSize == 0)
+         {
+            topology.lineSize = std::atoi(value.c_str());
+         }
+      }
+      if(topology.numSockets == 0 && !sockets.empty())
+      {
+         topology.numSockets = static_cast<int32_t>(sockets.size());
+      }
+      if(topology.numCores == 0 && !cores.empty())
+      {
+         topology.numCores = static_cast<int32_t>(cores.size());
+      }
+      if(topology.cacheL3 == 0 && topology.cacheL2 == 0)
+      {
+         // The cache size of x86 is the last level cache
+         topology.cacheL3 = cacheSize;
+      }
+   }
+
+   //! \brief Reads the CPU quota of the cgroup v2 or v1 of the process.
+   //! \param topology The topology that is filled.
+   static void ReadCgroup(Topology& topology)
+   {
+      std::ifstream file("/proc/self/cgroup");
+      std::string line;
+      while(std::getline(file, line))
+      {
+         // Lines are "id:controllers:path"
+         size_t first = line.find(':');
+         size_t second = line.find(':', first + 1);
+         if(first == std::string::npos || second == std::string::npos)
+         {
+            continue;
+         }
+         std::string controllers = line.substr(first + 1, 
+            second - first - 1);
+         std::string path = line.substr(second + 1);
+         if(path == "/")
+         {
+            path.clear();
+         }
+         double quota = 0.0;
+         if(controllers.empty())
+         {
+            // Version 2, cpu.max holds "max 100000" or "quota period"
+            std::string max;
+            if(ReadLine("/sys/fs/cgroup" + path + "/cpu.max", max) && 
+               max.compare(0, 3, "max") != 0)
+            {
+               double value = std::atof(max.c_str());
+               size_t space = max.find(' ');
+               double period = (space == std::string::npos) ? 0.0 :
+                  std::atof(max.c_str() + space + 1);
+               quota = (period > 0.0) ? value / period : 0.0;
+            }
+         }
+         else if(("," + controllers + ",").find(",cpu,") != 
+            std::string::npos)
+         {
+            // Version 1, a quota of -1 is unlimited
+            std::string dir = "/sys/fs/cgroup/" + controllers + path;
+            int64_t value = ReadValue(dir + "/cpu.cfs_quota_us", -1);
+            int64_t period = ReadValue(dir + "/cpu.cfs_period_us", 0);
+            if(value < 0 && controllers != "cpu")
+            {
+               dir = "/sys/fs/cgroup/cpu" + path;
+               value = ReadValue(dir + "/cpu.cfs_quota_us", -1);
+               period = ReadValue(dir + "/cpu.cfs_period_us", 0);
+            }
+            quota = (value > 0 && period > 0) ? 
+               static_cast<double>(value) / period : 0.0;
+         }
+         if(quota > 0.0 && 
+            (topology.cpuQuota == 0.0 || quota < topology.cpuQuota))
+         {
+            topology.cpuQuota = quota;
+         }
+      }
+   }
+   #endif
 };
 
 }
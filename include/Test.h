@@ -17,15 +17,32 @@
 //!
 //! A test case can have multiple test functions. Just add a test function 
 //! using the add member. Please ensure that all function names are unique.
+//! Benchmarks are added with addBenchmark and run after the test functions.
+//! If the environment variable AIRE_RESULTS is set, run writes the results 
+//! to AIRE_RESULTS.json and the test functions to AIRE_RESULTS.xml (JUnit).
+//! A test that runs inside a test function of another one writes no files.
 #ifndef TEST_H
 #define TEST_H
 #include <iostream>
+#include <iomanip>
 #include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <streambuf>
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+#include <ctime>
+#include <cstdlib>
 #include <cstdint>
 #include <map>
 #include <vector>
 #include <string>
 
+#include "Timer.h"
+#include "System.h"
+
 //! \brief Global aire namespace.
 namespace aire
 {
@@ -34,6 +51,47 @@ namespace aire
 class Test
 {
 public:  
+   //! \brief Statistics of the samples of a benchmark.
+   struct Benchmark
+   {
+      //! \brief Name of the benchmark.
+      std::string name;
+
+      //! \brief Number of calls of the function per sample.
+      uint64_t iterations;
+
+      //! \brief Time per call of every sample in nanoseconds.
+      std::vector<double> samples;
+
+      //! \brief Median time per call in nanoseconds.
+      double median;
+
+      //! \brief Median absolute deviation from the median in nanoseconds.
+      double deviation;
+
+      //! \brief Minimal time per call in nanoseconds.
+      double minimum;
+
+      //! \brief Calls per second of the median.
+      double opsPerSecond;
+   };
+
+   //! \brief Result of a test function.
+   struct Case
+   {
+      //! \brief Name of the test function.
+      std::string name;
+
+      //! \brief Return value of the function, 0 on success.
+      int32_t error;
+
+      //! \brief Time of the function in nanoseconds.
+      double time;
+
+      //! \brief Captured output of a parallel run.
+      std::string output;
+   };
+
    //! \brief Constructor of a test object.
    //! \param name Name of the test case.
    Test(std::string name) 
@@ -46,12 +104,18 @@ public:
    virtual void initialize(std::string name)
    {
       _name = name;
+      _numSamples = 5;
+      _sampleTime = 10;
+      _numThreads = 1;
    }
    
    //! \brief Destroy a test case object and free all used memory.
    virtual void destroy()
    {
       _test.erase(_test.begin(), _test.end());
+      _benchmarks.clear();
+      _results.clear();
+      _cases.clear();
    }
    
    //! \brief Destructor of a test object that calls destroy.
@@ -76,32 +140,261 @@ public:
       }
    }
    
+   //! \brief Adds a benchmark to the test case.
+   //!
+   //! The function is called in a loop without an indirect call per 
+   //! iteration. Pass results to DoNotOptimize, so the compiler does not 
+   //! remove the work.
+   //! \param name Name of the benchmark.
+   //! \param func The function to measure, called once per iteration.
+   template<class FuncType>
+   void addBenchmark(std::string name, FuncType func)
+   {
+      if(_benchmarks.find(name) != _benchmarks.end())
+      {
+         std::cerr << "Benchmark with name: " << name << " exists." 
+            << std::endl;
+         return;
+      }
+      _benchmarks[name] = [func] (uint64_t iterations) mutable
+         {
+            for(uint64_t i = 0; i < iterations; i++)
+            {
+               func();
+            }
+         };
+   }
+
+   //! \brief Sets the measurement of the benchmarks.
+   //! \param numSamples Number of measured samples of a benchmark.
+   //! \param sampleTime Time of a sample and of the warmup in milliseconds.
+   void setBenchmark(size_t numSamples, double sampleTime)
+   {
+      _numSamples = std::max(numSamples, static_cast<size_t>(1));
+      _sampleTime = sampleTime;
+   }
+
+   //! \brief Access to the statistics of the benchmarks after run.
+   //! \return The statistics in the order of the names.
+   const std::vector<Benchmark>& getBenchmarks() const
+   {
+      return _results;
+   }
+
+   //! \brief Keeps the compiler from removing the computation of a value.
+   template<class ValueType>
+   static void DoNotOptimize(const ValueType& value)
+   {
+      #if defined(__GNUC__)
+      asm volatile("" : : "r,m"(value) : "memory");
+      #else
+      const volatile void* volatile sink = &value;
+      (void)sink;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      #endif
+   }
+
+   //! \brief Keeps the compiler from removing the computation of a value.
+   template<class ValueType>
+   static void DoNotOptimize(ValueType& value)
+   {
+      #if defined(__clang__)
+      asm volatile("" : "+r,m"(value) : : "memory");
+      #elif defined(__GNUC__)
+      asm volatile("" : "+m,r"(value) : : "memory");
+      #else
+      const volatile void* volatile sink = &value;
+      (void)sink;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      #endif
+   }
+
+   //! \brief Forces all pending writes to memory before this point.
+   static void ClobberMemory()
+   {
+      #if defined(__GNUC__)
+      asm volatile("" : : : "memory");
+      #else
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      #endif
+   }
+
+   //! \brief Runs the test functions on several threads.
+   //!
+   //! The output of a test function to std::cout, std::clog and std::cerr 
+   //! is captured and printed after all functions finished, in the order 
+   //! of the names. Output of threads that a test function starts and 
+   //! output by printf is not captured. The format state of the streams, 
+   //! e.g. the precision, is shared by all functions. The functions must 
+   //! not depend on each other, functions that start their own threads or 
+   //! measure time are better run sequentially. Benchmarks always run 
+   //! alone after the test functions.
+   //! \param numThreads Number of threads, 0 for the available CPUs, 1 runs 
+   //!                   the functions on the calling thread.
+   void setParallel(size_t numThreads)
+   {
+      _numThreads = (numThreads > 0) ? numThreads : 
+         static_cast<size_t>(System::GetNumAvailable());
+   }
+
+   //! \brief Access to the results of the test functions after run.
+   //! \return The results in the order of the names.
+   const std::vector<Case>& getCases() const
+   {
+      return _cases;
+   }
+
+   //! \brief Access to the name of the test case.
+   const std::string& getName() const
+   {
+      return _name;
+   }
+
+   //! \brief Writes the results of the last run as JSON.
+   //!
+   //! The object has the name, the date, the host from System, the cases 
+   //! with their times and the benchmarks with their samples. Times are 
+   //! in nanoseconds.
+   //! \param stream The output stream.
+   void writeJson(std::ostream& stream) const
+   {
+      const Topology& topology = System::GetTopology();
+      std::ios::fmtflags flags = stream.flags();
+      std::streamsize precision = stream.precision(10);
+      char date[32] = "";
+      std::time_t now = std::time(nullptr);
+      std::tm* utc = std::gmtime(&now);
+      if(utc != nullptr)
+      {
+         std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", utc);
+      }
+      stream << "{\n\"name\": " << Json(_name) << ",\n\"date\": \"" << date 
+         << "\",\n\"host\": {\"model\": " << Json(topology.model) 
+         << ", \"sockets\": " << topology.numSockets 
+         << ", \"cores\": " << topology.numCores 
+         << ", \"threads\": " << topology.numThreads 
+         << ", \"nodes\": " << topology.numNodes 
+         << ", \"available\": " << System::GetNumAvailable() 
+         << ", \"cacheL1\": " << topology.cacheL1 
+         << ", \"cacheL2\": " << topology.cacheL2 
+         << ", \"cacheL3\": " << topology.cacheL3 
+         << ", \"lineSize\": " << topology.lineSize << "},\n\"cases\": [";
+      for(size_t i = 0; i < _cases.size(); i++)
+      {
+         stream << ((i > 0) ? ",\n" : "\n") << "{\"name\": " 
+            << Json(_cases[i].name) << ", \"error\": " << _cases[i].error 
+            << ", \"time\": " << _cases[i].time << "}";
+      }
+      stream << "],\n\"benchmarks\": [";
+      for(size_t i = 0; i < _results.size(); i++)
+      {
+         const Benchmark& result = _results[i];
+         stream << ((i > 0) ? ",\n" : "\n") << "{\"name\": " 
+            << Json(result.name) << ", \"iterations\": " << result.iterations
+            << ", \"median\": " << result.median << ", \"deviation\": " 
+            << result.deviation << ", \"minimum\": " << result.minimum 
+            << ", \"opsPerSecond\": " << result.opsPerSecond 
+            << ", \"samples\": [";
+         for(size_t k = 0; k < result.samples.size(); k++)
+         {
+            stream << ((k > 0) ? ", " : "") << result.samples[k];
+         }
+         stream << "]}";
+      }
+      stream << "]\n}\n";
+      stream.precision(precision);
+      stream.flags(flags);
+   }
+
+   //! \brief Writes the test functions of the last run as JUnit XML.
+   //!
+   //! Every function is a testcase with its time in seconds, failed 
+   //! functions have a failure and captured output is system-out.
+   //! \param stream The output stream.
+   void writeJunit(std::ostream& stream) const
+   {
+      std::ios::fmtflags flags = stream.flags();
+      std::streamsize precision = stream.precision(6);
+      double time = 0;
+      size_t numFailed = 0;
+      for(size_t i = 0; i < _cases.size(); i++)
+      {
+         time += _cases[i].time;
+         numFailed += (_cases[i].error != 0) ? 1 : 0;
+      }
+      stream << std::fixed 
+         << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+         << "<testsuite name=\"" << Xml(_name) << "\" tests=\"" 
+         << _cases.size() << "\" failures=\"" << numFailed << "\" time=\"" 
+         << time / 1e9 << "\">\n";
+      for(size_t i = 0; i < _cases.size(); i++)
+      {
+         const Case& result = _cases[i];
+         stream << "  <testcase name=\"" << Xml(result.name) 
+            << "\" classname=\"" << Xml(_name) << "\" time=\"" 
+            << result.time / 1e9 << "\">\n";
+         if(result.error != 0)
+         {
+            stream << "    <failure message=\"returned " << result.error 
+               << "\"/>\n";
+         }
+         if(!result.output.empty())
+         {
+            stream << "    <system-out>" << Xml(result.output) 
+               << "</system-out>\n";
+         }
+         stream << "  </testcase>\n";
+      }
+      stream << "</testsuite>\n";
+      stream.precision(precision);
+      stream.flags(flags);
+   }
+
    //! \brief Runs all test functions in the test case.
    //! \param haltOnError Indicates if the test aborts if an error occurs.
    virtual void run(bool haltOnError = false)
    {
-      int32_t error = 0;
-      
       std::clog << "---------------------------------------------" << std::endl;
       std::clog << "Running " << _name << std::endl;
       std::clog << "---------------------------------------------" << std::endl;
       uint32_t k = 0;
       uint32_t i = 0;
       std::vector<std::string> failed;
+      bool isOuter = (GetNumRunning()++ == 0);
+
+      _cases.clear();
+      for(auto it = _test.begin(); it != _test.end(); it++)
+      {
+         Case result = {it->first, 0, 0, std::string()};
+         _cases.push_back(result);
+      }
+      if(_numThreads > 1)
+      {
+         runParallel(haltOnError);
+      }
       
       for(auto it = _test.begin(); it != _test.end(); it++)
       {
+         Case& result = _cases[k];
          k++;
          std::clog << "Case " << k << ": " << it->first << std::endl;
          std::cout << "Case " << k << ": " << it->first << std::endl;
-         error = it->second();   
-         if(haltOnError && error != 0)
+         if(_numThreads > 1)
+         {
+            std::cout << result.output;
+         }
+         else
+         {
+            result.error = runCase(it->second, result.time);
+         }
+         printTime(std::cout, result.time);
+         if(haltOnError && result.error != 0)
          {
             failed.push_back(it->first);
             std::clog << "Error: " << it->first << std::endl;
             exit(EXIT_FAILURE);  
          }
-         else if(error != 0)
+         else if(result.error != 0)
          {
             failed.push_back(it->first);
             i++;
@@ -116,6 +409,22 @@ public:
          std::clog << "Fail: " << *it << std::endl;
          std::cout << "Fail: " << *it << std::endl;
       }
+
+      _results.clear();
+      k = 0;
+      for(auto it = _benchmarks.begin(); it != _benchmarks.end(); it++)
+      {
+         k++;
+         std::clog << "Benchmark " << k << ": " << it->first << std::endl;
+         std::cout << "Benchmark " << k << ": " << it->first << std::endl;
+         _results.push_back(measure(it->first, it->second));
+         print(std::cout, _results.back());
+      }
+      GetNumRunning()--;
+      if(isOuter)
+      {
+         writeResults();
+      }
    }
 private:
    //! \brief Name of the test.
@@ -123,6 +432,339 @@ private:
    
    //! \brief Tast cases mapped by a descriptive test name.
    std::map<std::string, std::function<int32_t ()>> _test;
+
+   //! \brief Benchmarks that call a function a number of times by name.
+   std::map<std::string, std::function<void (uint64_t)>> _benchmarks;
+
+   //! \brief Statistics of the last run of the benchmarks.
+   std::vector<Benchmark> _results;
+
+   //! \brief Number of samples of a benchmark.
+   size_t _numSamples;
+
+   //! \brief Time of a sample in milliseconds.
+   double _sampleTime;
+
+   //! \brief Results of the last run of the test functions.
+   std::vector<Case> _cases;
+
+   //! \brief Number of threads that run the test functions.
+   size_t _numThreads;
+
+   //! \brief Stream buffer that captures the output of a thread.
+   //!
+   //! The buffer replaces the buffer of a stream. Threads that run a test 
+   //! function append to the output of the function, other threads write 
+   //! to the replaced buffer under a lock.
+   class Capture : public std::streambuf
+   {
+   public:
+      //! \brief Constructor that replaces the buffer of a stream.
+      //! \param stream The stream.
+      //! \param mutex Lock of the writes to the replaced buffers.
+      Capture(std::ostream& stream, std::mutex& mutex) : _stream(stream), 
+         _mutex(mutex)
+      {
+         _buffer = _stream.rdbuf(this);
+      }
+
+      //! \brief Destructor that restores the buffer of the stream.
+      virtual ~Capture()
+      {
+         _stream.rdbuf(_buffer);
+      }
+
+      //! \brief Access to the output of the calling thread.
+      //! \return The output or nullptr if the thread is not captured.
+      static std::string*& GetOutput()
+      {
+         static thread_local std::string* output = nullptr;
+         return output;
+      }
+
+   protected:
+      //! \brief Writes a character.
+      virtual int_type overflow(int_type c)
+      {
+         if(!traits_type::eq_int_type(c, traits_type::eof()))
+         {
+            char data = traits_type::to_char_type(c);
+            xsputn(&data, 1);
+         }
+         return traits_type::not_eof(c);
+      }
+
+      //! \brief Writes characters.
+      virtual std::streamsize xsputn(const char* data, std::streamsize size)
+      {
+         std::string* output = GetOutput();
+         if(output != nullptr)
+         {
+            output->append(data, static_cast<size_t>(size));
+            return size;
+         }
+         std::lock_guard<std::mutex> lock(_mutex);
+         return _buffer->sputn(data, size);
+      }
+
+      //! \brief Flushes the replaced buffer.
+      virtual int sync()
+      {
+         if(GetOutput() != nullptr)
+         {
+            return 0;
+         }
+         std::lock_guard<std::mutex> lock(_mutex);
+         return _buffer->pubsync();
+      }
+
+   private:
+      //! \brief The stream.
+      std::ostream& _stream;
+
+      //! \brief The replaced buffer of the stream.
+      std::streambuf* _buffer;
+
+      //! \brief Lock of the writes to the replaced buffers.
+      std::mutex& _mutex;
+   };
+
+   //! \brief Runs a test function and measures its time.
+   //! \param func The test function.
+   //! \param time The time in nanoseconds.
+   //! \return The result of the function.
+   static int32_t runCase(std::function<int32_t ()>& func, double& time)
+   {
+      Timer timer;
+      timer.start();
+      int32_t error = func();
+      timer.stop();
+      time = timer.getTime();
+      return error;
+   }
+
+   //! \brief Runs the test functions on the threads and captures the output.
+   //!
+   //! The threads take the next function by an atomic index. After an 
+   //! error with haltOnError no further function is started, all functions 
+   //! before the failed one have finished then.
+   //! \param haltOnError Indicates if the test stops at an error.
+   void runParallel(bool haltOnError)
+   {
+      std::vector<std::function<int32_t ()>*> funcs;
+      for(auto it = _test.begin(); it != _test.end(); it++)
+      {
+         funcs.push_back(&it->second);
+      }
+      std::atomic<size_t> next(0);
+      std::atomic<bool> isHalted(false);
+      std::mutex mutex;
+      {
+         Capture out(std::cout, mutex);
+         Capture log(std::clog, mutex);
+         Capture err(std::cerr, mutex);
+         std::vector<std::thread> threads;
+         for(size_t t = 0; t < _numThreads && t < funcs.size(); t++)
+         {
+            threads.push_back(std::thread([&] ()
+               {
+                  size_t index = next++;
+                  while(index < funcs.size() && !isHalted)
+                  {
+                     Case& result = _cases[index];
+                     Capture::GetOutput() = &result.output;
+                     result.error = runCase(*funcs[index], result.time);
+                     Capture::GetOutput() = nullptr;
+                     if(haltOnError && result.error != 0)
+                     {
+                        isHalted = true;
+                     }
+                     index = next++;
+                  }
+               }
+            ));
+         }
+         for(size_t t = 0; t < threads.size(); t++)
+         {
+            threads[t].join();
+         }
+      }
+   }
+
+   //! \brief Access to the number of tests that run, nested ones included.
+   static std::atomic<uint32_t>& GetNumRunning()
+   {
+      static std::atomic<uint32_t> numRunning(0);
+      return numRunning;
+   }
+
+   //! \brief Writes the result files if AIRE_RESULTS is set.
+   void writeResults() const
+   {
+      const char* path = std::getenv("AIRE_RESULTS");
+      if(path == nullptr || *path == '\0')
+      {
+         return;
+      }
+      std::ofstream json((std::string(path) + ".json").c_str());
+      writeJson(json);
+      std::ofstream junit((std::string(path) + ".xml").c_str());
+      writeJunit(junit);
+      if(!json || !junit)
+      {
+         std::cerr << "Cannot write the results to: " << path << std::endl;
+      }
+   }
+
+   //! \brief Quotes a string for JSON.
+   static std::string Json(const std::string& text)
+   {
+      std::string result = "\"";
+      for(size_t i = 0; i < text.size(); i++)
+      {
+         unsigned char c = static_cast<unsigned char>(text[i]);
+         if(c == '"' || c == '\\')
+         {
+            result += '\\';
+            result += text[i];
+         }
+         else if(c < 0x20)
+         {
+            const char* hex = "0123456789abcdef";
+            result += "\\u00";
+            result += hex[c >> 4];
+            result += hex[c & 15];
+         }
+         else
+         {
+            result += text[i];
+         }
+      }
+      return result + "\"";
+   }
+
+   //! \brief Escapes a string for XML, control characters are dropped.
+   static std::string Xml(const std::string& text)
+   {
+      std::string result;
+      for(size_t i = 0; i < text.size(); i++)
+      {
+         unsigned char c = static_cast<unsigned char>(text[i]);
+         if(c == '&')
+         {
+            result += "&amp;";
+         }
+         else if(c == '<')
+         {
+            result += "&lt;";
+         }
+         else if(c == '>')
+         {
+            result += "&gt;";
+         }
+         else if(c == '"')
+         {
+            result += "&quot;";
+         }
+         else if(c >= 0x20 || c == '\n' || c == '\t' || c == '\r')
+         {
+            result += text[i];
+         }
+      }
+      return result;
+   }
+
+   //! \brief Prints the time of a test function.
+   static void printTime(std::ostream& stream, double time)
+   {
+      std::ios::fmtflags flags = stream.flags();
+      std::streamsize precision = stream.precision();
+      stream << std::fixed << std::setprecision(3) << "Time: " 
+         << time / 1e6 << " ms" << std::endl;
+      stream.precision(precision);
+      stream.flags(flags);
+   }
+
+   //! \brief Measures the samples of a benchmark.
+   //!
+   //! The warmup doubles the iterations until a batch takes a tenth of the 
+   //! sample time and runs the function for a sample time. The iterations 
+   //! of a sample are scaled from the warmup to take the sample time.
+   //! \param name Name of the benchmark.
+   //! \param batch The function that calls the benchmark a number of times.
+   //! \return The statistics of the samples.
+   Benchmark measure(const std::string& name, 
+      std::function<void (uint64_t)>& batch)
+   {
+      double sampleTime = _sampleTime * 1e6;
+      uint64_t iterations = 1;
+      uint64_t total = 0;
+      double nanos = 0;
+      double warmup = 0;
+      while(warmup < sampleTime || nanos < sampleTime / 10)
+      {
+         Timer timer;
+         timer.start();
+         batch(iterations);
+         timer.stop();
+         nanos = timer.getTime();
+         warmup += nanos;
+         total += iterations;
+         if(nanos < sampleTime / 10)
+         {
+            iterations *= 2;
+         }
+      }
+
+      Benchmark result;
+      result.name = name;
+      double perCall = std::max(warmup / static_cast<double>(total), 1e-3);
+      result.iterations = std::max(static_cast<uint64_t>(sampleTime / 
+         perCall), static_cast<uint64_t>(1));
+      for(size_t i = 0; i < _numSamples; i++)
+      {
+         Timer timer;
+         timer.start();
+         batch(result.iterations);
+         timer.stop();
+         result.samples.push_back(timer.getTime() / 
+            static_cast<double>(result.iterations));
+      }
+
+      std::vector<double> sorted = result.samples;
+      result.median = GetMedian(sorted);
+      result.minimum = sorted.front();
+      for(size_t i = 0; i < sorted.size(); i++)
+      {
+         sorted[i] = std::fabs(sorted[i] - result.median);
+      }
+      result.deviation = GetMedian(sorted);
+      result.opsPerSecond = (result.median > 0) ? 1e9 / result.median : 0;
+      return result;
+   }
+
+   //! \brief Sorts values and returns their median.
+   static double GetMedian(std::vector<double>& values)
+   {
+      std::sort(values.begin(), values.end());
+      size_t middle = values.size() / 2;
+      return (values.size() % 2 == 1) ? values[middle] : 
+         (values[middle - 1] + values[middle]) / 2;
+   }
+
+   //! \brief Prints the statistics of a benchmark.
+   static void print(std::ostream& stream, const Benchmark& result)
+   {
+      std::ios::fmtflags flags = stream.flags();
+      std::streamsize precision = stream.precision();
+      stream << std::fixed << std::setprecision(2) << "   " 
+         << result.median << " ns/op +- " << result.deviation 
+         << " (min " << result.minimum << ") " << std::setprecision(0) 
+         << result.opsPerSecond << " ops/s, " << result.samples.size() 
+         << " x " << result.iterations << " calls" << std::endl;
+      stream.precision(precision);
+      stream.flags(flags);
+   }
    
    //! \brief Private copy constructor. 
    Test(Test const&);
@@ -0,0 +1,121 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file TextChunk.h
+//! \brief Chunks of a text for a parallel search.
+#ifndef TEXTCHUNK_H
+#define TEXTCHUNK_H
+
+#include <vector>
+#include <cstddef>
+
+#include "ThreadPool.h"
+
+//! \brief Global aire namespace.
+namespace aire 
+{
+
+//! \brief Part of a text that is searched by one task.
+//!
+//! A chunk reads the key length - 1 characters of the next one to see the
+//! matches that cross the boundary. Such a match moves the start of the
+//! next chunk, so the search that owns the chunks corrects it afterwards.
+//! String and Matcher derive their chunks from it.
+struct TextChunk
+{
+   //! \brief Minimal number of characters of a chunk.
+   static const size_t MIN_SIZE = 1 << 16;
+
+   //! \brief The first position of the chunk.
+   size_t first;
+
+   //! \brief The position behind the chunk.
+   size_t last;
+
+   //! \brief The position the matches start from, behind the last match
+   //! of the chunk before.
+   size_t start;
+
+   //! \brief The position behind the last match, start if none.
+   size_t end;
+
+   //! \brief The number of matches that start in the chunk.
+   size_t count;
+
+   //! \brief Places the chunk in a text, it has no matches yet.
+   //! \param index The index of the chunk.
+   //! \param chunkSize The number of characters of a chunk.
+   //! \param size The number of characters of the text.
+   void place(size_t index, size_t chunkSize, size_t size)
+   {
+      first = index * chunkSize;
+      last = (size - first > chunkSize) ? first + chunkSize : size;
+      start = first;
+      end = first;
+      count = 0;
+   }
+
+   //! \brief Number of characters of a chunk.
+   //! \param pool The pool that runs the chunks.
+   //! \param size The number of characters of the text.
+   //! \param length The number of characters of the longest key.
+   //! \param grain The requested number of characters, 0 for automatic.
+   static size_t GetSize(ThreadPool& pool, size_t size, size_t length,
+      size_t grain)
+   {
+      if(grain == 0)
+      {
+         // A few chunks per thread balance uneven match densities
+         grain = size / (4 * pool.getNumThreads()) + 1;
+         grain = (grain < MIN_SIZE) ? static_cast<size_t>(MIN_SIZE) : grain;
+      }
+
+      // A match crosses at most one boundary
+      return (grain < length) ? length : grain;
+   }
+
+   //! \brief Position behind the characters a chunk reads.
+   //! \param chunk The chunk.
+   //! \param length The number of characters of the longest key.
+   //! \param size The number of characters of the text.
+   static size_t GetLimit(const TextChunk& chunk, size_t length, size_t size)
+   {
+      size_t overlap = (length > 0) ? length - 1 : 0;
+      return (size - chunk.last > overlap) ? chunk.last + overlap : size;
+   }
+
+   //! \brief Start of a chunk, the size of the text behind the last chunk.
+   template<class ChunkType>
+   static size_t GetStart(const std::vector<ChunkType>& chunks, size_t index,
+      size_t size)
+   {
+      return (index < chunks.size()) ? chunks[index].start : size;
+   }
+
+   //! \brief Sums the matches of chunks.
+   template<class ChunkType>
+   static size_t GetCount(const std::vector<ChunkType>& chunks)
+   {
+      size_t count = 0;
+      for(size_t i = 0; i < chunks.size(); i++)
+      {
+         count += chunks[i].count;
+      }
+      return count;
+   }
+};
+
+}
+
+#endif
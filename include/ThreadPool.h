@@ -0,0 +1,635 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file ThreadPool.h
+//! \brief Work-stealing thread pool. 
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <exception>
+#include <memory>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstddef>
+
+#include "System.h"
+#include "Event.h"
+
+//! \brief Global aire namespace.
+namespace aire
+{
+
+//! \brief Unit of work of the thread pool.
+typedef std::function<void ()> Task;
+
+//! \brief Work-stealing deque of tasks.
+//!
+//! Implements the deque of Chase and Lev with the memory orders of Le et 
+//! al., Correct and Efficient Work-Stealing for Weak Memory Models, 
+//! PPoPP 2013. Only the owner thread calls push and pop at the bottom, any 
+//! thread can steal from the top. The buffer grows when it is full, the 
+//! old buffers are kept until the deque is destroyed because a thief 
+//! might still read from them.
+class WorkDeque
+{
+public:
+   //! \brief Constructor of the object.
+   //! \param capacity The initial capacity, rounded up to a power of two.
+   WorkDeque(size_t capacity = 256)
+   {
+      initialize(capacity);
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~WorkDeque()
+   {
+      destroy();
+   }
+
+   //! \brief Allocates the first buffer.
+   //! \param capacity The initial capacity, rounded up to a power of two.
+   virtual void initialize(size_t capacity = 256)
+   {
+      size_t size = 1;
+      while(size < capacity)
+      {
+         size <<= 1;
+      }
+      _top = 0;
+      _bottom = 0;
+      _buffers.push_back(std::unique_ptr<Buffer>(new Buffer(size)));
+      _buffer = _buffers.back().get();
+   }
+
+   //! \brief Frees all buffers, the tasks are not freed.
+   virtual void destroy()
+   {
+      _buffer = nullptr;
+      _buffers.clear();
+   }
+
+   //! \brief Pushes a task at the bottom, only called by the owner.
+   //! \param task The task.
+   void push(Task* task)
+   {
+      int64_t bottom = _bottom.load(std::memory_order_relaxed);
+      int64_t top = _top.load(std::memory_order_acquire);
+      Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+      if(bottom - top > static_cast<int64_t>(buffer->mask))
+      {
+         buffer = grow(buffer, top, bottom);
+      }
+      buffer->put(bottom, task);
+      std::atomic_thread_fence(std::memory_order_release);
+      _bottom.store(bottom + 1, std::memory_order_relaxed);
+   }
+
+   //! \brief Pops the newest task from the bottom, only called by the owner.
+   //! \return The task or nullptr if the deque is empty.
+   Task* pop()
+   {
+      int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+      Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+      _bottom.store(bottom, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t top = _top.load(std::memory_order_relaxed);
+      Task* task = nullptr;
+      if(top <= bottom)
+      {
+         task = buffer->get(bottom);
+         if(top == bottom)
+         {
+            // Last task, race against the thieves
+            if(!_top.compare_exchange_strong(top, top + 1, 
+               std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+               task = nullptr;
+            }
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+         }
+      }
+      else
+      {
+         _bottom.store(bottom + 1, std::memory_order_relaxed);
+      }
+      return task;
+   }
+
+   //! \brief Steals the oldest task from the top.
+   //! \return The task or nullptr if the deque is empty or the race is lost.
+   Task* steal()
+   {
+      int64_t top = _top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t bottom = _bottom.load(std::memory_order_acquire);
+      Task* task = nullptr;
+      if(top < bottom)
+      {
+         Buffer* buffer = _buffer.load(std::memory_order_acquire);
+         task = buffer->get(top);
+         if(!_top.compare_exchange_strong(top, top + 1, 
+            std::memory_order_seq_cst, std::memory_order_relaxed))
+         {
+            task = nullptr;
+         }
+      }
+      return task;
+   }
+
+   //! \brief Access to the approximate number of tasks.
+   //! \return The number of tasks.
+   size_t getSize() const
+   {
+      int64_t bottom = _bottom.load(std::memory_order_relaxed);
+      int64_t top = _top.load(std::memory_order_relaxed);
+      return (bottom > top) ? static_cast<size_t>(bottom - top) : 0;
+   }
+
+private:
+   //! \brief Circular buffer of tasks.
+   struct Buffer
+   {
+      //! \brief Constructor of the buffer.
+      //! \param size The size, a power of two.
+      Buffer(size_t size) : mask(size - 1), tasks(new std::atomic<Task*>[size])
+      {
+      }
+
+      //! \brief Stores a task.
+      void put(int64_t index, Task* task)
+      {
+         tasks[index & mask].store(task, std::memory_order_relaxed);
+      }
+
+      //! \brief Loads a task.
+      Task* get(int64_t index) const
+      {
+         return tasks[index & mask].load(std::memory_order_relaxed);
+      }
+
+      //! \brief Size of the buffer minus one.
+      size_t mask;
+
+      //! \brief The tasks.
+      std::unique_ptr<std::atomic<Task*>[]> tasks;
+   };
+
+   //! \brief Index of the oldest task.
+   std::atomic<int64_t> _top;
+
+   //! \brief Index after the newest task.
+   std::atomic<int64_t> _bottom;
+
+   //! \brief Current buffer.
+   std::atomic<Buffer*> _buffer;
+
+   //! \brief All buffers ever allocated.
+   std::vector<std::unique_ptr<Buffer>> _buffers;
+
+   //! \brief Replaces the buffer by one of twice the size.
+   //! \param buffer The full buffer.
+   //! \param top The index of the oldest task.
+   //! \param bottom The index after the newest task.
+   //! \return The new buffer.
+   Buffer* grow(Buffer* buffer, int64_t top, int64_t bottom)
+   {
+      _buffers.push_back(std::unique_ptr<Buffer>(
+         new Buffer(2 * (buffer->mask + 1))));
+      Buffer* bigger = _buffers.back().get();
+      for(int64_t i = top; i < bottom; i++)
+      {
+         bigger->put(i, buffer->get(i));
+      }
+      _buffer.store(bigger, std::memory_order_release);
+      return bigger;
+   }
+
+   //! \brief Private copy constructor. 
+   WorkDeque(WorkDeque const&);
+   
+   //! \brief Private assignment operator.
+   WorkDeque& operator=(WorkDeque const&);
+};
+
+//! \brief Work-stealing thread pool.
+//!
+//! Every worker owns a WorkDeque. Tasks spawned by a worker are pushed to 
+//! its own deque, tasks from other threads go to a shared queue. An idle 
+//! worker takes its newest task, then the shared queue, then steals the 
+//! oldest task of another worker. Workers without work park on a futex 
+//! word. A thread that waits for parallelFor runs tasks meanwhile, so the 
+//! helpers can be nested. Futures of submit should not be waited for in a 
+//! task, use getResult there instead.
+class ThreadPool
+{
+public:
+   //! \brief Constructor of the object.
+   //! \param numThreads The number of workers, 0 uses the available CPUs.
+   ThreadPool(size_t numThreads = 0)
+   {
+      initialize(numThreads);
+   }
+
+   //! \brief Destructor of the object that joins the workers.
+   virtual ~ThreadPool()
+   {
+      destroy();
+   }
+
+   //! \brief Starts the workers.
+   //! \param numThreads The number of workers, 0 uses the available CPUs.
+   virtual void initialize(size_t numThreads = 0)
+   {
+      if(numThreads == 0)
+      {
+         numThreads = System::GetNumAvailable();
+      }
+      _isStopping = false;
+      _numIdle = 0;
+      _epoch = 0;
+      _numShared = 0;
+      for(size_t i = 0; i < numThreads; i++)
+      {
+         _deques.push_back(std::unique_ptr<WorkDeque>(new WorkDeque()));
+      }
+      for(size_t i = 0; i < numThreads; i++)
+      {
+         _workers.push_back(std::thread(&ThreadPool::run, this, i));
+      }
+   }
+
+   //! \brief Runs the remaining tasks and joins the workers.
+   virtual void destroy()
+   {
+      _isStopping = true;
+      _epoch++;
+      Futex::Wake(&_epoch, INT_MAX);
+      for(size_t i = 0; i < _workers.size(); i++)
+      {
+         _workers[i].join();
+      }
+      _workers.clear();
+      _deques.clear();
+   }
+
+   //! \brief Access to the number of workers.
+   //! \return The number of threads of the pool.
+   size_t getNumThreads() const
+   {
+      return _workers.size();
+   }
+
+   //! \brief Runs a function in the pool.
+   //! \param func The function without parameters.
+   //! \return The future of the result of the function.
+   template<class FuncType>
+   auto submit(FuncType func) -> std::future<decltype(func())>
+   {
+      typedef decltype(func()) ResultType;
+      auto task = std::make_shared<std::packaged_task<ResultType ()>>(func);
+      std::future<ResultType> result = task->get_future();
+      push(new Task([task] () { (*task)(); }));
+      return result;
+   }
+
+   //! \brief Waits for a future and runs tasks meanwhile.
+   //! \param future The future of a submitted function.
+   //! \return The result of the function.
+   template<class ResultType>
+   ResultType getResult(std::future<ResultType>& future)
+   {
+      help([&future] () 
+         { 
+            return future.wait_for(std::chrono::seconds(0)) != 
+               std::future_status::ready;
+         }
+      );
+      return future.get();
+   }
+
+   //! \brief Calls a function for every index of a range in parallel.
+   //!
+   //! The range is split in halves until a part has at most grain 
+   //! indices. The halves are pushed as tasks, so idle workers steal the 
+   //! largest parts first. If func throws, the indices not yet started are 
+   //! skipped and the first exception is rethrown to the caller.
+   //! \param begin The first index.
+   //! \param end The index after the last index.
+   //! \param grain The maximal number of indices of a task.
+   //! \param func The function that takes an index.
+   template<class FuncType>
+   void parallelFor(size_t begin, size_t end, size_t grain, FuncType func)
+   {
+      if(end <= begin)
+      {
+         return;
+      }
+      Loop loop;
+      loop.remaining = end - begin;
+      loop.isFailed = false;
+      split(begin, end, std::max<size_t>(grain, 1), func, loop);
+      help([&loop] () 
+         { 
+            return loop.remaining.load(std::memory_order_acquire) > 0; 
+         }
+      );
+      if(loop.error)
+      {
+         std::rethrow_exception(loop.error);
+      }
+   }
+
+   //! \brief Reduces a range in parallel.
+   //!
+   //! The range is cut into chunks of grain indices. Every chunk is 
+   //! reduced by func(first, last, identity) and the results of the chunks 
+   //! are combined in order by reduce, so the result is deterministic. 
+   //! Exceptions of func are rethrown like in parallelFor.
+   //! \param begin The first index.
+   //! \param end The index after the last index.
+   //! \param grain The number of indices of a chunk.
+   //! \param identity The neutral element of reduce.
+   //! \param func The function that reduces the indices [first, last).
+   //! \param reduce The function that combines two results.
+   //! \return The reduction of the range.
+   template<class ValueType, class FuncType, class ReduceType>
+   ValueType parallelReduce(size_t begin, size_t end, size_t grain, 
+      ValueType identity, FuncType func, ReduceType reduce)
+   {
+      if(end <= begin)
+      {
+         return identity;
+      }
+      grain = std::max<size_t>(grain, 1);
+      size_t numChunks = (end - begin + grain - 1) / grain;
+      std::vector<ValueType> partials(numChunks, identity);
+      parallelFor(0, numChunks, 1, [&] (size_t chunk)
+         {
+            size_t first = begin + chunk * grain;
+            size_t last = std::min(first + grain, end);
+            partials[chunk] = func(first, last, identity);
+         }
+      );
+      ValueType result = identity;
+      for(size_t i = 0; i < numChunks; i++)
+      {
+         result = reduce(result, partials[i]);
+      }
+      return result;
+   }
+
+private:
+   //! \brief State of a parallel loop.
+   struct Loop
+   {
+      //! \brief The number of indices not yet done.
+      std::atomic<size_t> remaining;
+
+      //! \brief Specifies that an index threw, the rest is skipped.
+      std::atomic<bool> isFailed;
+
+      //! \brief The first exception of the loop.
+      std::exception_ptr error;
+
+      //! \brief Mutex of the exception.
+      std::mutex mutex;
+   };
+
+   //! \brief Worker of the calling thread.
+   struct Worker
+   {
+      //! \brief The pool of the worker.
+      ThreadPool* pool;
+
+      //! \brief The index of the worker.
+      size_t index;
+   };
+
+   //! \brief Deques of the workers.
+   std::vector<std::unique_ptr<WorkDeque>> _deques;
+
+   //! \brief Threads of the workers.
+   std::vector<std::thread> _workers;
+
+   //! \brief Tasks of threads that are not workers.
+   std::deque<Task*> _shared;
+
+   //! \brief Mutex of the shared tasks.
+   std::mutex _mutex;
+
+   //! \brief Number of shared tasks.
+   std::atomic<size_t> _numShared;
+
+   //! \brief Number of workers that look for work to park.
+   std::atomic<uint32_t> _numIdle;
+
+   //! \brief Word the idle workers park on.
+   std::atomic<uint32_t> _epoch;
+
+   //! \brief Specifies that the workers exit when there is no work.
+   std::atomic<bool> _isStopping;
+
+   //! \brief Access to the worker of the calling thread.
+   //! \return The worker, the pool is nullptr for other threads.
+   static Worker& GetWorker()
+   {
+      static thread_local Worker worker = { nullptr, 0 };
+      return worker;
+   }
+
+   //! \brief Pushes a task and wakes an idle worker.
+   //! \param task The task.
+   void push(Task* task)
+   {
+      Worker& worker = GetWorker();
+      if(worker.pool == this)
+      {
+         _deques[worker.index]->push(task);
+      }
+      else
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         _shared.push_back(task);
+         _numShared++;
+      }
+
+      // Order the push before the check of the idle workers
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if(_numIdle.load(std::memory_order_relaxed) > 0)
+      {
+         _epoch++;
+         Futex::Wake(&_epoch, 1);
+      }
+   }
+
+   //! \brief Looks for a task of the calling thread.
+   //! \return The task or nullptr.
+   Task* find()
+   {
+      Worker& worker = GetWorker();
+      size_t numDeques = _deques.size();
+      size_t start = 0;
+      if(worker.pool == this)
+      {
+         Task* task = _deques[worker.index]->pop();
+         if(task != nullptr)
+         {
+            return task;
+         }
+         start = worker.index + 1;
+      }
+      if(_numShared.load(std::memory_order_relaxed) > 0)
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         if(!_shared.empty())
+         {
+            Task* task = _shared.front();
+            _shared.pop_front();
+            _numShared--;
+            return task;
+         }
+      }
+      for(size_t i = 0; i < numDeques; i++)
+      {
+         Task* task = _deques[(start + i) % numDeques]->steal();
+         if(task != nullptr)
+         {
+            return task;
+         }
+      }
+      return nullptr;
+   }
+
+   //! \brief Runs and frees a task.
+   //! \param task The task.
+   static void execute(Task* task)
+   {
+      (*task)();
+      delete task;
+   }
+
+   //! \brief Runs tasks while a condition holds.
+   //! \param isWaiting The condition.
+   template<class CondType>
+   void help(CondType isWaiting)
+   {
+      while(isWaiting())
+      {
+         Task* task = find();
+         if(task != nullptr)
+         {
+            execute(task);
+         }
+         else
+         {
+            std::this_thread::yield();
+         }
+      }
+   }
+
+   //! \brief Splits a range and runs the first part.
+   //! \param begin The first index.
+   //! \param end The index after the last index.
+   //! \param grain The maximal number of indices of a task.
+   //! \param func The function that takes an index.
+   //! \param loop The state of the loop.
+   template<class FuncType>
+   void split(size_t begin, size_t end, size_t grain, FuncType& func,
+      Loop& loop)
+   {
+      // An exception must not leave a worker, the range is done anyway
+      try
+      {
+         while(end - begin > grain)
+         {
+            size_t middle = begin + (end - begin) / 2;
+            push(new Task([this, middle, end, grain, &func, &loop] ()
+               {
+                  split(middle, end, grain, func, loop);
+               }
+            ));
+            end = middle;
+         }
+         for(size_t i = begin; i < end && 
+            !loop.isFailed.load(std::memory_order_relaxed); i++)
+         {
+            func(i);
+         }
+      }
+      catch(...)
+      {
+         std::lock_guard<std::mutex> lock(loop.mutex);
+         if(!loop.error)
+         {
+            loop.error = std::current_exception();
+         }
+         loop.isFailed = true;
+      }
+      loop.remaining.fetch_sub(end - begin, std::memory_order_release);
+   }
+
+   //! \brief Main loop of a worker.
+   //! \param index The index of the worker.
+   void run(size_t index)
+   {
+      Worker& worker = GetWorker();
+      worker.pool = this;
+      worker.index = index;
+      while(true)
+      {
+         Task* task = find();
+         if(task != nullptr)
+         {
+            execute(task);
+            continue;
+         }
+
+         // Register as idle before the last look for work
+         _numIdle++;
+         uint32_t epoch = _epoch.load();
+         task = find();
+         if(task != nullptr)
+         {
+            _numIdle--;
+            execute(task);
+            continue;
+         }
+         if(_isStopping.load())
+         {
+            _numIdle--;
+            break;
+         }
+         Futex::Wait(&_epoch, epoch, nullptr);
+         _numIdle--;
+      }
+   }
+
+   //! \brief Private copy constructor. 
+   ThreadPool(ThreadPool const&);
+   
+   //! \brief Private assignment operator.
+   ThreadPool& operator=(ThreadPool const&);
+};
+
+}
+
+#endif
@@ -0,0 +1,583 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file ThreadWatch.h
+//! \brief Watch that keeps a separate timer table for every thread.
+#ifndef THREADWATCH_H
+#define THREADWATCH_H
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include "Histogram.h"
+#include "Counters.h"
+#include "Watch.h"
+
+//! \brief Global aire namespace.
+namespace aire
+{
+
+//! \brief Watch that keeps a separate timer table for every thread.
+//!
+//! Every thread records into its own Watch. The table of the calling
+//! thread is cached in thread local storage, so starting and stopping a
+//! timer does not take any lock. Only the first access of a thread
+//! registers its table under a mutex. The tables are owned by the
+//! ThreadWatch and survive the thread, printTime merges them into one
+//! report. Call printTime when the recording threads are done or idle.
+//! The cache has one entry per thread, a thread that alternates between 
+//! two thread watches looks its table up under the mutex on every switch.
+template<class KeyType, class TimerType = Timer>
+class ThreadWatch
+{
+public:
+   //! \brief Constructor of the object.
+   ThreadWatch()
+   {
+      initialize();
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~ThreadWatch()
+   {
+      destroy();
+   }
+
+   //! \brief Initializes the default parameter of the object.
+   virtual void initialize()
+   {
+      _id = GetNextId();
+      _isHistogram = false;
+      _isCounters = false;
+      _traceSize = 0;
+   }
+
+   //! \brief Frees the timer tables of all threads.
+   virtual void destroy()
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _threads.clear();
+      _watches.clear();
+      _names.clear();
+      _keys.clear();
+
+      // Thread local caches must not point to the freed tables
+      _id = GetNextId();
+   }
+
+   //! \brief Access to the watch of the calling thread.
+   //!
+   //! Register timers only through the thread watch, so that the handles 
+   //! are the same in every thread.
+   //! \return The watch that only the calling thread records into.
+   const Watch<KeyType, TimerType>& getWatch()
+   {
+      return local();
+   }
+
+   //! \brief Access to the unique id of the thread watch.
+   //! \return The id, it changes when the watch is destroyed or initialized.
+   uint64_t getId() const
+   {
+      return _id;
+   }
+
+   //! \brief Registers a timer name for all threads.
+   //! \param name The string containing the timer name.
+   //! \return The handle of the timer that is valid in every thread.
+   size_t getHandle(const std::basic_string<KeyType>& name)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _names.find(name);
+      if(it != _names.end())
+      {
+         return it->second;
+      }
+      size_t handle = _keys.size();
+      _keys.push_back(name);
+      _names.insert(std::make_pair(name, handle));
+      return handle;
+   }
+
+   //! \brief Access method for a timer of the calling thread by handle.
+   //! \param handle The handle returned by getHandle.
+   //! \return Returns the timer corresponding to the handle.
+   TimerType* getTimer(size_t handle)
+   {
+      Watch<KeyType, TimerType>& watch = local();
+      if(handle >= watch.getNumTimers())
+      {
+         sync(watch);
+      }
+      return watch.getTimer(handle);
+   }
+
+   //! \brief Access method for a timer of the calling thread.
+   //!
+   //! Only the first access of a thread to a name takes a lock.
+   //! \param name The string literal containing the timer name.
+   //! \return Returns the timer corresponding to the string.
+   TimerType* getTimer(const std::basic_string<KeyType>& name)
+   {
+      TimerType* timer = local().findTimer(name);
+      if(timer == nullptr)
+      {
+         timer = getTimer(getHandle(name));
+      }
+      return timer;
+   }
+
+   //! \brief Starts a scope in the call tree of the calling thread.
+   //! \param handle The handle returned by getHandle.
+   void start(size_t handle)
+   {
+      Watch<KeyType, TimerType>& watch = local();
+      if(handle >= watch.getNumTimers())
+      {
+         sync(watch);
+      }
+      watch.start(handle);
+   }
+
+   //! \brief Starts a scope in the call tree of the calling thread.
+   //! \param name The string containing the timer name.
+   void start(const std::basic_string<KeyType>& name)
+   {
+      Watch<KeyType, TimerType>& watch = local();
+      if(watch.findTimer(name) != nullptr)
+      {
+         watch.start(name);
+      }
+      else
+      {
+         start(getHandle(name));
+      }
+   }
+
+   //! \brief Stops a scope in the call tree of the calling thread.
+   //! \param handle The handle returned by getHandle.
+   void stop(size_t handle)
+   {
+      local().stop(handle);
+   }
+
+   //! \brief Stops a scope in the call tree of the calling thread.
+   //! \param name The string containing the timer name.
+   void stop(const std::basic_string<KeyType>& name)
+   {
+      Watch<KeyType, TimerType>& watch = local();
+      if(watch.findTimer(name) != nullptr)
+      {
+         watch.stop(name);
+      }
+   }
+
+   //! \brief Enables or disables the histograms of all threads.
+   //!
+   //! Call it before the threads start to record.
+   //! \param isEnabled Specifies to record the percentiles of all timers.
+   void setHistogram(bool isEnabled)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _isHistogram = isEnabled;
+      for(size_t t = 0; t < _watches.size(); t++)
+      {
+         _watches[t]->setHistogram(isEnabled);
+      }
+   }
+
+   //! \brief Enables or disables the hardware counters of all threads.
+   //!
+   //! Call it before the threads start to record, every thread counts 
+   //! its own events.
+   //! \param isEnabled Specifies to count the events of all timers.
+   void setCounters(bool isEnabled)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _isCounters = isEnabled;
+      for(size_t t = 0; t < _watches.size(); t++)
+      {
+         _watches[t]->setCounters(isEnabled);
+      }
+   }
+
+   //! \brief Enables or disables the recording of timed spans.
+   //!
+   //! Every thread records into its own bounded buffer. Call it before 
+   //! the threads start to record.
+   //! \param capacity The number of spans per thread, 0 disables it.
+   void setTrace(size_t capacity)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _traceSize = capacity;
+      for(size_t t = 0; t < _watches.size(); t++)
+      {
+         _watches[t]->setTrace(capacity);
+      }
+   }
+
+   //! \brief Writes the spans of all threads as Chrome trace.
+   //!
+   //! The threads are numbered in the order they registered. Call it when 
+   //! the recording threads are done or idle.
+   //! \param stream The output stream to write the JSON document to.
+   void writeTrace(std::ostream& stream)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      // Align all threads to the earliest span
+      int64_t origin = 0;
+      bool isFirst = true;
+      for(size_t t = 0; t < _watches.size(); t++)
+      {
+         TraceBuffer* trace = _watches[t]->getTrace();
+         if(trace != nullptr && trace->getSize() > 0)
+         {
+            int64_t start = _watches[t]->getTraceStart();
+            origin = isFirst ? start : std::min(origin, start);
+            isFirst = false;
+         }
+      }
+
+      isFirst = true;
+      stream << "{\"traceEvents\":[";
+      for(size_t t = 0; t < _watches.size(); t++)
+      {
+         stream << (isFirst ? "\n" : ",\n") 
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+                << "\"tid\":" << t << ",\"args\":{\"name\":\"Thread " << t 
+                << "\"}}";
+         isFirst = false;
+         _watches[t]->writeEvents(stream, origin, t, isFirst);
+      }
+      stream << "\n],\"displayTimeUnit\":\"ns\"}" << std::endl;
+   }
+
+   //! \brief Access to the number of threads that recorded.
+   //! \return The number of timer tables.
+   size_t getNumThreads()
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _watches.size();
+   }
+
+   //! \brief Prints the merged time of all threads.
+   //!
+   //! The first column is the aggregate over all threads, followed by
+   //! one column per thread in the order the threads registered. With 
+   //! histograms the percentiles and with counters the events of all 
+   //! threads are merged per timer. If scopes were recorded the call 
+   //! trees of all threads are merged by name and printed like 
+   //! Watch::printTree, the total is the time of the top level scopes.
+   //! \param stream The output stream to print to.
+   //! \param isAverage Specifies to print average values.
+   void printTime(std::basic_ostream<KeyType>& stream, bool isAverage = false)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      // Nested scopes are not added twice, print the merged call tree
+      bool isTree = false;
+      for(size_t t = 0; t < _watches.size(); t++)
+      {
+         isTree = isTree || _watches[t]->getNumScopes() > 0;
+      }
+      if(isTree)
+      {
+         Watch<KeyType, TimerType> merged;
+         merged.setHistogram(_isHistogram);
+         merged.setCounters(_isCounters);
+         for(size_t t = 0; t < _watches.size(); t++)
+         {
+            merged.merge(*_watches[t]);
+         }
+         merged.printTree(stream, isAverage);
+         return;
+      }
+
+      const size_t maxlen = 40;
+      const size_t nThreads = _watches.size();
+
+      // Collect the union of the timer names
+      std::map<std::basic_string<KeyType>, std::vector<TimerType*>> rows;
+      for(size_t t = 0; t < nThreads; t++)
+      {
+         auto names = _watches[t]->getNames();
+         for(auto it = names.begin(); it != names.end(); ++it)
+         {
+            // Skip timers that were only registered by this thread
+            TimerType* timer = _watches[t]->findTimer(*it);
+            if(timer->getCount() > 0)
+            {
+               auto& row = rows[*it];
+               row.resize(nThreads, nullptr);
+               row[t] = timer;
+            }
+         }
+      }
+
+      // Aggregate each row and the columns
+      std::vector<double> aggregate;
+      std::vector<double> columns(nThreads, 0.0);
+      double totalTime = 0;
+      for(auto it = rows.begin(); it != rows.end(); ++it)
+      {
+         double time = 0;
+         size_t count = 0;
+         for(size_t t = 0; t < nThreads; t++)
+         {
+            TimerType* timer = it->second[t];
+            if(timer != nullptr)
+            {
+               time += timer->getTime(false);
+               count += timer->getCount();
+               columns[t] += timer->getTime(isAverage);
+            }
+         }
+         if(isAverage && count > 0)
+         {
+            time /= static_cast<double>(count);
+         }
+         aggregate.push_back(time);
+         totalTime += time;
+      }
+
+      std::ios::fmtflags flags = stream.flags();
+      std::streamsize precision = stream.precision(3);
+      stream << std::scientific;
+      printLine(stream, nThreads);
+      printName(stream, "Timer", maxlen);
+      stream << std::setw(10) << "Total" << std::setw(9) << "Share";
+      for(size_t t = 0; t < nThreads; t++)
+      {
+         stream << std::setw(9) << "#" << std::setw(1) << t;
+      }
+      stream << std::endl;
+      printLine(stream, nThreads);
+
+      // Print one row per timer
+      Histogram merged;
+      size_t k = 0;
+      for(auto it = rows.begin(); it != rows.end(); ++it, ++k)
+      {
+         printName(stream, it->first, maxlen);
+         stream << std::setw(10) << aggregate[k]
+                << std::fixed << std::setprecision(1) << std::setw(8)
+                << (totalTime > 0 ? aggregate[k] / totalTime * 100 : 0.0)
+                << "%" << std::scientific << std::setprecision(3);
+         for(size_t t = 0; t < nThreads; t++)
+         {
+            TimerType* timer = it->second[t];
+            if(timer != nullptr)
+            {
+               stream << std::setw(10) << timer->getTime(isAverage);
+            }
+            else
+            {
+               stream << std::setw(10) << "-";
+            }
+         }
+         stream << std::endl;
+
+         // Merge the histograms of all threads
+         merged.reset();
+         for(size_t t = 0; t < nThreads; t++)
+         {
+            TimerType* timer = it->second[t];
+            if(timer != nullptr && timer->getHistogram() != nullptr)
+            {
+               merged.merge(*timer->getHistogram());
+            }
+         }
+         if(merged.getCount() > 0)
+         {
+            stream << "   ";
+            merged.printPercentiles(stream, 
+               TimerType::Clock::GetNanosPerTick());
+            stream << std::endl;
+         }
+
+         // Sum the counters of all threads
+         Counters counts;
+         for(size_t t = 0; t < nThreads; t++)
+         {
+            TimerType* timer = it->second[t];
+            if(timer != nullptr && timer->getCounters() != nullptr)
+            {
+               counts.merge(*timer->getCounters());
+            }
+         }
+         if(counts.isAvailable())
+         {
+            stream << "   ";
+            counts.printCounts(stream, isAverage);
+            stream << std::endl;
+         }
+      }
+
+      // Print out the total time
+      printLine(stream, nThreads);
+      printName(stream, "Total", maxlen);
+      stream << std::setw(10) << totalTime << std::setw(9) << " ";
+      for(size_t t = 0; t < nThreads; t++)
+      {
+         stream << std::setw(10) << columns[t];
+      }
+      stream << std::endl;
+      stream.precision(precision);
+      stream.flags(flags);
+   }
+
+private:
+   //! \brief Thread local cache entry for the table of the thread.
+   struct Cache
+   {
+      //! \brief Id of the watch the entry belongs to.
+      uint64_t id;
+
+      //! \brief Timer table of the thread.
+      Watch<KeyType, TimerType>* watch;
+   };
+
+   //! \brief Unique id of the object.
+   uint64_t _id;
+
+   //! \brief Mutex for the registration of the threads.
+   std::mutex _mutex;
+
+   //! \brief Timer tables in registration order.
+   std::vector<std::unique_ptr<Watch<KeyType, TimerType>>> _watches;
+
+   //! \brief Index into the timer tables by thread.
+   std::map<std::thread::id, size_t> _threads;
+
+   //! \brief Specifies if new tables record histograms.
+   bool _isHistogram;
+
+   //! \brief Specifies if new tables count hardware events.
+   bool _isCounters;
+
+   //! \brief Number of spans of the trace buffer of new tables.
+   size_t _traceSize;
+
+   //! \brief Handles of the timers by name.
+   std::map<std::basic_string<KeyType>, size_t> _names;
+
+   //! \brief Names of the timers by handle.
+   std::vector<std::basic_string<KeyType>> _keys;
+
+   //! \brief Unique id to detect stale thread local caches.
+   //! \return A new id, never 0.
+   static uint64_t GetNextId()
+   {
+      static std::atomic<uint64_t> nextId(1);
+      return nextId++;
+   }
+
+   //! \brief Access to the thread local cache.
+   //! \return The cache entry of the calling thread.
+   static Cache& GetCache()
+   {
+      static thread_local Cache cache = {0, nullptr};
+      return cache;
+   }
+
+   //! \brief Access to the table of the calling thread.
+   //! \return The cached table of the calling thread.
+   Watch<KeyType, TimerType>& local()
+   {
+      Cache& cache = GetCache();
+      if(cache.id != _id)
+      {
+         cache.watch = &attach();
+         cache.id = _id;
+      }
+      return *cache.watch;
+   }
+
+   //! \brief Registers all missing handles in the table of a thread.
+   //! \param watch The table of the calling thread.
+   void sync(Watch<KeyType, TimerType>& watch)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for(size_t k = watch.getNumTimers(); k < _keys.size(); k++)
+      {
+         watch.getHandle(_keys[k]);
+      }
+   }
+
+   //! \brief Looks up or creates the table of the calling thread.
+   //! \return The table of the calling thread.
+   Watch<KeyType, TimerType>& attach()
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::thread::id tid = std::this_thread::get_id();
+      auto it = _threads.find(tid);
+      if(it != _threads.end())
+      {
+         return *_watches[it->second];
+      }
+      _threads[tid] = _watches.size();
+      _watches.push_back(std::unique_ptr<Watch<KeyType, TimerType>>(
+         new Watch<KeyType, TimerType>()));
+      _watches.back()->setHistogram(_isHistogram);
+      _watches.back()->setCounters(_isCounters);
+      _watches.back()->setTrace(_traceSize);
+      return *_watches.back();
+   }
+
+   //! \brief Prints a name padded to a fixed width.
+   //! \param stream The output stream to print to.
+   //! \param name The name to print.
+   //! \param width The width of the column.
+   template<class NameType>
+   static void printName(std::basic_ostream<KeyType>& stream,
+      const NameType& name, size_t width)
+   {
+      std::basic_ostringstream<KeyType> out;
+      out << name;
+      std::basic_string<KeyType> text = out.str();
+      text.resize(width, ' ');
+      stream << text;
+   }
+
+   //! \brief Prints a separator line for the given number of threads.
+   //! \param stream The output stream to print to.
+   //! \param nThreads The number of thread columns.
+   static void printLine(std::basic_ostream<KeyType>& stream, size_t nThreads)
+   {
+      stream << std::basic_string<KeyType>(59 + 10 * nThreads, '-')
+             << std::endl;
+   }
+
+   //! \brief Private copy constructor.
+   ThreadWatch(ThreadWatch const&);
+
+   //! \brief Private assignment operator.
+   ThreadWatch& operator=(ThreadWatch const&);
+};
+
+}
+
+#endif
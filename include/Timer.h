@@ -17,33 +17,195 @@
 #ifndef TIMER_H
 #define TIMER_H
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define AIRE_HAS_TSC
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define AIRE_HAS_TSC
+#endif
+
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <memory>
+
+#include "Histogram.h"
+#include "Counters.h"
 
 //! \brief Global aire namespace.
 namespace aire
 {
 
+//! \brief Clock policy that reads the monotonic system clock.
+//!
+//! A clock policy provides the current time stamp in ticks and the 
+//! conversion of ticks into nanoseconds.
+class SteadyClock
+{
+public:
+   //! \brief Reads the current time stamp.
+   //! \return The time stamp in ticks.
+   static int64_t Now()
+   {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now().time_since_epoch()).count();
+   }
+
+   //! \brief Access to the length of a tick.
+   //! \return The nanoseconds per tick.
+   static double GetNanosPerTick()
+   {
+      return 1.0;
+   }
+};
+
+//! \brief Clock policy that reads the time stamp counter of the CPU.
+//!
+//! The counter is read with rdtscp, which waits for all previous 
+//! instructions to finish. The length of a tick is calibrated once against 
+//! the steady clock. The counter is only a valid clock if it is invariant, 
+//! i.e. it runs at a constant rate in all power states and on all cores. 
+//! On CPUs without rdtscp or an invariant counter the steady clock is used.
+class TscClock
+{
+public:
+   //! \brief Reads the current time stamp.
+   //! \return The time stamp in ticks.
+   static int64_t Now()
+   {
+      #if defined(AIRE_HAS_TSC)
+      static const bool isAvailable = IsAvailable();
+      if(isAvailable)
+      {
+         unsigned int aux;
+         return static_cast<int64_t>(__rdtscp(&aux));
+      }
+      #endif
+      return SteadyClock::Now();
+   }
+
+   //! \brief Checks if the time stamp counter is used as clock.
+   //! \return True if the CPU has rdtscp and an invariant counter.
+   static bool IsAvailable()
+   {
+      #if defined(AIRE_HAS_TSC) && (defined(__x86_64__) || defined(__i386__))
+      unsigned int eax, ebx, ecx, edx;
+      if(__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) == 0 || 
+         (edx & (1u << 27)) == 0)
+      {
+         return false;
+      }
+      #elif defined(AIRE_HAS_TSC)
+      int info[4];
+      __cpuid(info, 0x80000000);
+      if(static_cast<unsigned int>(info[0]) < 0x80000001u)
+      {
+         return false;
+      }
+      __cpuid(info, 0x80000001);
+      if((info[3] & (1 << 27)) == 0)
+      {
+         return false;
+      }
+      #endif
+      return IsInvariant();
+   }
+
+   //! \brief Access to the length of a tick.
+   //! \return The calibrated nanoseconds per tick.
+   static double GetNanosPerTick()
+   {
+      static const double nanosPerTick = Calibrate();
+      return nanosPerTick;
+   }
+
+   //! \brief Checks if the time stamp counter is invariant.
+   //! \return True if the counter can be used as a clock.
+   static bool IsInvariant()
+   {
+      #if defined(AIRE_HAS_TSC) && (defined(__x86_64__) || defined(__i386__))
+      unsigned int eax, ebx, ecx, edx;
+      if(__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0)
+      {
+         return false;
+      }
+      return (edx & (1u << 8)) != 0;
+      #elif defined(AIRE_HAS_TSC)
+      int info[4];
+      __cpuid(info, 0x80000007);
+      return (info[3] & (1 << 8)) != 0;
+      #else
+      return false;
+      #endif
+   }
+
+private:
+   //! \brief Measures the ticks of the counter during 20 milliseconds.
+   //! \return The nanoseconds per tick.
+   static double Calibrate()
+   {
+      if(!IsAvailable())
+      {
+         return SteadyClock::GetNanosPerTick();
+      }
+      const int64_t span = 20000000;
+      int64_t startTime = SteadyClock::Now();
+      int64_t startTick = Now();
+      int64_t stopTime = startTime;
+      while(stopTime - startTime < span)
+      {
+         stopTime = SteadyClock::Now();
+      }
+      int64_t stopTick = Now();
+      return static_cast<double>(stopTime - startTime) / 
+         static_cast<double>(stopTick - startTick);
+   }
+};
+
 //! \brief Timer that measures the time using start and stop.
 //!
 //! A measurement can be started and stopped multiple times. The timespan 
-//! is added to the total time.  
-class Timer
+//! is added to the total time. The ClockType policy provides the time 
+//! stamps. The overhead of a measurement is calibrated once per clock and 
+//! subtracted from the recorded time. Optionally every measurement is 
+//! recorded into a histogram to report percentiles and the hardware 
+//! counters of the thread are read around every measurement.
+template<class ClockType>
+class BasicTimer
 {
 public:
+   //! \brief The clock policy of the timer.
+   typedef ClockType Clock;
+
    //! \brief Constructor of the object.
-   Timer()
+   BasicTimer()
    {
       initialize();
    }
    
    //! \brief Destructor of the object.
-   virtual ~Timer() { }
+   virtual ~BasicTimer() { }
    
    //! \brief Initializes the default parameter of the object.
    virtual void initialize()
    {
       _count = 0;
       _isRunning = false;
+      _timeOverhead = GetOverhead();
+      _startTime = 0;
+      _timeSpan = 0;
+      if(_histogram)
+      {
+         _histogram->reset();
+      }
+      if(_counters)
+      {
+         _counters->reset();
+      }
    }
    
    //! \brief Starts the timer.
@@ -53,58 +215,244 @@ public:
       {
          _isRunning = true;
          _count++;     
-         _startTime = std::chrono::steady_clock::now();
+         if(_counters)
+         {
+            _counters->start();
+         }
+         _startTime = ClockType::Now();
       }
    }
    
    //! \brief Stops the timer.
-   void stop()
+   //! \return The measured span in ticks or 0 if the timer was not running.
+   int64_t stop()
    {  
-      _timeSpan += std::chrono::steady_clock::now() - _startTime;
-      _isRunning = false;
+      int64_t span = 0;
+      if(_isRunning)
+      {
+         span = ClockType::Now() - _startTime;
+         if(_counters)
+         {
+            _counters->stop();
+         }
+         _isRunning = false;
+         add(span);
+      }
+      return span;
+   }
+
+   //! \brief Records a span that was measured by another timer.
+   //!
+   //! The timer must not be running and must not count hardware events, 
+   //! e.g. a watch measures a scope once and records it in two timers.
+   //! \param span The span in ticks of the clock.
+   void record(int64_t span)
+   {
+      _count++;
+      add(span);
    }
    
    //! \brief Access to the total recorded time.
    //! \param isAverage Specifies to return average values.
-   //! \return The total time recorded by this timer.
+   //! \return The total time recorded by this timer in nanoseconds.
    double getTime(bool isAverage = false)
    {
       double result = -1;
-      if(isAverage)
+      double ticks = static_cast<double>(_timeSpan) - 
+         _timeOverhead * static_cast<double>(_count);
+      result = std::max(ticks, 0.0) * ClockType::GetNanosPerTick();
+      if(isAverage && _count > 0)
       {
-         result = (_timeSpan.count() / static_cast<double>(_count));
+         result = result / static_cast<double>(_count);
       }
-      else
+
+      return result;
+   }
+
+   //! \brief Access to the time stamp of the last start.
+   //! \return The time stamp in ticks of the clock.
+   int64_t getStartTime() const
+   {
+      return _startTime;
+   }
+
+   //! \brief Access to the state of the timer.
+   //! \return True if the timer was started and not stopped.
+   bool isRunning() const
+   {
+      return _isRunning;
+   }
+
+   //! \brief Access to the number of measurements.
+   //! \return The number of times the timer was started.
+   size_t getCount() const
+   {
+      return _count;
+   }
+
+   //! \brief Adds the measurements of another timer, e.g. of another thread.
+   //!
+   //! The histogram and the counters are merged if both timers have them.
+   //! \param other The timer to add, it must not be running.
+   void merge(const BasicTimer& other)
+   {
+      _count += other._count;
+      _timeSpan += other._timeSpan;
+      if(_histogram && other._histogram)
+      {
+         _histogram->merge(*other._histogram);
+      }
+      if(_counters && other._counters)
+      {
+         _counters->merge(*other._counters);
+      }
+   }
+
+   //! \brief Enables or disables the histogram of the measurements.
+   //!
+   //! The histogram is allocated once when it is enabled, recording into 
+   //! it does not allocate.
+   //! \param isEnabled Specifies to record every measurement.
+   void setHistogram(bool isEnabled)
+   {
+      if(isEnabled && !_histogram)
       {
-         result = _timeSpan.count();
+         _histogram.reset(new Histogram());
       }
+      else if(!isEnabled)
+      {
+         _histogram.reset();
+      }
+   }
 
+   //! \brief Access to the histogram of the measurements.
+   //! \return The histogram in ticks or nullptr if it is disabled.
+   Histogram* getHistogram() const
+   {
+      return _histogram.get();
+   }
+
+   //! \brief Enables or disables the hardware counters of the measurements.
+   //!
+   //! Every measurement reads the counter group of the thread that runs it, 
+   //! the timer only keeps the counts at the start and the sums. Without 
+   //! permission for perf events the counters stay unavailable and the time 
+   //! is measured as before.
+   //! \param isEnabled Specifies to count events of every measurement.
+   void setCounters(bool isEnabled)
+   {
+      if(isEnabled && !_counters)
+      {
+         _counters.reset(new Counters());
+      }
+      else if(!isEnabled)
+      {
+         _counters.reset();
+      }
+   }
+
+   //! \brief Access to the hardware counters of the measurements.
+   //! \return The counters or nullptr if they are disabled.
+   Counters* getCounters() const
+   {
+      return _counters.get();
+   }
+
+   //! \brief Access to a percentile of the measurements.
+   //! \param percent The percentile between 0 and 100, e.g. 99.9.
+   //! \return The percentile in nanoseconds or -1 without histogram.
+   double getPercentile(double percent) const
+   {
+      double result = -1;
+      if(_histogram)
+      {
+         result = static_cast<double>(_histogram->getPercentile(percent)) *
+            ClockType::GetNanosPerTick();
+      }
       return result;
    }
 
+   //! \brief Sets the overhead that is subtracted per measurement.
+   //! \param overhead The overhead in ticks, 0 disables the correction.
+   void setOverhead(double overhead)
+   {
+      _timeOverhead = overhead;
+   }
+
+   //! \brief Access to the calibrated overhead of a measurement.
+   //!
+   //! The overhead is the median time between two back to back time 
+   //! stamps. It is measured once on the first call.
+   //! \return The overhead in ticks of the clock.
+   static double GetOverhead()
+   {
+      static const double overhead = Calibrate();
+      return overhead;
+   }
+
 private:
-   //! \brief System overhead of the time stamp.
+   //! \brief System overhead of the time stamp in ticks.
    double _timeOverhead;
    
    //! \brief Counter for average time measurments.
    size_t _count;
 
    //! \brief Start time stamp.
-   std::chrono::time_point<std::chrono::steady_clock> _startTime;
+   int64_t _startTime;
    
-   //! \brief Total time of a time measurement.
-   std::chrono::duration<double, std::nano> _timeSpan;
+   //! \brief Total time of a time measurement in ticks.
+   int64_t _timeSpan;
    
    //! \brief State variable of the timer.
    bool _isRunning;
 
+   //! \brief Optional histogram of the measurements in ticks.
+   std::unique_ptr<Histogram> _histogram;
+
+   //! \brief Optional hardware counters of the measurements.
+   std::unique_ptr<Counters> _counters;
+
+   //! \brief Adds a measured span to the total time and the histogram.
+   //! \param span The span in ticks of the clock.
+   void add(int64_t span)
+   {
+      _timeSpan += span;
+      if(_histogram)
+      {
+         double ticks = static_cast<double>(span) - _timeOverhead;
+         _histogram->record(static_cast<uint64_t>(std::max(ticks, 0.0)));
+      }
+   }
+
+   //! \brief Measures the median overhead of a measurement.
+   //! \return The overhead in ticks.
+   static double Calibrate()
+   {
+      const size_t samples = 1001;
+      std::vector<int64_t> spans(samples);
+      for(size_t i = 0; i < samples; i++)
+      {
+         int64_t startTime = ClockType::Now();
+         spans[i] = ClockType::Now() - startTime;
+      }
+      std::nth_element(spans.begin(), spans.begin() + samples / 2, 
+         spans.end());
+      return static_cast<double>(spans[samples / 2]);
+   }
+
    //! \brief Private copy constructor. 
-   Timer(Timer const&);
+   BasicTimer(BasicTimer const&);
    
    //! \brief Private assignment operator. 
-   Timer& operator=(Timer const&); 
+   BasicTimer& operator=(BasicTimer const&); 
 };
 
+//! \brief Timer that uses the steady system clock.
+typedef BasicTimer<SteadyClock> Timer;
+
+//! \brief Timer that uses the time stamp counter of the CPU.
+typedef BasicTimer<TscClock> TscTimer;
+
 }  
 
 #endif
@@ -0,0 +1,170 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file Trace.h
+//! \brief Bounded buffer of timed spans for trace export. 
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <algorithm>
+
+//! \brief Global aire namespace.
+namespace aire
+{
+
+//! \brief Timed span of a scope.
+struct TraceEvent
+{
+   //! \brief Handle of the timer of the scope.
+   uint32_t handle;
+
+   //! \brief Nesting depth of the scope.
+   uint32_t depth;
+
+   //! \brief Start time stamp in ticks.
+   int64_t begin;
+
+   //! \brief Stop time stamp in ticks.
+   int64_t end;
+};
+
+//! \brief Bounded ring buffer of timed spans.
+//!
+//! The memory is allocated once by initialize. Recording never allocates, 
+//! if the buffer is full the oldest span is overwritten. The buffer is not 
+//! thread safe, every thread records into its own buffer.
+class TraceBuffer
+{
+public:
+   //! \brief Constructor of the object.
+   //! \param capacity Number of spans, rounded up to a power of two.
+   TraceBuffer(size_t capacity)
+   {
+      initialize(capacity);
+   }
+
+   //! \brief Destructor of the object.
+   virtual ~TraceBuffer() { }
+
+   //! \brief Allocates the buffer.
+   //! \param capacity Number of spans, rounded up to a power of two.
+   virtual void initialize(size_t capacity)
+   {
+      _capacity = 1;
+      while(_capacity < capacity)
+      {
+         _capacity <<= 1;
+      }
+      _events.reset(new TraceEvent[_capacity]);
+      _next = 0;
+   }
+
+   //! \brief Records a span.
+   //! \param event The span to record.
+   void record(const TraceEvent& event)
+   {
+      _events[_next & (_capacity - 1)] = event;
+      _next++;
+   }
+
+   //! \brief Removes all spans.
+   void clear()
+   {
+      _next = 0;
+   }
+
+   //! \brief Access to the number of buffered spans.
+   //! \return The number of spans that can be read.
+   size_t getSize() const
+   {
+      return static_cast<size_t>(std::min<uint64_t>(_next, _capacity));
+   }
+
+   //! \brief Access to the number of overwritten spans.
+   //! \return The number of spans lost because the buffer was full.
+   uint64_t getDropped() const
+   {
+      return _next - getSize();
+   }
+
+   //! \brief Access to a buffered span, the oldest span first.
+   //! \param index The index between 0 and getSize.
+   //! \return The span.
+   const TraceEvent& getEvent(size_t index) const
+   {
+      return _events[(_next - getSize() + index) & (_capacity - 1)];
+   }
+
+   //! \brief Writes a name as JSON string.
+   //!
+   //! Narrow strings are written as they are, i.e. as UTF-8. Wide 
+   //! characters are written as escape sequences.
+   //! \param stream The output stream to write to.
+   //! \param name The name to write.
+   template<class CharType>
+   static void WriteString(std::ostream& stream, 
+      const std::basic_string<CharType>& name)
+   {
+      stream << '"';
+      for(size_t i = 0; i < name.length(); i++)
+      {
+         uint32_t c = static_cast<uint32_t>(name[i]);
+         if(sizeof(CharType) == 1)
+         {
+            c &= 0xff;
+         }
+         if(c == '"' || c == '\\')
+         {
+            stream << '\\' << static_cast<char>(c);
+         }
+         else if(c < 0x20 || (c > 0x7f && sizeof(CharType) > 1))
+         {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c & 0xffff);
+            stream << code;
+         }
+         else
+         {
+            stream << static_cast<char>(c);
+         }
+      }
+      stream << '"';
+   }
+
+private:
+   //! \brief The spans.
+   std::unique_ptr<TraceEvent[]> _events;
+
+   //! \brief Number of spans the buffer can hold.
+   size_t _capacity;
+
+   //! \brief Number of spans recorded since the last clear.
+   uint64_t _next;
+
+   //! \brief Private copy constructor. 
+   TraceBuffer(TraceBuffer const&);
+   
+   //! \brief Private assignment operator. 
+   TraceBuffer& operator=(TraceBuffer const&); 
+};
+
+}
+
+#endif
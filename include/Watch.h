@@ -20,12 +20,22 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <memory>
 #include <map>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+#include <vector>
 
 #include "Singleton.h"
 #include "Timer.h"
+#include "Trace.h"
 
 //! \brief Global aire namespace.
 namespace aire
@@ -36,17 +46,54 @@ namespace aire
 // This class is not thread safe and it is not suposed 
 // to be thread safe. In a multi-threadded environment 
 // each thread might want to have it's own watch. 
-template<class KeyType>
+//
+// Every timer name is interned once into a handle. The handle is the index 
+// into a flat array of timers that is allocated in blocks, so a timer never 
+// moves and the handle can be used without any string lookup. The 
+// TimerType selects the clock of the timers, see BasicTimer.
+//
+// Timers started with the start and stop methods of the watch are tracked 
+// on a scope stack. Every nesting of a timer in a parent scope is a node of 
+// a call tree that records the inclusive time of the scope. The report 
+// prints the tree with inclusive and exclusive time, so nested time is 
+// not counted twice. Optionally every scope is recorded as timed span into 
+// a bounded buffer that can be written as Chrome trace.
+template<class KeyType, class TimerType = Timer>
 class Watch
 {
 public:
+   //! \brief Number of timers allocated at once.
+   static const size_t BLOCK_SIZE = 64;
+
    //! \brief Constructor of the object.
-   Watch() { }
+   Watch() 
+   { 
+      initialize();
+   }
+
+   //! \brief Initializes the default parameter of the object.
+   virtual void initialize()
+   {
+      _id = GetNextId();
+      _isHistogram = false;
+      _isCounters = false;
+   }
    
    virtual void destroy()
    {
       // Free all created timers
-      _timers.erase(_timers.begin(), _timers.end());
+      _trace.reset();
+      _scopes.clear();
+      _roots.clear();
+      _nodes.clear();
+      _isScoped.clear();
+      _numScopes.clear();
+      _blocks.clear();
+      _keys.clear();
+      _names.clear();
+
+      // Handles cached by call sites are no longer valid
+      _id = GetNextId();
    }
 
    //! \brief Destructor of the object.
@@ -55,47 +102,344 @@ public:
       destroy();
    }
    
+   //! \brief Access to the unique id of the watch.
+   //! \return The id, it changes when the watch is destroyed or initialized.
+   uint64_t getId() const
+   {
+      return _id;
+   }
+
+   //! \brief Registers a timer name and returns its handle.
+   //! \param name The string containing the timer name.
+   //! \return The stable handle of the timer.
+   size_t getHandle(const std::basic_string<KeyType>& name)
+   {
+      // Look if the timer exists   
+      auto it = _names.find(name);
+      if(it != _names.end())
+      {
+         return it->second;
+      }
+
+      // Create timer if there is no timer for the name
+      size_t handle = _keys.size();
+      if(handle % BLOCK_SIZE == 0)
+      {
+         _blocks.push_back(
+            std::unique_ptr<TimerType[]>(new TimerType[BLOCK_SIZE]));
+      }
+      _keys.push_back(name);
+      _names.insert(std::make_pair(name, handle));
+      getTimer(handle)->setHistogram(_isHistogram);
+      getTimer(handle)->setCounters(_isCounters);
+      _isScoped.push_back(false);
+      _numScopes.push_back(0);
+      return handle;
+   }
+
+   //! \brief Access method for a timer by handle.
+   //! \param handle The handle returned by getHandle.
+   //! \return Returns the timer corresponding to the handle.
+   TimerType* getTimer(size_t handle) const
+   {
+      assert(handle < _keys.size());
+      return &_blocks[handle / BLOCK_SIZE][handle % BLOCK_SIZE];
+   }
+
    //! \brief Access method for a timer.
    //! \param name The string literal containing the timer name.
    //! \return Returns the timer corresponding to the string.
-   std::unique_ptr<Timer> const& getTimer(std::basic_string<KeyType> name)
+   TimerType* getTimer(const std::basic_string<KeyType>& name)
    {
-      // Look if the timer exists   
-      auto it = _timers.find(name);
-      if (it == _timers.end())
+      return getTimer(getHandle(name));
+   }
+
+   //! \brief Searches a timer without creating it.
+   //! \param name The string containing the timer name.
+   //! \return The timer or nullptr if no timer exists for the name.
+   TimerType* findTimer(const std::basic_string<KeyType>& name) const
+   {
+      auto it = _names.find(name);
+      return (it == _names.end()) ? nullptr : getTimer(it->second);
+   }
+
+   //! \brief Starts a timer as a scope nested in the current scope.
+   //! \param handle The handle returned by getHandle.
+   void start(size_t handle)
+   {
+      // Look for the node of the timer below the current scope
+      std::vector<size_t>& children = _scopes.empty() ? 
+         _roots : _nodes[_scopes.back().first]->children;
+      size_t node = _nodes.size();
+      for(size_t i = 0; i < children.size(); i++)
       {
-         // Create timer if there is no timer for the name
-         auto newTimer =_timers.insert(
-            std::pair<std::basic_string<KeyType>, std::unique_ptr<Timer>>(name,
-            std::move(std::unique_ptr<Timer>(new Timer()))));
-         return newTimer.first->second;
+         if(_nodes[children[i]]->handle == handle)
+         {
+            node = children[i];
+            break;
+         }
       }
-      else
+      if(node == _nodes.size())
       {
-         return it->second;
-      }   
+         node = addNode(handle);
+         children.push_back(node);
+      }
+
+      // Recursive scopes leave the flat timer to the outermost scope. It 
+      // records the span of the node, only counters need their own reads.
+      TimerType* timer = getTimer(handle);
+      bool isOuter = _numScopes[handle]++ == 0 && !timer->isRunning();
+      _scopes.push_back(std::make_pair(node, isOuter));
+      if(isOuter && timer->getCounters() != nullptr)
+      {
+         timer->start();
+      }
+      _nodes[node]->timer.start();
    }
-   
+
+   //! \brief Starts a timer as a scope nested in the current scope.
+   //! \param name The string containing the timer name.
+   void start(const std::basic_string<KeyType>& name)
+   {
+      start(getHandle(name));
+   }
+
+   //! \brief Stops the scope of a timer.
+   //!
+   //! Scopes that were started within the scope and are still running 
+   //! are stopped as well.
+   //! \param handle The handle returned by getHandle.
+   void stop(size_t handle)
+   {
+      // Ignore timers that are not on the scope stack
+      size_t depth = _scopes.size();
+      while(depth > 0 && _nodes[_scopes[depth - 1].first]->handle != handle)
+      {
+         depth--;
+      }
+      while(depth > 0 && _scopes.size() >= depth)
+      {
+         Node& node = *_nodes[_scopes.back().first];
+         int64_t begin = node.timer.getStartTime();
+         int64_t span = node.timer.stop();
+         if(_trace)
+         {
+            TraceEvent event = { static_cast<uint32_t>(node.handle), 
+               static_cast<uint32_t>(_scopes.size() - 1), begin, 
+               begin + span };
+            _trace->record(event);
+         }
+         TimerType* timer = getTimer(node.handle);
+         if(_scopes.back().second && timer->getCounters() != nullptr)
+         {
+            timer->stop();
+         }
+         else if(_scopes.back().second)
+         {
+            timer->record(span);
+         }
+         _numScopes[node.handle]--;
+         _scopes.pop_back();
+      }
+   }
+
+   //! \brief Stops the scope of a timer.
+   //! \param name The string containing the timer name.
+   void stop(const std::basic_string<KeyType>& name)
+   {
+      stop(getHandle(name));
+   }
+
+   //! \brief Adds the timers and the call tree of another watch.
+   //!
+   //! Timers are matched by name and scopes by their path of names, e.g. 
+   //! to merge the watches of several threads into one report. Enable 
+   //! histograms and counters before merging to merge them as well.
+   //! \param other The watch to add, it must not have running timers.
+   void merge(const Watch& other)
+   {
+      for(size_t handle = 0; handle < other._keys.size(); handle++)
+      {
+         getTimer(other._keys[handle])->merge(*other.getTimer(handle));
+      }
+      for(size_t i = 0; i < other._roots.size(); i++)
+      {
+         mergeNode(other, other._roots[i], _roots);
+      }
+   }
+
+   //! \brief Access to the number of nodes in the call tree.
+   //! \return The number of distinct nestings of scopes.
+   size_t getNumScopes() const
+   {
+      return _nodes.size();
+   }
+
+   //! \brief Access to the name of a timer.
+   //! \param handle The handle of the timer.
+   //! \return The name the handle was registered with.
+   const std::basic_string<KeyType>& getName(size_t handle) const
+   {
+      return _keys[handle];
+   }
+
+   //! \brief Access to the number of registered timers.
+   //! \return The number of handles.
+   size_t getNumTimers() const
+   {
+      return _keys.size();
+   }
+
+   //! \brief Enables or disables the histograms of all timers.
+   //! \param isEnabled Specifies to record the percentiles of all timers.
+   void setHistogram(bool isEnabled)
+   {
+      _isHistogram = isEnabled;
+      for(size_t handle = 0; handle < _keys.size(); handle++)
+      {
+         getTimer(handle)->setHistogram(isEnabled);
+      }
+      for(size_t node = 0; node < _nodes.size(); node++)
+      {
+         _nodes[node]->timer.setHistogram(isEnabled);
+      }
+   }
+
+   //! \brief Enables or disables the hardware counters of all timers.
+   //!
+   //! All timers of a thread read one counter group, see Counters.
+   //! \param isEnabled Specifies to count the events of all timers.
+   void setCounters(bool isEnabled)
+   {
+      _isCounters = isEnabled;
+      for(size_t handle = 0; handle < _keys.size(); handle++)
+      {
+         getTimer(handle)->setCounters(isEnabled);
+      }
+      for(size_t node = 0; node < _nodes.size(); node++)
+      {
+         _nodes[node]->timer.setCounters(isEnabled);
+      }
+   }
+
+   //! \brief Enables or disables the recording of timed spans.
+   //!
+   //! Every stopped scope is recorded with its start and stop time stamp. 
+   //! The buffer is allocated once here and keeps the latest spans.
+   //! \param capacity The number of spans to keep, 0 disables the trace.
+   void setTrace(size_t capacity)
+   {
+      _trace.reset(capacity > 0 ? new TraceBuffer(capacity) : nullptr);
+   }
+
+   //! \brief Access to the buffer of timed spans.
+   //! \return The buffer or nullptr if the trace is disabled.
+   TraceBuffer* getTrace() const
+   {
+      return _trace.get();
+   }
+
+   //! \brief Writes the recorded spans as Chrome trace.
+   //!
+   //! The file can be loaded into chrome://tracing or Perfetto.
+   //! \param stream The output stream to write the JSON document to.
+   void writeTrace(std::ostream& stream) const
+   {
+      bool isFirst = true;
+      stream << "{\"traceEvents\":[";
+      writeEvents(stream, getTraceStart(), 0, isFirst);
+      stream << "\n],\"displayTimeUnit\":\"ns\"}" << std::endl;
+   }
+
+   //! \brief Writes the recorded spans as Chrome trace events.
+   //! \param stream The output stream to write to.
+   //! \param origin The time stamp in ticks that becomes time 0.
+   //! \param tid The thread id of the events.
+   //! \param isFirst Specifies if no event was written before.
+   void writeEvents(std::ostream& stream, int64_t origin, size_t tid,
+      bool& isFirst) const
+   {
+      if(!_trace)
+      {
+         return;
+      }
+      const double scale = TimerType::Clock::GetNanosPerTick() / 1000.0;
+      std::ios::fmtflags flags = stream.flags();
+      std::streamsize precision = stream.precision(3);
+      stream << std::fixed;
+      for(size_t i = 0; i < _trace->getSize(); i++)
+      {
+         const TraceEvent& event = _trace->getEvent(i);
+         stream << (isFirst ? "\n" : ",\n") << "{\"name\":";
+         TraceBuffer::WriteString(stream, _keys[event.handle]);
+         stream << ",\"cat\":\"aire\",\"ph\":\"X\",\"pid\":0,\"tid\":" 
+                << tid << ",\"ts\":" << (event.begin - origin) * scale 
+                << ",\"dur\":" << (event.end - event.begin) * scale << "}";
+         isFirst = false;
+      }
+      stream.precision(precision);
+      stream.flags(flags);
+   }
+
+   //! \brief Access to the earliest recorded time stamp.
+   //! \return The start of the oldest span or 0 without spans.
+   int64_t getTraceStart() const
+   {
+      int64_t start = 0;
+      if(_trace)
+      {
+         for(size_t i = 0; i < _trace->getSize(); i++)
+         {
+            const TraceEvent& event = _trace->getEvent(i);
+            start = (i == 0) ? event.begin : std::min(start, event.begin);
+         }
+      }
+      return start;
+   }
+
+   //! \brief Access to the names of all timers.
+   //! \return The sorted names of all timers of the watch.
+   std::vector<std::basic_string<KeyType>> getNames() const
+   {
+      std::vector<std::basic_string<KeyType>> names;
+      for(auto it = _names.begin(); it != _names.end(); ++it)
+      {
+         names.push_back(it->first);
+      }
+      return names;
+   }
+
    //! \brief Prints the total time recorded by all timers.
+   //!
+   //! If scopes were recorded the call tree is printed, see printTree. 
+   //! Timers with a histogram get a second line with the percentiles and 
+   //! timers with available counters a line with the events.
    //! \param isAverage Specifies to print average values.
    //! \param stream The output stream to print to.
    void printTime(std::basic_ostream<KeyType>& stream, bool isAverage = false)
    {
+      if(!_nodes.empty())
+      {
+         printTree(stream, isAverage);
+         return;
+      }
+
       // Maximum lendth of the timer name
       unsigned int maxlen = 40;
       
       // Calculate the total time
       double totalTime = 0;
-      for(auto it = _timers.begin(); it != _timers.end(); ++it) 
+      for(auto it = _names.begin(); it != _names.end(); ++it) 
       {
-         totalTime += it->second->getTime(isAverage);
+         totalTime += getTimer(it->second)->getTime(isAverage);
       }
       stream << "-------------------------------------------------------------" 
              << "-----" << std::endl;
       
       // Iterate over all timers and print the total time
-      for(auto it = _timers.begin(); it != _timers.end(); ++it) 
+      for(auto it = _names.begin(); it != _names.end(); ++it) 
       {
+         TimerType* timer = getTimer(it->second);
          unsigned int respace = maxlen;
          std::basic_string<KeyType> output = it->first;
          if(it->first.length() > maxlen)
@@ -109,10 +453,25 @@ public:
          }
 
          stream << output << std::setw(maxlen-respace) << " "
-                << std::scientific << it->second->getTime(isAverage) << " "
+                << std::scientific << timer->getTime(isAverage) << " "
                 << std::resetiosflags(::std::ios::scientific)
-                << "(" << (it->second->getTime(isAverage)/totalTime*100) << "%)"
+                << "(" << (timer->getTime(isAverage)/totalTime*100) << "%)"
                 << std::endl;
+
+         if(timer->getHistogram() != nullptr && timer->getCount() > 0)
+         {
+            stream << "   ";
+            timer->getHistogram()->printPercentiles(stream,
+               TimerType::Clock::GetNanosPerTick());
+            stream << std::endl;
+         }
+         if(timer->getCounters() != nullptr && 
+            timer->getCounters()->isAvailable())
+         {
+            stream << "   ";
+            timer->getCounters()->printCounts(stream, isAverage);
+            stream << std::endl;
+         }
       }
       
       // Print out the total time
@@ -122,10 +481,236 @@ public:
              << "Total                                    " << totalTime
              << std::resetiosflags(::std::ios::scientific) << std::endl;
    }
+
+   //! \brief Prints the call tree of the scopes.
+   //!
+   //! Every scope is indented below its parent scope. The exclusive time 
+   //! is the inclusive time without the time of the nested scopes. Timers 
+   //! that were only used without scopes are printed at the top level. 
+   //! The total is the sum of the top level scopes.
+   //! \param isAverage Specifies to print average values per call.
+   //! \param stream The output stream to print to.
+   void printTree(std::basic_ostream<KeyType>& stream, bool isAverage = false)
+   {
+      double totalTime = 0;
+      for(size_t i = 0; i < _roots.size(); i++)
+      {
+         totalTime += _nodes[_roots[i]]->timer.getTime(false);
+      }
+      for(size_t handle = 0; handle < _keys.size(); handle++)
+      {
+         if(!_isScoped[handle])
+         {
+            totalTime += getTimer(handle)->getTime(false);
+         }
+      }
+
+      std::ios::fmtflags flags = stream.flags();
+      std::streamsize precision = stream.precision(3);
+      std::basic_string<KeyType> line(81, '-');
+      stream << line << std::endl << Pad("Timer", 40) << std::scientific
+             << std::setw(11) << "Inclusive" << std::setw(11) << "Exclusive"
+             << std::setw(10) << "Calls" << std::setw(9) << "Share" 
+             << std::endl << line << std::endl;
+      for(size_t i = 0; i < _roots.size(); i++)
+      {
+         printNode(stream, _roots[i], 0, totalTime, isAverage);
+      }
+      for(auto it = _names.begin(); it != _names.end(); ++it)
+      {
+         TimerType* timer = getTimer(it->second);
+         if(!_isScoped[it->second] && timer->getCount() > 0)
+         {
+            double time = timer->getTime(false);
+            printRow(stream, it->first, 0, time, time, timer, totalTime,
+               isAverage);
+         }
+      }
+      stream << line << std::endl << Pad("Total", 40) << std::setw(11) 
+             << totalTime << std::endl;
+      stream.precision(precision);
+      stream.flags(flags);
+   }
    
 private:
-   //! \brief Hash-map of timers.  
-   std::map<std::basic_string<KeyType>, std::unique_ptr<Timer>> _timers;
+   //! \brief Node of the call tree.
+   struct Node
+   {
+      //! \brief Handle of the timer of the scope.
+      size_t handle;
+
+      //! \brief Nodes of the scopes nested in this scope.
+      std::vector<size_t> children;
+
+      //! \brief Inclusive time of the scope.
+      TimerType timer;
+   };
+
+   //! \brief Unique id to detect stale handles of call sites.
+   uint64_t _id;
+
+   //! \brief Handles of the timers by name.  
+   std::map<std::basic_string<KeyType>, size_t> _names;
+
+   //! \brief Names of the timers by handle.
+   std::vector<std::basic_string<KeyType>> _keys;
+
+   //! \brief Specifies if new timers record a histogram.
+   bool _isHistogram;
+
+   //! \brief Specifies if new timers count hardware events.
+   bool _isCounters;
+
+   //! \brief Blocks of timers indexed by handle.
+   std::vector<std::unique_ptr<TimerType[]>> _blocks;
+
+   //! \brief Specifies by handle if a timer was used as scope.
+   std::vector<bool> _isScoped;
+
+   //! \brief Number of running scopes by handle.
+   std::vector<uint32_t> _numScopes;
+
+   //! \brief Nodes of the call tree.
+   std::vector<std::unique_ptr<Node>> _nodes;
+
+   //! \brief Top level nodes of the call tree.
+   std::vector<size_t> _roots;
+
+   //! \brief Stack of running nodes and if they own the flat timer.
+   std::vector<std::pair<size_t, bool>> _scopes;
+
+   //! \brief Optional buffer of timed spans.
+   std::unique_ptr<TraceBuffer> _trace;
+
+   //! \brief Unique id to detect stale handles of call sites.
+   //! \return A new id, never 0.
+   static uint64_t GetNextId()
+   {
+      static std::atomic<uint64_t> nextId(1);
+      return nextId++;
+   }
+
+   //! \brief Creates a node of the call tree.
+   //! \param handle The handle of the timer of the scope.
+   //! \return The index of the node.
+   size_t addNode(size_t handle)
+   {
+      _nodes.push_back(std::unique_ptr<Node>(new Node()));
+      _nodes.back()->handle = handle;
+      _nodes.back()->timer.setHistogram(_isHistogram);
+      _nodes.back()->timer.setCounters(_isCounters);
+      _isScoped[handle] = true;
+      return _nodes.size() - 1;
+   }
+
+   //! \brief Adds a node of another watch and all nested nodes.
+   //! \param other The watch of the node.
+   //! \param node The index of the node in the other watch.
+   //! \param children The nodes to merge the node into.
+   void mergeNode(const Watch& other, size_t node, 
+      std::vector<size_t>& children)
+   {
+      const Node& source = *other._nodes[node];
+      size_t handle = getHandle(other._keys[source.handle]);
+      size_t target = _nodes.size();
+      for(size_t i = 0; i < children.size(); i++)
+      {
+         if(_nodes[children[i]]->handle == handle)
+         {
+            target = children[i];
+            break;
+         }
+      }
+      if(target == _nodes.size())
+      {
+         target = addNode(handle);
+         children.push_back(target);
+      }
+      _nodes[target]->timer.merge(source.timer);
+      for(size_t i = 0; i < source.children.size(); i++)
+      {
+         mergeNode(other, source.children[i], _nodes[target]->children);
+      }
+   }
+
+   //! \brief Prints a node and all nested nodes.
+   //! \param stream The output stream to print to.
+   //! \param node The index of the node.
+   //! \param depth The nesting depth of the node.
+   //! \param totalTime The total time of the tree.
+   //! \param isAverage Specifies to print average values per call.
+   void printNode(std::basic_ostream<KeyType>& stream, size_t node, 
+      size_t depth, double totalTime, bool isAverage)
+   {
+      Node& current = *_nodes[node];
+      double inclusive = current.timer.getTime(false);
+      double exclusive = inclusive;
+      for(size_t i = 0; i < current.children.size(); i++)
+      {
+         exclusive -= _nodes[current.children[i]]->timer.getTime(false);
+      }
+      printRow(stream, _keys[current.handle], depth, inclusive, 
+         std::max(exclusive, 0.0), &current.timer, totalTime, isAverage);
+      for(size_t i = 0; i < current.children.size(); i++)
+      {
+         printNode(stream, current.children[i], depth + 1, totalTime, 
+            isAverage);
+      }
+   }
+
+   //! \brief Converts a name into a string of fixed width.
+   //! \param name The name to convert.
+   //! \param width The width of the column.
+   //! \return The truncated or padded name.
+   template<class NameType>
+   static std::basic_string<KeyType> Pad(const NameType& name, size_t width)
+   {
+      std::basic_ostringstream<KeyType> out;
+      out << name;
+      std::basic_string<KeyType> text = out.str();
+      text.resize(width, ' ');
+      return text;
+   }
+
+   //! \brief Prints one row of the call tree.
+   //! \param stream The output stream to print to.
+   //! \param name The name of the timer.
+   //! \param depth The nesting depth of the row.
+   //! \param inclusive The inclusive time.
+   //! \param exclusive The exclusive time.
+   //! \param timer The timer with the calls, the histogram and counters.
+   //! \param totalTime The total time of the tree.
+   //! \param isAverage Specifies to print average values per call.
+   void printRow(std::basic_ostream<KeyType>& stream, 
+      const std::basic_string<KeyType>& name, size_t depth, double inclusive,
+      double exclusive, TimerType* timer, double totalTime, bool isAverage)
+   {
+      std::basic_string<KeyType> output(2 * depth, ' ');
+      output = Pad(output + name, 40);
+      double calls = static_cast<double>(std::max<size_t>(timer->getCount(),
+         1));
+      double share = (totalTime > 0) ? inclusive / totalTime * 100 : 0.0;
+      stream << output << std::setw(11) 
+             << (isAverage ? inclusive / calls : inclusive) << std::setw(11) 
+             << (isAverage ? exclusive / calls : exclusive) << std::setw(10)
+             << timer->getCount() << std::fixed << std::setprecision(1) 
+             << std::setw(8) << share << "%" << std::scientific 
+             << std::setprecision(3) << std::endl;
+      if(timer->getHistogram() != nullptr && timer->getCount() > 0)
+      {
+         stream << std::basic_string<KeyType>(2 * depth + 3, ' ');
+         timer->getHistogram()->printPercentiles(stream,
+            TimerType::Clock::GetNanosPerTick());
+         stream << std::endl;
+      }
+      if(timer->getCounters() != nullptr && 
+         timer->getCounters()->isAvailable())
+      {
+         stream << std::basic_string<KeyType>(2 * depth + 3, ' ');
+         timer->getCounters()->printCounts(stream, isAverage);
+         stream << std::endl;
+      }
+   }
 
    //! \brief Private copy constructor. 
    Watch(Watch const&);
@@ -134,6 +719,148 @@ private:
    Watch& operator=(Watch const&);
 };
 
+//! \brief Starts a timer and stops it when the scope is left.
+template<class TimerType>
+class BasicScope
+{
+public:
+   //! \brief Constructor of the object that starts the timer.
+   //! \param timer The timer to measure the scope with.
+   BasicScope(TimerType* timer)
+   {
+      initialize(timer);
+   }
+
+   //! \brief Destructor of the object that stops the timer.
+   virtual ~BasicScope()
+   {
+      destroy();
+   }
+
+   //! \brief Starts the timer.
+   //! \param timer The timer to measure the scope with.
+   virtual void initialize(TimerType* timer)
+   {
+      _timer = timer;
+      _timer->start();
+   }
+
+   //! \brief Stops the timer.
+   virtual void destroy()
+   {
+      _timer->stop();
+   }
+
+private:
+   //! \brief The running timer.
+   TimerType* _timer;
+
+   //! \brief Private copy constructor.
+   BasicScope(BasicScope const&);
+
+   //! \brief Private assignment operator.
+   BasicScope& operator=(BasicScope const&);
+};
+
+//! \brief Scope measured with the steady clock timer.
+typedef BasicScope<Timer> ScopeTimer;
+
+//! \brief Starts a scope of a watch and stops it when the scope is left.
+//!
+//! Other than ScopeTimer the scope is tracked in the call tree of the 
+//! watch. WatchType is a Watch or a ThreadWatch.
+template<class WatchType>
+class WatchScope
+{
+public:
+   //! \brief Constructor of the object that starts the scope.
+   //! \param watch The watch to record into.
+   //! \param handle The handle of the timer.
+   WatchScope(WatchType& watch, size_t handle)
+   {
+      initialize(watch, handle);
+   }
+
+   //! \brief Destructor of the object that stops the scope.
+   virtual ~WatchScope()
+   {
+      destroy();
+   }
+
+   //! \brief Starts the scope.
+   //! \param watch The watch to record into.
+   //! \param handle The handle of the timer.
+   virtual void initialize(WatchType& watch, size_t handle)
+   {
+      _watch = &watch;
+      _handle = handle;
+      _watch->start(_handle);
+   }
+
+   //! \brief Stops the scope.
+   virtual void destroy()
+   {
+      _watch->stop(_handle);
+   }
+
+private:
+   //! \brief The watch that records the scope.
+   WatchType* _watch;
+
+   //! \brief The handle of the timer.
+   size_t _handle;
+
+   //! \brief Private copy constructor.
+   WatchScope(WatchScope const&);
+
+   //! \brief Private assignment operator.
+   WatchScope& operator=(WatchScope const&);
+};
+
+//! \brief Timer handle of an AIRE_SCOPE_TIMER call site for one watch.
+struct HandleCache
+{
+   //! \brief The id of the watch, 0 if none.
+   uint64_t watch;
+
+   //! \brief The handle of the timer in the watch.
+   size_t handle;
+
+   //! \brief Registers the name again if the watch changed.
+   //! \param watch The watch (or thread watch) object.
+   //! \param name The name of the timer.
+   //! \return The handle of the timer in the watch.
+   template<class WatchType, class NameType>
+   size_t get(WatchType& watch, const NameType& name)
+   {
+      if(this->watch != watch.getId())
+      {
+         handle = watch.getHandle(name);
+         this->watch = watch.getId();
+      }
+      return handle;
+   }
+};
+
 }
 
+// Helper to create unique names per source line
+#define AIRE_CONCAT_(a, b) a##b
+#define AIRE_CONCAT(a, b) AIRE_CONCAT_(a, b)
+
+//! \brief Measures the rest of the scope with the timer of the given name.
+//!
+//! The scope is nested into the running scopes of the watch.
+//! Every thread caches the handle of the call site for the last watch it 
+//! used, a call site used with another watch or after the watch was 
+//! destroyed registers the name again.
+//! \param watch The watch (or thread watch) object.
+//! \param name The name of the timer.
+#define AIRE_SCOPE_TIMER(watch, name) \
+   static thread_local aire::HandleCache AIRE_CONCAT(aireCache, __LINE__) = \
+      {0, 0}; \
+   aire::WatchScope<std::remove_reference<decltype(watch)>::type> \
+      AIRE_CONCAT(aireScope, __LINE__)((watch), \
+      AIRE_CONCAT(aireCache, __LINE__).get((watch), (name)))
+
 #endif
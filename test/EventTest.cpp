@@ -19,10 +19,13 @@
 #include <cstdint>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <vector>
 
 #include "Test.h"
 #include "Event.h"
 #include "Stream.h"
+#include "Singleton.h"
 
 // --- Thread output -----------------------------------------------------------
 void outputFunc()
@@ -79,17 +82,306 @@ int32_t signalAndWait()
    return EXIT_SUCCESS;
 }
 
+// --- Timed wait --------------------------------------------------------------
+int32_t timedWait()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::Event event;
+
+   auto start = std::chrono::steady_clock::now();
+   if(event.wait(50))
+   {
+      result = EXIT_FAILURE;
+   }
+   auto span = std::chrono::steady_clock::now() - start;
+   if(span < std::chrono::milliseconds(50) || span > std::chrono::seconds(5))
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // The signal is kept until it is consumed by one wait
+   event.signal();
+   if(!event.wait(50) || event.tryWait())
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Ping pong ---------------------------------------------------------------
+int32_t pingPong()
+{
+   const uint32_t rounds = 10000;
+   aire::Event ping;
+   aire::Event pong;
+
+   std::thread partner([&ping, &pong, rounds] ()
+      {
+         for(uint32_t i = 0; i < rounds; i++)
+         {
+            ping.wait();
+            pong.signal();
+         }
+      }
+   );
+
+   auto start = std::chrono::steady_clock::now();
+   for(uint32_t i = 0; i < rounds; i++)
+   {
+      ping.signal();
+      pong.wait();
+   }
+   auto span = std::chrono::steady_clock::now() - start;
+   partner.join();
+
+   std::cout << "Round trip: " << std::chrono::duration_cast<
+      std::chrono::nanoseconds>(span).count() / rounds << " ns" << std::endl;
+   return EXIT_SUCCESS;
+}
+
+// --- Broadcast and counting --------------------------------------------------
+template<uint32_t N>
+int32_t broadcast()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::Event start(true);
+   aire::Latch done(N);
+   aire::Semaphore tokens(0);
+   std::atomic<uint32_t> consumed(0);
+   std::thread threads[N];
+
+   for(uint32_t i = 0; i < N; i++)
+   {
+      threads[i] = std::thread([&] () 
+         {
+            // All workers pass one signal of the manual-reset event
+            start.wait();
+            tokens.acquire();
+            consumed++;
+            done.countDown();
+         }
+      );
+   }
+
+   start.signal();
+   tokens.release(N);
+   if(!done.wait(10000) || consumed != N || tokens.tryAcquire())
+   {
+      result = EXIT_FAILURE;
+   }
+
+   for(uint32_t i = 0; i < N; i++)
+   {
+      threads[i].join();
+   }
+
+   // The manual-reset event stays signaled until reset
+   if(!start.tryWait() || !start.wait(0))
+   {
+      result = EXIT_FAILURE;
+   }
+   start.reset();
+   if(start.wait(10) || tokens.acquire(10))
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Wait for several events -------------------------------------------------
+int32_t waitMulti()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::Event first;
+   aire::Event second;
+   std::vector<aire::Event*> events;
+   events.push_back(&first);
+   events.push_back(&second);
+
+   if(aire::Event::WaitAny(events, 10) != -1)
+   {
+      result = EXIT_FAILURE;
+   }
+
+   std::thread signaler([&second] ()
+      {
+         std::this_thread::sleep_for(std::chrono::milliseconds(10));
+         second.signal();
+      }
+   );
+   if(aire::Event::WaitAny(events, 10000) != 1)
+   {
+      result = EXIT_FAILURE;
+   }
+   signaler.join();
+
+   first.signal();
+   second.signal();
+   if(!aire::Event::WaitAll(events, 1000) || 
+      aire::Event::WaitAll(events, 10))
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // No signal is lost while the waiter registers and leaves
+   const uint32_t rounds = 1000;
+   aire::Event done;
+   std::thread producer([&events, &done, rounds] ()
+      {
+         for(uint32_t i = 0; i < rounds; i++)
+         {
+            events[i % 2]->signal();
+            done.wait();
+         }
+      }
+   );
+   for(uint32_t i = 0; i < rounds; i++)
+   {
+      if(aire::Event::WaitAny(events, 10000) != static_cast<int32_t>(i % 2))
+      {
+         result = EXIT_FAILURE;
+      }
+      done.signal();
+   }
+   producer.join();
+   return result;
+}
+
+// --- Singleton access --------------------------------------------------------
+struct Instance
+{
+   Instance() { Constructed++; }
+   static std::atomic<uint32_t> Constructed;
+};
+std::atomic<uint32_t> Instance::Constructed(0);
+
+template<uint32_t N>
+int32_t singletonAccess()
+{
+   int32_t result = EXIT_SUCCESS;
+   std::thread threads[N];
+   Instance* instances[N];
+   
+   for(uint32_t i = 0; i < N; i++)
+   {
+      threads[i] = std::thread([&instances, i] () 
+         {
+            instances[i] = aire::Singleton<Instance>::GetInstance();
+         }
+      );
+   }
+
+   for(uint32_t i = 0; i < N; i++)
+   {
+      threads[i].join();
+      if(instances[i] != instances[0])
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   if(Instance::Constructed != 1)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Per-thread and sharded singleton ----------------------------------------
+typedef aire::ShardedSingleton<std::atomic<uint64_t>> ShardedCounter;
+
+template<uint32_t N>
+int32_t singletonShards()
+{
+   int32_t result = EXIT_SUCCESS;
+   std::thread threads[N];
+   uint64_t* locals[N];
+   std::atomic<uint32_t> ready(0);
+   
+   for(uint32_t i = 0; i < N; i++)
+   {
+      threads[i] = std::thread([&locals, &ready, i] () 
+         {
+            locals[i] = aire::ThreadSingleton<uint64_t>::GetInstance();
+            for(uint32_t k = 0; k < 1000; k++)
+            {
+               (*aire::ThreadSingleton<uint64_t>::GetInstance())++;
+               (*ShardedCounter::GetInstance())++;
+               (*ShardedCounter::GetByThread())++;
+            }
+            if(*locals[i] != 1000)
+            {
+               locals[i] = nullptr;
+            }
+
+            // Keep the instance alive until all threads have one
+            ready++;
+            while(ready < N)
+            {
+               std::this_thread::yield();
+            }
+         }
+      );
+   }
+
+   for(uint32_t i = 0; i < N; i++)
+   {
+      threads[i].join();
+   }
+
+   // Every thread had its own instance
+   for(uint32_t i = 0; i < N; i++)
+   {
+      for(uint32_t k = 0; k < i; k++)
+      {
+         if(locals[i] == nullptr || locals[i] == locals[k])
+         {
+            result = EXIT_FAILURE;
+         }
+      }
+   }
+
+   uint64_t sum = 0;
+   ShardedCounter::Visit([&sum] (std::atomic<uint64_t>& counter)
+      {
+         sum += counter;
+      }
+   );
+   // Every shard has its own cache line
+   if(sum != 2 * 1000 * N || ShardedCounter::GetNumShards() < 1 || 
+      reinterpret_cast<uintptr_t>(ShardedCounter::GetInstance()) % 64 != 0)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
 // --- Main --------------------------------------------------------------------
 int main()
 {
    aire::Test test("Thread-Test");
 
    test.add("Signal and wait (2 threads)", signalAndWait);
+   test.add("Timed wait", timedWait);
+   test.add("Ping pong (2 threads)", pingPong);
+   test.add("Broadcast and count (16 threads)", broadcast<16>);
+   test.add("Wait for several events", waitMulti);
+
+   test.add("Singleton access (32 threads)", singletonAccess<32>);
+   test.add("Singleton shards (8 threads)", singletonShards<8>);
 
    test.add("Synchronized print (2 threads)", threadOutput<2>);
    test.add("Synchronized print (8 threads)", threadOutput<8>);
    test.add("Synchronized print (32 threads)", threadOutput<32>);
 
+   aire::Event event;
+   test.addBenchmark("Signal and wait (1 thread)", [&event] () 
+      {
+         event.signal();
+         aire::Test::DoNotOptimize(event.tryWait());
+      }
+   );
+
    test.run();
   
    return EXIT_SUCCESS;
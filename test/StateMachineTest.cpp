@@ -0,0 +1,230 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file StateMachineTest.cpp
+//! \brief Test case for the table driven state machine. 
+#include <cstdlib>
+#include <cstdint>
+#include <memory>
+
+#include "Test.h"
+#include "StateMachine.h"
+
+// --- Turnstile ---------------------------------------------------------------
+enum Gate { LOCKED, OPEN, BROKEN, NUM_GATES };
+enum Input { COIN, PUSH, KICK, REPAIR, NUM_INPUTS };
+
+struct Turnstile
+{
+   uint32_t coins;
+   uint32_t passes;
+   uint32_t alarms;
+};
+
+bool hasCoin(const Turnstile& turnstile) { return turnstile.coins > 0; }
+void payCoin(Turnstile& turnstile) { turnstile.coins--; }
+void pass(Turnstile& turnstile) { turnstile.passes++; }
+void alarm(Turnstile& turnstile) { turnstile.alarms++; }
+
+typedef aire::Transition<Turnstile, Gate, Input> TurnstileTransition;
+
+struct TurnstileTable
+{
+   typedef Turnstile ContextType;
+   typedef Gate StateType;
+   typedef Input EventType;
+   static const size_t NUM_STATES = NUM_GATES;
+   static const size_t NUM_EVENTS = NUM_INPUTS;
+   static const Gate INITIAL = LOCKED;
+   static constexpr TurnstileTransition TRANSITIONS[] = {
+      {LOCKED, COIN,   OPEN,   &hasCoin, &payCoin},
+      {LOCKED, PUSH,   LOCKED, nullptr,  &alarm},
+      {OPEN,   PUSH,   LOCKED, nullptr,  &pass},
+      {LOCKED, KICK,   BROKEN, nullptr,  &alarm},
+      {OPEN,   KICK,   BROKEN, nullptr,  &alarm},
+      {BROKEN, REPAIR, LOCKED, nullptr,  nullptr},
+      // Taken only if the guard of the first COIN transition fails
+      {LOCKED, COIN,   LOCKED, nullptr,  &alarm}
+   };
+};
+constexpr TurnstileTransition TurnstileTable::TRANSITIONS[];
+
+typedef aire::StateMachine<TurnstileTable> TurnstileMachine;
+
+int32_t turnstile()
+{
+   int32_t result = EXIT_SUCCESS;
+   Turnstile context = {1, 0, 0};
+   TurnstileMachine machine(context);
+
+   // The guard passes once, then the second transition of the cell
+   if(!machine.process(COIN) || machine.getState() != OPEN || 
+      context.coins != 0 || !machine.process(PUSH) || 
+      machine.getState() != LOCKED || context.passes != 1 || 
+      !machine.process(COIN) || machine.getState() != LOCKED || 
+      context.alarms != 1)
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // Events without a transition are ignored
+   if(machine.process(REPAIR) || machine.process(NUM_INPUTS) || 
+      machine.getState() != LOCKED || !machine.process(KICK) || 
+      machine.process(COIN) || machine.getState() != BROKEN || 
+      !machine.process(REPAIR) || machine.getState() != LOCKED)
+   {
+      result = EXIT_FAILURE;
+   }
+
+   if(!TurnstileMachine::HasTransition(OPEN, KICK) || 
+      TurnstileMachine::HasTransition(OPEN, COIN) || 
+      TurnstileMachine::HasTransition(NUM_GATES, COIN))
+   {
+      result = EXIT_FAILURE;
+   }
+
+   machine.initialize();
+   if(machine.getState() != TurnstileTable::INITIAL || 
+      machine.getContext() != &context)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Many machines -----------------------------------------------------------
+template<uint32_t N>
+int32_t manyMachines()
+{
+   int32_t result = EXIT_SUCCESS;
+   std::unique_ptr<Turnstile[]> contexts(new Turnstile[N]);
+   std::unique_ptr<TurnstileMachine[]> machines(new TurnstileMachine[N]);
+   for(uint32_t i = 0; i < N; i++)
+   {
+      contexts[i].coins = i % 3;
+      contexts[i].passes = 0;
+      contexts[i].alarms = 0;
+      machines[i].setContext(contexts[i]);
+   }
+
+   // Every machine passes as often as it has coins
+   for(uint32_t round = 0; round < 3; round++)
+   {
+      for(uint32_t i = 0; i < N; i++)
+      {
+         machines[i].process(COIN);
+         machines[i].process(PUSH);
+      }
+   }
+   for(uint32_t i = 0; i < N; i++)
+   {
+      if(contexts[i].passes != i % 3 || contexts[i].coins != 0 || 
+         machines[i].getState() != LOCKED)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+   return result;
+}
+
+// --- Large table -------------------------------------------------------------
+enum Step { NUM_STEPS = 30 };
+enum Tick { NUM_TICKS = 20 };
+
+struct Counter
+{
+   uint32_t count;
+};
+
+void increment(Counter& counter) { counter.count++; }
+bool isEven(const Counter& counter) { return counter.count % 2 == 0; }
+
+typedef aire::Transition<Counter, Step, Tick> StepTransition;
+
+//! \brief Table ordered by state, every step has two transitions per tick.
+template<class IndicesType>
+struct StepTable;
+
+template<size_t... I>
+struct StepTable<aire::Indices<I...>>
+{
+   typedef Counter ContextType;
+   typedef Step StateType;
+   typedef Tick EventType;
+   static const size_t NUM_STATES = NUM_STEPS;
+   static const size_t NUM_EVENTS = NUM_TICKS;
+   static const Step INITIAL = static_cast<Step>(0);
+   static constexpr StepTransition TRANSITIONS[] = {
+      {static_cast<Step>(I / (2 * NUM_TICKS)), 
+      static_cast<Tick>(I % NUM_TICKS), 
+      static_cast<Step>((I % (2 * NUM_TICKS) < NUM_TICKS) ? 
+      (I / (2 * NUM_TICKS) + 1) % NUM_STEPS : I / (2 * NUM_TICKS)), 
+      (I % (2 * NUM_TICKS) < NUM_TICKS) ? &isEven : nullptr, &increment}...
+   };
+};
+
+template<size_t... I>
+constexpr StepTransition StepTable<aire::Indices<I...>>::TRANSITIONS[];
+
+int32_t largeTable()
+{
+   // More transitions than the default constexpr depth of 512
+   typedef StepTable<aire::MakeIndices<2 * NUM_STEPS * NUM_TICKS>::Type> 
+      Table;
+   int32_t result = EXIT_SUCCESS;
+   Counter counter = {0};
+   aire::StateMachine<Table> machine(counter);
+
+   // The guarded transition of a cell steps on even counts, the second 
+   // one of the cell stays otherwise
+   for(uint32_t i = 0; i < 2 * NUM_STEPS; i++)
+   {
+      if(!machine.process(static_cast<Tick>(i % NUM_TICKS)) || 
+         machine.getState() != static_cast<Step>((i / 2 + 1) % NUM_STEPS) ||
+         counter.count != i + 1)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+   if(!aire::StateMachine<Table>::HasTransition(static_cast<Step>(29), 
+      static_cast<Tick>(19)))
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Main --------------------------------------------------------------------
+int main()
+{
+   aire::Test test("StateMachine-Test");
+
+   test.add("Turnstile", turnstile);
+   test.add("Many machines (10000)", manyMachines<10000>);
+   test.add("Large table (1200)", largeTable);
+
+   Turnstile context = {0, 0, 0};
+   TurnstileMachine machine(context);
+   test.addBenchmark("Process event", [&machine, &context] () 
+      {
+         context.coins = 1;
+         machine.process(COIN);
+         aire::Test::DoNotOptimize(machine.process(PUSH));
+      }
+   );
+
+   test.run();
+  
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,333 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file StreamTest.cpp
+//! \brief Test case for the synchronized stream and the logger. 
+#include <cstdlib>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <limits>
+
+#include "Test.h"
+#include "Stream.h"
+#include "Logger.h"
+#include "BinaryLog.h"
+
+// --- Stream ------------------------------------------------------------------
+int32_t stream()
+{
+   int32_t result = EXIT_SUCCESS;
+   if((aire::Stream() << "ID:" << 42 << ' ' << 1.5).toString() != "ID:42 1.5")
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Fixed stream ------------------------------------------------------------
+//! \brief Compares the fixed stream with std::ostream for a value.
+template<class ValueType>
+bool IsSame(const ValueType& value, int32_t precision = 6)
+{
+   aire::FixedStream<> fixed;
+   std::ostringstream reference;
+   fixed.setPrecision(precision);
+   reference.precision(precision);
+   fixed << value;
+   reference << value;
+   if(fixed.toString() != reference.str())
+   {
+      std::cout << fixed.getData() << " != " << reference.str() << std::endl;
+      return false;
+   }
+   return true;
+}
+
+int32_t fixedStream()
+{
+   int32_t result = EXIT_SUCCESS;
+   const double doubles[] = {0.0, 1.0, -1.5, 0.1, 3.14159265358979, 100.0, 
+      123456.0, 1234567.0, 999999.5, 0.0001, 0.00001234, 1e100, -2.5e-300, 
+      4.9e-324, 1.7976931348623157e308, 1.0 / 3.0, 65536.0, 0.5};
+   for(size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++)
+   {
+      if(!IsSame(doubles[i]) || !IsSame(doubles[i], 15) || 
+         !IsSame(static_cast<float>(doubles[i])))
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   // Exact ties round to even like std::ostream
+   const double ties[] = {1234.125, 100.0625, 250.0, 2.5, 3.5, -0.375, 
+      0.125, 2.5e21, 1e23};
+   for(size_t i = 0; i < sizeof(ties) / sizeof(ties[0]); i++)
+   {
+      if(!IsSame(ties[i]) || !IsSame(ties[i], 1) || !IsSame(ties[i], 2) ||
+         !IsSame(ties[i], 3))
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+   if(!IsSame(std::numeric_limits<int64_t>::min()) || 
+      !IsSame(std::numeric_limits<uint64_t>::max()) || 
+      !IsSame(int16_t(-42)) || !IsSame(0u) || !IsSame('c') || 
+      !IsSame(true) || !IsSame("text") || !IsSame(std::string("string")) ||
+      !IsSame(static_cast<const void*>(&result)) ||
+      !IsSame(std::numeric_limits<double>::infinity()))
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // The text is cut at the end of the inline buffer
+   aire::FixedStream<8> line;
+   line << "ID:" << 1234567;
+   if(line.toString() != "ID:1234" || !line.isTruncated() || 
+      line.getData()[line.getSize()] != '\0')
+   {
+      result = EXIT_FAILURE;
+   }
+   line.clear();
+   line << -7 << ' ' << 2.5;
+   if(line.toString() != "-7 2.5" || line.isTruncated())
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Asynchronous logger -----------------------------------------------------
+//! \brief Reads a temporary file from the start.
+std::string ReadFile(FILE* file)
+{
+   std::string content;
+   char chunk[4096];
+   size_t size = 0;
+   std::fflush(file);
+   std::rewind(file);
+   while((size = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+   {
+      content.append(chunk, size);
+   }
+   return content;
+}
+
+template<uint32_t N>
+int32_t asyncLogger()
+{
+   int32_t result = EXIT_SUCCESS;
+   const uint32_t numLines = 10000;
+   FILE* file = std::tmpfile();
+   if(file == nullptr)
+   {
+      return EXIT_FAILURE;
+   }
+
+   {
+      // Few records per thread make the threads wait for the writer
+      aire::Logger logger(fileno(file), 16);
+      std::thread threads[N];
+      for(uint32_t t = 0; t < N; t++)
+      {
+         threads[t] = std::thread([&logger, t] ()
+            {
+               for(uint32_t i = 0; i < numLines; i++)
+               {
+                  aire::LogStream(logger) << t << ' ' << i << '\n';
+               }
+            }
+         );
+      }
+      for(uint32_t t = 0; t < N; t++)
+      {
+         threads[t].join();
+      }
+      logger.flush();
+      if(logger.getNumLines() != N * numLines || logger.getNumDropped() != 0)
+      {
+         result = EXIT_FAILURE;
+      }
+
+      // Long lines are truncated
+      aire::LogStream(logger) << std::string(2 * aire::Logger::LINE_SIZE, 'x');
+   }
+
+   // A failed write drops the batch and reports the error
+   {
+      aire::Logger broken(-1, 16);
+      aire::LogStream(broken) << "lost" << '\n';
+      broken.flush();
+      if(broken.getNumDropped() != 1 || broken.getError() != EBADF)
+      {
+         result = EXIT_FAILURE;
+      }
+
+      // The thread does not write into the freed buffer after destroy
+      broken.destroy();
+      aire::LogStream(broken) << "lost" << '\n';
+      broken.initialize(-1, 16);
+      aire::LogStream(broken) << "lost" << '\n';
+      broken.flush();
+      if(broken.getNumDropped() != 1)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   // The lines of every thread are complete and in order
+   std::istringstream lines(ReadFile(file));
+   std::vector<uint32_t> next(N, 0);
+   uint32_t thread = 0;
+   uint32_t index = 0;
+   while(lines >> thread >> index)
+   {
+      if(thread >= N || index != next[thread]++)
+      {
+         result = EXIT_FAILURE;
+         break;
+      }
+   }
+   for(uint32_t t = 0; t < N; t++)
+   {
+      if(next[t] != numLines)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+   lines.clear();
+   std::string tail;
+   lines >> tail;
+   if(tail.size() != aire::Logger::LINE_SIZE)
+   {
+      result = EXIT_FAILURE;
+   }
+   std::fclose(file);
+   return result;
+}
+
+// --- Binary log --------------------------------------------------------------
+template<uint32_t N>
+int32_t binaryLog()
+{
+   int32_t result = EXIT_SUCCESS;
+   const uint32_t numLines = 10000;
+
+   // Arguments are formatted on the calling thread of writeText
+   {
+      aire::BinaryLog log;
+      std::ostringstream text;
+      std::string name("name");
+      AIRE_LOG(log, "Start");
+      AIRE_LOG(log, "{} {} {} {} {} {} {}", -5, 2.5, name, 'c', "literal", 
+         true, 7u);
+      AIRE_LOG(log, "Missing {} {}", 1);
+      if(log.writeText(text) != 3 || log.writeText(text) != 0 || 
+         text.str() != "Start\n-5 2.5 name c literal 1 7\nMissing 1 {}\n")
+      {
+         std::cout << text.str();
+         result = EXIT_FAILURE;
+      }
+   }
+
+   // The thread does not write into the freed ring buffer after destroy
+   {
+      aire::BinaryLog log;
+      std::ostringstream text;
+      AIRE_LOG(log, "Old");
+      log.destroy();
+      AIRE_LOG(log, "New {}", 1);
+      if(log.writeText(text) != 1 || text.str() != "New 1\n")
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   // A call site registers its format in every log it writes to
+   for(uint32_t i = 0; i < 3; i++)
+   {
+      aire::BinaryLog log;
+      std::ostringstream text;
+      AIRE_LOG(log, "Log {}", i);
+      if(log.writeText(text) != 1 || text.str() != "Log " + 
+         std::to_string(i) + "\n")
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   // A background thread formats the lines of all threads
+   aire::BinaryLog log(4096);
+   std::ostringstream text;
+   std::thread threads[N];
+   log.startWriter(text, 1);
+   for(uint32_t t = 0; t < N; t++)
+   {
+      threads[t] = std::thread([&log, t] ()
+         {
+            for(uint32_t i = 0; i < numLines; i++)
+            {
+               AIRE_LOG(log, "{} {} {}", t, i, "line");
+            }
+         }
+      );
+   }
+   for(uint32_t t = 0; t < N; t++)
+   {
+      threads[t].join();
+   }
+   log.stopWriter();
+
+   // The lines of every thread are in order, some might be dropped
+   std::istringstream lines(text.str());
+   std::vector<int64_t> last(N, -1);
+   uint64_t count = 0;
+   uint32_t thread = 0;
+   int64_t index = 0;
+   std::string word;
+   while(lines >> thread >> index >> word)
+   {
+      if(thread >= N || index <= last[thread] || word != "line")
+      {
+         result = EXIT_FAILURE;
+         break;
+      }
+      last[thread] = index;
+      count++;
+   }
+   if(count + log.getDropped() != N * numLines)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Main --------------------------------------------------------------------
+int main()
+{
+   aire::Test test("Stream-Test");
+
+   test.add("Stream", stream);
+   test.add("Fixed stream", fixedStream);
+   test.add("Asynchronous logger (8 threads)", asyncLogger<8>);
+   test.add("Binary log (4 threads)", binaryLog<4>);
+
+   test.run();
+  
+   return EXIT_SUCCESS;
+}
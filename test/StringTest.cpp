@@ -16,11 +16,385 @@
 //! \brief Test driver for basic string utility functions. 
 
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <vector>
+#include <random>
 
 #include "String.h"
+#include "Matcher.h"
+#include "ThreadPool.h"
 #include "Test.h"
 
+// --- Substring count --------------------------------------------------------
+//! \brief Counts the occurrences by brute force.
+uint32_t Count(const std::string& text, const std::string& key)
+{
+   uint32_t count = 0;
+   size_t i = 0;
+   while(!key.empty() && i + key.size() <= text.size())
+   {
+      bool isMatch = text.compare(i, key.size(), key) == 0;
+      count += isMatch ? 1 : 0;
+      i += isMatch ? key.size() : 1;
+   }
+   return count;
+}
+
+int32_t substrCount()
+{
+   int32_t result = EXIT_SUCCESS;
+   std::mt19937 random(11);
+
+   // Keys around the vector widths and the Horspool limit
+   for(uint32_t round = 0; round < 2000; round++)
+   {
+      std::string key(random() % 70, 'a');
+      std::string text(random() % 300, 'a');
+      for(size_t i = 0; i < key.size(); i++)
+      {
+         key[i] = "ab"[random() % 2];
+      }
+      for(size_t i = 0; i < text.size(); i++)
+      {
+         text[i] = "abc"[random() % 3];
+      }
+
+      // Plant the key to get matches of long keys too
+      for(size_t i = 0; i + key.size() < text.size() && !key.empty(); 
+         i += 1 + random() % (2 * key.size()))
+      {
+         text.replace(i, key.size(), key);
+      }
+      if(aire::String::CountSubstr(text, key) != Count(text, key))
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+   if(aire::String::CountSubstr<char>("aaaaa", "aa") != 2 ||
+      aire::String::CountSubstr<char>("text", "") != 0 ||
+      aire::String::CountSubstr<wchar_t>(L"aaaaa", L"aa") != 2)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Substring replace ------------------------------------------------------
+int32_t substrReplace()
+{
+   int32_t result = EXIT_SUCCESS;
+   std::mt19937 random(13);
+   for(uint32_t round = 0; round < 500; round++)
+   {
+      std::string key(1 + random() % 3, 'a');
+      std::string value(random() % 5, 'x');
+      std::string text(random() % 100, 'a');
+      for(size_t i = 0; i < key.size(); i++)
+      {
+         key[i] = "ab"[random() % 2];
+      }
+      for(size_t i = 0; i < text.size(); i++)
+      {
+         text[i] = "ab"[random() % 2];
+      }
+
+      // Reference by repeated search from the end of the last match
+      std::string expected;
+      size_t position = 0;
+      size_t found = text.find(key);
+      while(found != std::string::npos)
+      {
+         expected += text.substr(position, found - position) + value;
+         position = found + key.size();
+         found = text.find(key, position);
+      }
+      expected += text.substr(position);
+      if(aire::String::ReplaceSubstr(text, key, value) != expected)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   // Appends to a string and writes to a buffer
+   std::string output("> ");
+   aire::String::ReplaceSubstr<char>("a-b-c", "-", "--", output);
+   char buffer[8];
+   size_t size = aire::String::ReplaceSubstr<char>("a-b-c", "-", "", 
+      buffer, sizeof(buffer));
+   if(output != "> a--b--c" || std::string(buffer, size) != "abc" ||
+      aire::String::ReplaceSubstr<char>("a-b-c", "-", "+++", buffer, 
+      sizeof(buffer)) != 9 || 
+      aire::String::ReplaceSubstr<char>("text", "", "x") != "text")
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Multi-pattern search ----------------------------------------------------
+//! \brief Leftmost longest matches by brute force.
+std::vector<aire::Matcher<char>::Match> FindAll(const std::string& text, 
+   const std::vector<std::string>& keys)
+{
+   std::vector<aire::Matcher<char>::Match> matches;
+   size_t i = 0;
+   while(i < text.size())
+   {
+      aire::Matcher<char>::Match best = {i, 0, 0};
+      for(size_t k = 0; k < keys.size(); k++)
+      {
+         if(keys[k].size() > best.length && 
+            text.compare(i, keys[k].size(), keys[k]) == 0)
+         {
+            best.length = keys[k].size();
+            best.key = static_cast<uint32_t>(k);
+         }
+      }
+      if(best.length > 0)
+      {
+         matches.push_back(best);
+      }
+      i += (best.length > 0) ? best.length : 1;
+   }
+   return matches;
+}
+
+int32_t multiPattern()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::Matcher<char> matcher;
+   matcher.add("he", "1");
+   matcher.add("she", "2");
+   matcher.add("his", "3");
+   matcher.add("hers", "4");
+   matcher.compile();
+   if(matcher.count("ushers and his hers") != 3 || 
+      matcher.replaceAll("ushers and his hers") != "u2rs and 3 4" ||
+      matcher.findAll("xhersx")[0].position != 1)
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // Random keys and texts on a small alphabet force many overlaps
+   std::mt19937 random(7);
+   for(uint32_t round = 0; round < 200; round++)
+   {
+      aire::Matcher<char> randomMatcher;
+      std::vector<std::string> keys(1 + random() % 8);
+      for(size_t k = 0; k < keys.size(); k++)
+      {
+         keys[k].resize(1 + random() % 4);
+         for(size_t i = 0; i < keys[k].size(); i++)
+         {
+            keys[k][i] = "abc"[random() % 3];
+         }
+         randomMatcher.add(keys[k]);
+      }
+      randomMatcher.compile();
+      std::string text(random() % 64, 'a');
+      for(size_t i = 0; i < text.size(); i++)
+      {
+         text[i] = "abcd"[random() % 4];
+      }
+      auto matches = randomMatcher.findAll(text);
+      auto expected = FindAll(text, keys);
+      if(matches.size() != expected.size())
+      {
+         result = EXIT_FAILURE;
+         continue;
+      }
+      for(size_t i = 0; i < matches.size(); i++)
+      {
+         if(matches[i].position != expected[i].position ||
+            matches[i].length != expected[i].length)
+         {
+            result = EXIT_FAILURE;
+         }
+      }
+   }
+
+   // Wide characters beyond the class table
+   aire::Matcher<wchar_t> wide;
+   wide.add(L"\u4e2d\u6587", L"zh");
+   wide.add(L"Ni", L"XYZ");
+   wide.compile();
+   if(wide.replaceAll(L"Ni \u4e2d\u6587 \u4e2d Ni") != L"XYZ zh \u4e2d XYZ")
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Views and tokens --------------------------------------------------------
+int32_t stringRef()
+{
+   int32_t result = EXIT_SUCCESS;
+   std::string text = "key=value; other=more";
+   aire::StringRef<char> view(text);
+   aire::StringRef<char> value = view.slice(4, 5);
+
+   // Slices share the characters of the text
+   if(value.getData() != text.data() + 4 || value != "value" ||
+      view.slice(100).getSize() != 0 || view.slice(17, 100) != "more" ||
+      view.find("=") != 3 || view.find("=", 4) != 16 || 
+      view.find("none") != aire::StringRef<char>::NPOS ||
+      value.toString() != "value")
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // Strings, literals and slices mix without copies
+   if(aire::String::CountSubstr(view.slice(0, 10), "e") != 2 ||
+      aire::String::CountSubstr("aaaaa", "aa") != 2 ||
+      aire::String::ReplaceSubstr(value, "a", std::string("A")) != "vAlue" ||
+      aire::String::ReplaceSubstr(L"a-b", L"-", L"+") != L"a+b")
+   {
+      result = EXIT_FAILURE;
+   }
+   char buffer[16];
+   if(aire::String::ReplaceSubstr(view.slice(0, 9), "=", ": ", buffer, 16) 
+      != 10 || aire::StringRef<char>(buffer, 10) != "key: value")
+   {
+      result = EXIT_FAILURE;
+   }
+
+   #if __cplusplus >= 201703L
+   std::string_view standard = view.slice(4, 5);
+   if(aire::String::CountSubstr(standard, "a") != 1)
+   {
+      result = EXIT_FAILURE;
+   }
+   #endif
+   return result;
+}
+
+template<class TokenizerType>
+std::string Join(const TokenizerType& tokenizer)
+{
+   std::string joined;
+   for(aire::StringRef<char> token : tokenizer)
+   {
+      joined.append("[").append(token.getData(), token.getSize()) += ']';
+   }
+   return joined;
+}
+
+int32_t tokenizer()
+{
+   int32_t result = EXIT_SUCCESS;
+   if(Join(aire::String::Split("a,,b,", ",")) != "[a][][b][]" ||
+      Join(aire::String::Split("a--b", "--")) != "[a][b]" ||
+      Join(aire::String::Split("", ",")) != "[]" ||
+      Join(aire::String::Split("a,b", "")) != "[a,b]" ||
+      Join(aire::String::Tokenize(" a \tbb  c ", " \t")) != "[a][bb][c]" ||
+      Join(aire::String::Tokenize(" \t ", " \t")) != "")
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // The tokens point into the text
+   std::string text = "x=1;y=2";
+   aire::Tokenizer<char> tokens = aire::String::Split(text, ";");
+   aire::StringRef<char> token;
+   size_t count = 0;
+   while(tokens.next(token))
+   {
+      count++;
+      if(token.getData() < text.data() || 
+         token.end() > text.data() + text.size())
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+   if(count != 2 || tokens.next(token))
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Parallel search --------------------------------------------------------
+std::string RandomText(std::mt19937& random, size_t size, const char* chars)
+{
+   std::string text(size, 'a');
+   size_t numChars = std::strlen(chars);
+   for(size_t i = 0; i < size; i++)
+   {
+      text[i] = chars[random() % numChars];
+   }
+   return text;
+}
+
+int32_t parallelSearch()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::ThreadPool pool(4);
+   std::mt19937 random(5);
+
+   // Tiny chunks put many matches across the boundaries, periodic texts 
+   // shift the matches of every chunk, keys above 9 characters correct 
+   // the shift after the parallel count
+   for(uint32_t round = 0; round < 500; round++)
+   {
+      const char* chars = (round % 4 == 0) ? "a" : "ab";
+      std::string text = RandomText(random, random() % 400, chars);
+      std::string key = RandomText(random, random() % 14, chars);
+      size_t grain = 1 + random() % 24;
+      if(aire::String::CountSubstr(pool, text, key, grain) != 
+         aire::String::CountSubstr(text, key) ||
+         aire::String::ReplaceSubstr(pool, text, key, "<>", grain) != 
+         aire::String::ReplaceSubstr(text, key, "<>"))
+      {
+         result = EXIT_FAILURE;
+      }
+
+      aire::Matcher<char> matcher;
+      for(uint32_t k = 0; k < 1 + random() % 4; k++)
+      {
+         matcher.add(RandomText(random, 1 + random() % 5, chars), 
+            std::string(random() % 3, '#'));
+      }
+      matcher.compile();
+      std::vector<aire::Matcher<char>::Match> matches = 
+         matcher.findAll(pool, text, grain);
+      std::vector<aire::Matcher<char>::Match> expected = 
+         matcher.findAll(text);
+      if(matches.size() != expected.size() || 
+         matcher.count(pool, text, grain) != expected.size() ||
+         matcher.replaceAll(pool, text, grain) != matcher.replaceAll(text))
+      {
+         result = EXIT_FAILURE;
+         continue;
+      }
+      for(size_t i = 0; i < matches.size(); i++)
+      {
+         if(matches[i].position != expected[i].position ||
+            matches[i].key != expected[i].key)
+         {
+            result = EXIT_FAILURE;
+         }
+      }
+   }
+
+   // Automatic chunks of a larger text, the matches of a periodic text 
+   // never meet
+   std::string text = RandomText(random, 1 << 20, "abc");
+   std::string periodic((1 << 20) + 1, 'a');
+   if(aire::String::CountSubstr(pool, text, "abca") != 
+      aire::String::CountSubstr(text, "abca") ||
+      aire::String::CountSubstr(pool, periodic, "aa") != (1 << 19) ||
+      aire::String::CountSubstr(pool, periodic, std::string(12, 'a')) != 
+      aire::String::CountSubstr(periodic, std::string(12, 'a')) ||
+      aire::String::CountSubstr(pool, L"a-b-c", L"-", 2) != 2 ||
+      aire::String::CountSubstr(pool, "", "a") != 0)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
 // --- Main --------------------------------------------------------------------
 int main()
 {
@@ -30,7 +404,7 @@ int main()
       {
          int result = EXIT_SUCCESS;   
          std::basic_string<char> text("Ni N NI nI NiiniNi Niii");      
-         uint32_t count = aire::String::CountSubstr<char>(text, "Ni");
+         uint64_t count = aire::String::CountSubstr<char>(text, "Ni");
          if(count != 4) 
          {
             result = EXIT_FAILURE;
@@ -43,7 +417,7 @@ int main()
       {
          int result = EXIT_SUCCESS;
          std::basic_string<wchar_t> text(L"Ni N NI nI NiiniNi Niii");      
-         uint32_t count = aire::String::CountSubstr<wchar_t>(text, L"Ni");
+         uint64_t count = aire::String::CountSubstr<wchar_t>(text, L"Ni");
          if(count != 4) 
          {
             result = EXIT_FAILURE;
@@ -82,6 +456,29 @@ int main()
       }
    );
 
+   test.add("Substring count", substrCount);
+   test.add("Substring replace", substrReplace);
+   test.add("Multi-pattern search", multiPattern);
+   test.add("String views", stringRef);
+   test.add("Split and tokenize", tokenizer);
+   test.add("Parallel search (4 threads)", parallelSearch);
+
+   std::mt19937 random(3);
+   std::string text = RandomText(random, 1 << 16, "abcdefgh");
+   test.addBenchmark("Substring count 64 KiB", [&text] () 
+      {
+         aire::Test::DoNotOptimize(aire::String::CountSubstr(text, "abc"));
+      }
+   );
+   aire::Matcher<char> matcher;
+   matcher.add("abc");
+   matcher.add("hgf");
+   matcher.compile();
+   test.addBenchmark("Multi-pattern count 64 KiB", [&] () 
+      {
+         aire::Test::DoNotOptimize(matcher.count(text));
+      }
+   );
 
    test.run();
   
@@ -16,10 +16,67 @@
 //! \brief Test driver of basic system information class. 
 
 #include <cstdlib>
+#include <thread>
 
 #include "System.h"
 #include "Test.h"
 
+// --- Topology ----------------------------------------------------------------
+int32_t topology()
+{
+   int32_t result = EXIT_SUCCESS;
+   const aire::Topology& topology = aire::System::GetTopology();
+
+   std::cout << "Model: " << topology.model << std::endl;
+   std::cout << "Sockets: " << topology.numSockets << " Cores: " 
+      << topology.numCores << " Threads: " << topology.numThreads 
+      << " Nodes: " << topology.numNodes << std::endl;
+   std::cout << "L1: " << topology.cacheL1 << " L2: " << topology.cacheL2 
+      << " L3: " << topology.cacheL3 << " Line: " << topology.lineSize 
+      << std::endl;
+   std::cout << "Quota: " << topology.cpuQuota << " Cpuset: " 
+      << topology.cpuset.size() << " Available: " 
+      << aire::System::GetNumAvailable() << std::endl;
+
+   if(topology.numSockets < 1 || topology.numCores < topology.numSockets ||
+      topology.numThreads < topology.numCores || topology.numNodes < 1 ||
+      aire::System::GetNumAvailable() < 1 || 
+      aire::System::GetNumAvailable() > topology.numThreads)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Thread pinning ----------------------------------------------------------
+int32_t pinning()
+{
+   int32_t result = EXIT_SUCCESS;
+
+   #if defined(__linux__)
+   const aire::Topology& topology = aire::System::GetTopology();
+   if(!topology.cpuset.empty())
+   {
+      int32_t cpu = topology.cpuset.back();
+      std::thread thread([&result, cpu] ()
+         {
+            if(!aire::System::PinThread(cpu) || 
+               aire::System::GetCurrentCpu() != cpu)
+            {
+               result = EXIT_FAILURE;
+            }
+         }
+      );
+      thread.join();
+   }
+   if(aire::System::PinThread(-1))
+   {
+      result = EXIT_FAILURE;
+   }
+   #endif
+   return result;
+}
+
 // --- Main --------------------------------------------------------------------
 int main()
 {
@@ -36,6 +93,8 @@ int main()
    aire::Test test("System-Test");
    
    test.add("Get system information", func);
+   test.add("Topology", topology);
+   test.add("Thread pinning", pinning);
 
    test.run();
   
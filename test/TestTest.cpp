@@ -0,0 +1,199 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file TestTest.cpp
+//! \brief Test driver of the test and regression classes. 
+
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Test.h"
+#include "Regression.h"
+
+// --- Benchmark harness -------------------------------------------------------
+int32_t benchmarkHarness()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::Test bench("Bench-Test");
+   bench.setBenchmark(3, 2);
+   uint64_t calls = 0;
+   bench.addBenchmark("Sleep", [] () 
+      {
+         std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+   );
+   bench.addBenchmark("Count", [&calls] () { calls++; });
+   std::streamsize precision = std::cout.precision();
+   bench.run();
+
+   // The sleep takes at least 100 us, the warmup scaled the iterations, 
+   // the output keeps its format
+   const std::vector<aire::Test::Benchmark>& stats = bench.getBenchmarks();
+   if(std::cout.precision() != precision || (std::cout.flags() & 
+      std::ios::fixed) != 0 || stats.size() != 2 || stats[0].name != "Count" || 
+      stats[1].samples.size() != 3 || stats[1].median < 100000 || 
+      stats[1].minimum > stats[1].median || stats[1].deviation < 0 ||
+      stats[1].opsPerSecond > 10000 || stats[0].iterations < 1000 || 
+      calls < 3 * stats[0].iterations)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Parallel runner ---------------------------------------------------------
+int32_t parallelRunner()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::Test inner("Parallel-Test");
+   inner.setParallel(4);
+   for(uint32_t i = 0; i < 4; i++)
+   {
+      inner.add("Sleep " + std::to_string(i), [i] () -> int 
+         {
+            std::cout << "Output " << i << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            std::clog << "Log " << i << std::endl;
+            return (i == 3) ? EXIT_FAILURE : EXIT_SUCCESS;
+         }
+      );
+   }
+   auto start = std::chrono::steady_clock::now();
+   inner.run();
+   auto span = std::chrono::steady_clock::now() - start;
+
+   // The cases overlap and report their own output in order
+   const std::vector<aire::Test::Case>& cases = inner.getCases();
+   if(span > std::chrono::milliseconds(700) || cases.size() != 4 ||
+      cases[0].output != "Output 0\nLog 0\n" || cases[2].name != "Sleep 2" ||
+      cases[2].error != 0 || cases[3].error == 0 || cases[1].time < 2e8)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Result files ------------------------------------------------------------
+int32_t resultFiles()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::Test inner("Result \"Test\"");
+   inner.setBenchmark(5, 1);
+   inner.add("Fails <here>", [] () -> int { return EXIT_FAILURE; });
+   inner.addBenchmark("Loop", [] () 
+      {
+         for(uint32_t i = 0; i < 100; i++)
+         {
+            aire::Test::DoNotOptimize(i);
+         }
+      }
+   );
+   inner.run();
+
+   std::ostringstream junit;
+   inner.writeJunit(junit);
+   std::stringstream json;
+   inner.writeJson(json);
+   std::vector<aire::Test::Benchmark> benchmarks;
+   if(junit.str().find("<testcase name=\"Fails &lt;here&gt;\"") == 
+      std::string::npos || junit.str().find("failures=\"1\"") == 
+      std::string::npos || json.str().find("\"Result \\\"Test\\\"\"") == 
+      std::string::npos || !aire::Regression::Read(json, benchmarks) ||
+      benchmarks.size() != 1 || benchmarks[0].name != "Loop" ||
+      benchmarks[0].samples.size() != 5)
+   {
+      return EXIT_FAILURE;
+   }
+
+   // The nested test left the result files of the driver alone
+   const char* path = std::getenv("AIRE_RESULTS");
+   if(path != nullptr)
+   {
+      std::ifstream file((std::string(path) + ".json").c_str());
+      std::ostringstream written;
+      written << file.rdbuf();
+      if(written.str().find("Result \\\"Test\\\"") != std::string::npos)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   // The samples have 10 significant digits
+   for(size_t i = 0; i < benchmarks[0].samples.size(); i++)
+   {
+      double sample = inner.getBenchmarks()[0].samples[i];
+      if(std::fabs(benchmarks[0].samples[i] - sample) > 1e-9 * sample)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   // A run compared to itself did not change, a run with every sample 
+   // above the slowest one of the baseline is slower
+   std::vector<aire::Test::Benchmark> slower = benchmarks;
+   double shift = *std::max_element(benchmarks[0].samples.begin(), 
+      benchmarks[0].samples.end()) + benchmarks[0].median;
+   for(size_t i = 0; i < slower[0].samples.size(); i++)
+   {
+      slower[0].samples[i] += shift;
+   }
+   slower[0].median += shift;
+   std::ostringstream report;
+   if(aire::Regression::Print(report, 
+      aire::Regression::Compare(benchmarks, benchmarks)) != 0 ||
+      aire::Regression::Print(report, 
+      aire::Regression::Compare(benchmarks, slower)) != 1 ||
+      !aire::Regression::Compare(slower, benchmarks)[0].isFaster)
+   {
+      result = EXIT_FAILURE;
+   }
+   std::cout << report.str();
+
+   // Exact and approximated p-values of the U test
+   std::vector<double> low = {1, 2, 3, 4, 5};
+   std::vector<double> high = {6, 7, 8, 9, 10};
+   std::vector<double> many(30);
+   for(size_t i = 0; i < many.size(); i++)
+   {
+      many[i] = static_cast<double>(i);
+   }
+   if(std::fabs(aire::Regression::GetProbability(high, low) - 1.0 / 252) > 
+      1e-12 || aire::Regression::GetProbability(low, high) != 1 ||
+      std::fabs(aire::Regression::GetProbability(many, many) - 0.5) > 0.05)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Main --------------------------------------------------------------------
+int main()
+{
+   aire::Test test("Test-Test");
+
+   test.add("Benchmark harness", benchmarkHarness);
+   test.add("Parallel runner", parallelRunner);
+   test.add("Result files", resultFiles);
+
+   test.run();
+  
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+// Copyright (C) 2012 The contributors of aire
+//
+// This program is free software: you can redistribute it and/or modify  
+// it under the terms of the GNU General Public License as published by  
+// the Free Software Foundation, either version 3 of the License.  
+//
+// This program is distributed in the hope that it will be useful,  
+// but WITHOUT ANY WARRANTY; without even the implied warranty of  
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the  
+// GNU General Public License for more details.  
+//
+// You should have received a copy of the GNU General Public License  
+// along with this program. If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file ThreadPoolTest.cpp
+//! \brief Test case for the work-stealing thread pool. 
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <future>
+#include <stdexcept>
+
+#include "Test.h"
+#include "ThreadPool.h"
+
+// --- Work deque --------------------------------------------------------------
+template<uint32_t N>
+int32_t workDeque()
+{
+   int32_t result = EXIT_SUCCESS;
+   const uint32_t numTasks = 100000;
+   aire::WorkDeque deque(4);
+   std::vector<aire::Task> tasks(numTasks);
+
+   // The owner pops the newest, a thief steals the oldest task
+   deque.push(&tasks[0]);
+   deque.push(&tasks[1]);
+   deque.push(&tasks[2]);
+   if(deque.pop() != &tasks[2] || deque.steal() != &tasks[0] || 
+      deque.pop() != &tasks[1] || deque.pop() != nullptr || 
+      deque.steal() != nullptr)
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // Every task is taken exactly once while the buffer grows
+   std::vector<std::atomic<uint32_t>> taken(numTasks);
+   for(uint32_t i = 0; i < numTasks; i++)
+   {
+      taken[i] = 0;
+   }
+   std::atomic<bool> isDone(false);
+   std::thread thieves[N];
+   for(uint32_t i = 0; i < N; i++)
+   {
+      thieves[i] = std::thread([&] ()
+         {
+            while(!isDone || deque.getSize() > 0)
+            {
+               aire::Task* task = deque.steal();
+               if(task != nullptr)
+               {
+                  taken[task - &tasks[0]]++;
+               }
+            }
+         }
+      );
+   }
+   for(uint32_t i = 0; i < numTasks; i++)
+   {
+      deque.push(&tasks[i]);
+      if(i % 3 == 0)
+      {
+         aire::Task* task = deque.pop();
+         if(task != nullptr)
+         {
+            taken[task - &tasks[0]]++;
+         }
+      }
+   }
+   isDone = true;
+   for(uint32_t i = 0; i < N; i++)
+   {
+      thieves[i].join();
+   }
+   for(uint32_t i = 0; i < numTasks; i++)
+   {
+      if(taken[i] != 1)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+   return result;
+}
+
+// --- Submit ------------------------------------------------------------------
+int32_t submit()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::ThreadPool pool;
+   std::vector<std::future<uint64_t>> futures;
+
+   for(uint64_t i = 0; i < 1000; i++)
+   {
+      futures.push_back(pool.submit([i] () { return i * i; }));
+   }
+   for(uint64_t i = 0; i < 1000; i++)
+   {
+      if(futures[i].get() != i * i)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   // Tasks wait for their subtasks without blocking a worker
+   auto outer = pool.submit([&pool] () 
+      {
+         auto inner = pool.submit([] () { return 42; });
+         return pool.getResult(inner) + 1;
+      }
+   );
+   if(outer.get() != 43 || pool.getNumThreads() == 0)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Parallel for and reduce -------------------------------------------------
+int32_t parallelFor()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::ThreadPool pool;
+   const size_t size = 1000000;
+   std::vector<uint32_t> values(size, 0);
+
+   pool.parallelFor(0, size, 1024, [&values] (size_t i) { values[i]++; });
+   for(size_t i = 0; i < size; i++)
+   {
+      if(values[i] != 1)
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+
+   uint64_t sum = pool.parallelReduce(0, size, 4096, uint64_t(0),
+      [] (size_t first, size_t last, uint64_t value)
+      {
+         for(size_t i = first; i < last; i++)
+         {
+            value += i;
+         }
+         return value;
+      },
+      [] (uint64_t left, uint64_t right) { return left + right; }
+   );
+   if(sum != uint64_t(size) * (size - 1) / 2 || 
+      pool.parallelReduce(5, 5, 1, 7, [] (size_t, size_t, int value)
+         { return value; }, [] (int, int) { return 0; }) != 7)
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // An exception of any index reaches the caller, the pool stays usable
+   bool isThrown = false;
+   try
+   {
+      pool.parallelFor(0, size, 64, [] (size_t i) 
+         {
+            if(i % 100000 == 99999)
+            {
+               throw std::runtime_error("index");
+            }
+         }
+      );
+   }
+   catch(std::runtime_error&)
+   {
+      isThrown = true;
+   }
+   pool.parallelFor(0, size, 1024, [&values] (size_t i) { values[i]++; });
+   if(!isThrown || values[0] != 2 || values[size - 1] != 2)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+int32_t nestedFor()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::ThreadPool pool;
+   std::atomic<uint32_t> count(0);
+
+   pool.parallelFor(0, 64, 1, [&] (size_t) 
+      {
+         pool.parallelFor(0, 1000, 16, [&count] (size_t) { count++; });
+      }
+   );
+   if(count != 64000)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Main --------------------------------------------------------------------
+int main()
+{
+   aire::Test test("ThreadPool-Test");
+
+   test.add("Work deque (4 thieves)", workDeque<4>);
+   test.add("Submit", submit);
+   test.add("Parallel for and reduce", parallelFor);
+   test.add("Nested parallel for", nestedFor);
+
+   test.run();
+  
+   return EXIT_SUCCESS;
+}
@@ -19,18 +19,212 @@
 #include <cstdlib>
 #include <thread>
 #include <chrono>
+#include <sstream>
+
+#if defined(__linux__)
+#include <dirent.h>
+#endif
 
 #include "Test.h"
 #include "Timer.h"
 #include "Watch.h"
+#include "ThreadWatch.h"
+#include "Histogram.h"
+#include "Counters.h"
+#include "String.h"
 
 //! \brief Singleton type of the watch.
 typedef aire::Singleton<aire::Watch<char>> StopWatch;
 
+// --- Thread watch ------------------------------------------------------------
+template<uint32_t N>
+int32_t threadWatch()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::ThreadWatch<char> watch;
+   std::thread threads[N];
+   watch.setHistogram(true);
+   watch.setTrace(64);
+
+   for(uint32_t i = 0; i < N; i++)
+   {
+      threads[i] = std::thread([&watch] ()
+         {
+            for(uint32_t k = 0; k < 100; k++)
+            {
+               watch.getTimer("Worker timer")->start();
+               watch.getTimer("Worker timer")->stop();
+               watch.start("Worker scope");
+               watch.start("Inner scope");
+               watch.stop("Inner scope");
+               watch.stop("Worker scope");
+            }
+         }
+      );
+   }
+
+   for(uint32_t i = 0; i < N; i++)
+   {
+      threads[i].join();
+   }
+
+   if(watch.getNumThreads() != N)
+   {
+      result = EXIT_FAILURE;
+   }
+
+   watch.getTimer("Main timer")->start();
+   watch.getTimer("Main timer")->stop();
+   if(watch.getWatch().findTimer("Worker timer")->getCount() != 0)
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // The scopes of all threads are merged into one call tree
+   std::ostringstream out;
+   watch.printTime(out, false);
+   if(out.str().find("Worker timer") == std::string::npos || 
+      out.str().find("\n  Inner scope") == std::string::npos ||
+      out.str().find("Exclusive") == std::string::npos)
+   {
+      result = EXIT_FAILURE;
+   }
+   std::cout << out.str();
+
+   // Every thread keeps the latest 64 of its 200 spans
+   std::ostringstream trace;
+   watch.writeTrace(trace);
+   if(aire::String::CountSubstr<char>(trace.str(), " scope\"") != 64 * N ||
+      aire::String::CountSubstr<char>(trace.str(), "\"Inner scope\"") != 
+      32 * N || trace.str().find("\"tid\":7") == std::string::npos)
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // The cache of the main thread does not point to a freed table
+   watch.destroy();
+   watch.getTimer("Main timer")->start();
+   watch.getTimer("Main timer")->stop();
+   if(watch.getNumThreads() != 1 || 
+      watch.getWatch().findTimer("Main timer")->getCount() != 1)
+   {
+      result = EXIT_FAILURE;
+   }
+   return result;
+}
+
+// --- Hardware counters -------------------------------------------------------
+//! \brief Number of open file descriptors of the process, 0 if unknown.
+size_t GetNumFiles()
+{
+   size_t count = 0;
+   #if defined(__linux__)
+   DIR* dir = opendir("/proc/self/fd");
+   if(dir != nullptr)
+   {
+      while(readdir(dir) != nullptr)
+      {
+         count++;
+      }
+      closedir(dir);
+   }
+   #endif
+   return count;
+}
+
+int32_t hardwareCounters()
+{
+   int32_t result = EXIT_SUCCESS;
+   aire::Timer t;
+   t.setCounters(true);
+   volatile uint64_t sum = 0;
+   for(uint32_t i = 0; i < 100; i++)
+   {
+      t.start();
+      for(uint32_t k = 0; k < 1000; k++)
+      {
+         sum = sum + k;
+      }
+      t.stop();
+   }
+
+   // The time is measured with or without permission for perf events
+   aire::Counters* counters = t.getCounters();
+   if(t.getCount() != 100 || t.getTime() <= 0 || counters == nullptr)
+   {
+      return EXIT_FAILURE;
+   }
+   if(counters->isAvailable())
+   {
+      if(counters->getCount() != 100 || 
+         (counters->isSupported(aire::Counters::INSTRUCTIONS) && 
+         counters->getValue(aire::Counters::INSTRUCTIONS) < 100000))
+      {
+         result = EXIT_FAILURE;
+      }
+   }
+   else if(counters->getValue(aire::Counters::CYCLES) != 0 || 
+      counters->getIpc() != 0)
+   {
+      result = EXIT_FAILURE;
+   }
+   std::cout << "Counters " << (counters->isAvailable() ? "available" : 
+      "not available") << std::endl;
+
+   // Tables print a line with the events of available counters
+   aire::Watch<char> watch;
+   watch.setCounters(true);
+   watch.start("Loop");
+   sum = sum + 1;
+   watch.stop("Loop");
+   std::ostringstream stream;
+   watch.printTime(stream);
+   if((stream.str().find("instructions") != std::string::npos) != 
+      watch.findTimer("Loop")->getCounters()->isAvailable())
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // Merged counters of other threads
+   aire::Counters merged;
+   merged.merge(*counters);
+   merged.merge(*counters);
+   if(merged.isAvailable() != counters->isAvailable() || 
+      merged.getValue(aire::Counters::CYCLES) != 
+      2 * counters->getValue(aire::Counters::CYCLES))
+   {
+      result = EXIT_FAILURE;
+   }
+
+   // Nested timers of a thread share the group of the thread
+   size_t numFiles = GetNumFiles();
+   std::vector<aire::Timer> timers(64);
+   for(size_t i = 0; i < timers.size(); i++)
+   {
+      timers[i].setCounters(true);
+      timers[i].start();
+   }
+   for(size_t i = timers.size(); i > 0; i--)
+   {
+      timers[i - 1].stop();
+   }
+   if(GetNumFiles() > numFiles + aire::Counters::NUM_EVENTS || 
+      timers[0].getCounters()->isAvailable() != counters->isAvailable() ||
+      timers[0].getCounters()->getValue(aire::Counters::INSTRUCTIONS) < 
+      timers[63].getCounters()->getValue(aire::Counters::INSTRUCTIONS))
+   {
+      result = EXIT_FAILURE;
+   }
+   t.getCounters()->printCounts(std::cout, true);
+   std::cout << std::endl;
+   return result;
+}
+
 // --- Main --------------------------------------------------------------------
 int main()
 {
    aire::Test test("Watch-Test");
+   StopWatch::GetInstance()->setHistogram(true);
 
    test.add("Check timer and overhead", [] () -> int 
       {
@@ -64,16 +258,239 @@ int main()
    test.add("Nested timer", [] () -> int 
       {
          int result = EXIT_SUCCESS;
-         StopWatch::GetInstance()->getTimer("Outer timer")->start();
+         StopWatch::GetInstance()->start("Outer timer");
+         std::this_thread::sleep_for(std::chrono::milliseconds(10));
+         StopWatch::GetInstance()->start("Inner timer");
          std::this_thread::sleep_for(std::chrono::milliseconds(10));
-         StopWatch::GetInstance()->getTimer("Inner timer")->start();
+         StopWatch::GetInstance()->stop("Inner timer");
+         StopWatch::GetInstance()->stop("Outer timer");
+         return result;
+      }
+   );
+
+   test.add("Thread watch (8 threads)", threadWatch<8>);
+
+   test.add("Timer tree", [] () -> int 
+      {
+         int result = EXIT_SUCCESS;
+         aire::Watch<char> watch;
+         watch.setTrace(1000);
+         for(unsigned int i = 0; i < 10; i++)
+         {
+            AIRE_SCOPE_TIMER(watch, "Pipeline");
+            {
+               AIRE_SCOPE_TIMER(watch, "Parse");
+               std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            {
+               AIRE_SCOPE_TIMER(watch, "Compute");
+               watch.start("Parse");
+               watch.stop("Parse");
+            }
+         }
+
+         // Pipeline, Pipeline/Parse, Pipeline/Compute/Parse
+         if(watch.getNumScopes() != 4 || 
+            watch.getTimer("Pipeline")->getCount() != 10 ||
+            watch.getTimer("Parse")->getCount() != 20 ||
+            watch.getTimer("Parse")->getTime() >= 
+            watch.getTimer("Pipeline")->getTime())
+         {
+            result = EXIT_FAILURE;
+         }
+
+         std::ostringstream out;
+         watch.printTime(out, false);
+         if(out.str().find("\n    Parse") == std::string::npos)
+         {
+            result = EXIT_FAILURE;
+         }
+         std::cout << out.str();
+
+         std::ostringstream trace;
+         watch.writeTrace(trace);
+         if(watch.getTrace()->getSize() != 40 || 
+            trace.str().find("{\"name\":\"Compute\"") == std::string::npos)
+         {
+            result = EXIT_FAILURE;
+         }
+         std::cout << trace.str().substr(0, 200) << std::endl;
+
+         // The flat timer records the outermost of recursive scopes once
+         watch.start("Recursive");
+         watch.start("Recursive");
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         watch.stop("Recursive");
+         watch.stop("Recursive");
+         if(watch.getTimer("Recursive")->getCount() != 1 ||
+            watch.getTimer("Recursive")->isRunning() ||
+            watch.getTimer("Recursive")->getTime() < 1e6)
+         {
+            result = EXIT_FAILURE;
+         }
+         return result;
+      }
+   );
+
+   test.add("Histogram percentiles", [] () -> int 
+      {
+         int result = EXIT_SUCCESS;
+         aire::Histogram lower;
+         aire::Histogram upper;
+         for(uint64_t value = 1; value <= 100000; value++)
+         {
+            (value <= 50000 ? lower : upper).record(value);
+         }
+         lower.merge(upper);
+         double p50 = static_cast<double>(lower.getPercentile(50.0));
+         double p999 = static_cast<double>(lower.getPercentile(99.9));
+         if(lower.getCount() != 100000 || lower.getMin() != 1 || 
+            lower.getMax() != 100000 || std::fabs(p50 - 5e4) > 5e4 / 32 ||
+            std::fabs(p999 - 99900) > 99900.0 / 32)
+         {
+            result = EXIT_FAILURE;
+         }
+
+         // Every bucket ends right before the next one begins
+         for(uint32_t i = 0; i + 1 < aire::Histogram::NUM_BUCKETS; i++)
+         {
+            uint64_t highest = aire::Histogram::GetHighest(i);
+            if(aire::Histogram::GetIndex(highest) != i ||
+               aire::Histogram::GetIndex(highest + 1) != i + 1)
+            {
+               result = EXIT_FAILURE;
+            }
+         }
+
+         aire::Timer t;
+         t.setHistogram(true);
+         for(unsigned int i = 0; i < 100; i++)
+         {
+            t.start();
+            t.stop();
+         }
+         if(t.getHistogram()->getCount() != 100 || t.getPercentile(99) < 0)
+         {
+            result = EXIT_FAILURE;
+         }
+         lower.printPercentiles(std::cout);
+         std::cout << std::endl;
+         return result;
+      }
+   );
+
+   test.add("Time stamp counter timer", [] () -> int 
+      {
+         int result = EXIT_SUCCESS;
+         aire::TscTimer t;
+
+         t.start();
          std::this_thread::sleep_for(std::chrono::milliseconds(10));
-         StopWatch::GetInstance()->getTimer("Inner timer")->stop();
-         StopWatch::GetInstance()->getTimer("Outer timer")->stop();
+         t.stop();
+
+         std::cout << "Invariant: " << aire::TscClock::IsInvariant() 
+                   << " Available: " << aire::TscClock::IsAvailable()
+                   << " ns/tick: " << aire::TscClock::GetNanosPerTick()
+                   << " Wall time: " << t.getTime(false) << std::endl;
+         if(t.getTime(false) < 1e7 || t.getTime(false) > 1e9 || 
+            (!aire::TscClock::IsAvailable() && 
+            aire::TscClock::GetNanosPerTick() != 1.0))
+         {
+            result = EXIT_FAILURE;
+         }
+         return result;
+      }
+   );
+
+   test.add("Overhead calibration", [] () -> int 
+      {
+         int result = EXIT_SUCCESS;
+         aire::Timer t;
+         aire::TscTimer tsc;
+         for(unsigned int i = 0; i < 1000; i++)
+         {
+            t.start();
+            t.stop();
+            tsc.start();
+            tsc.stop();
+         }
+
+         std::cout << "Overhead: " << aire::Timer::GetOverhead() 
+                   << " Empty: " << t.getTime(true)
+                   << " TSC overhead: " << aire::TscTimer::GetOverhead()
+                   << " TSC empty: " << tsc.getTime(true) << std::endl;
+         if(t.getTime(true) > 1000 || tsc.getTime(true) > 1000)
+         {
+            result = EXIT_FAILURE;
+         }
+         return result;
+      }
+   );
+
+   test.add("Timer handle", [] () -> int 
+      {
+         int result = EXIT_SUCCESS;
+         aire::Watch<char>& watch = *StopWatch::GetInstance();
+         size_t handle = watch.getHandle("Handle timer");
+         if(watch.getHandle("Handle timer") != handle ||
+            watch.getTimer(handle) != watch.getTimer("Handle timer"))
+         {
+            result = EXIT_FAILURE;
+         }
+         for(unsigned int i = 0; i < 1000; i++)
+         {
+            AIRE_SCOPE_TIMER(watch, "Handle timer");
+         }
+         if(watch.getTimer(handle)->getCount() != 1000)
+         {
+            result = EXIT_FAILURE;
+         }
+
+         // A call site registers the name again for another watch
+         auto measure = [] (aire::Watch<char>& current) 
+            {
+               AIRE_SCOPE_TIMER(current, "Site timer");
+            };
+         aire::Watch<char> first;
+         aire::Watch<char> second;
+         second.getHandle("Other timer");
+         measure(first);
+         measure(second);
+         first.destroy();
+         first.initialize();
+         measure(first);
+         if(first.findTimer("Site timer")->getCount() != 1 ||
+            second.findTimer("Site timer")->getCount() != 1 ||
+            second.findTimer("Other timer")->getCount() != 0)
+         {
+            result = EXIT_FAILURE;
+         }
          return result;
       }
    );
 
+   test.add("Hardware counters", hardwareCounters);
+
+   test.addBenchmark("Timer start and stop", [] () 
+      {
+         aire::Timer timer;
+         timer.start();
+         aire::Test::DoNotOptimize(timer.stop());
+      }
+   );
+   test.addBenchmark("TSC timer start and stop", [] () 
+      {
+         aire::TscTimer timer;
+         timer.start();
+         aire::Test::DoNotOptimize(timer.stop());
+      }
+   );
+   test.addBenchmark("Scope timer", [] () 
+      {
+         AIRE_SCOPE_TIMER(*StopWatch::GetInstance(), "Benchmark timer");
+      }
+   );
+
    test.run();
 
    StopWatch::GetInstance()->printTime(std::cout, false);